@@ -15,7 +15,12 @@
 #include	"dirio.h"
 #include	"fileread.h"
 #include	"answers.h"
+#include	"prefetch.h"
+#include	"journal.h"
 #include	"play.h"
+#include	"hint.h"
+#include	"census.h"
+#include	"generate.h"
 #include	"userio.h"
 
 /* The default directory for the puzzle files.
@@ -32,19 +37,27 @@ typedef	struct startupdata {
     int		silence;	/* FALSE if we are allowed to ring the bell */
     int		listseries;	/* TRUE if the files should be displayed */
     int		writeanswer;	/* TRUE if the solution should be displayed */
+    int		explore;	/* TRUE if the positions should be counted */
+    int		census;		/* TRUE if every puzzle should be counted */
+    int		generate;	/* TRUE if new puzzles should be created */
+    int		cutloops;	/* TRUE if loops should be cut from the moves */
 } startupdata;
 
 /* Online help.
  */
 static char const *yowzitch = 
-	"Usage: cblocks [-hvqlw] [-D DIR] [-S DIR] [NAME] [-LEVEL]\n"
+	"Usage: cblocks [-hvqlpwecg] [-D DIR] [-S DIR] [NAME] [-LEVEL]\n"
 	"   -h  Display this help\n"
 	"   -v  Display version information\n"
 	"   -l  Print out the list of available setup files\n"
 	"   -w  Print out the solution for the specified puzzle\n"
+	"   -e  Count every position reachable in the specified puzzle\n"
+	"   -c  Count every position reachable in every puzzle in NAME\n"
+	"   -g  Print the hardest starting positions for the specified puzzle\n"
 	"   -D  Read setup files from DIR instead of the default\n"
 	"   -S  Save games in DIR instead of the default\n"
 	"   -q  Be quiet; don't ring the bell\n"
+	"   -p  Cut out moves that return to an earlier position\n"
 	"NAME specifies which setup file to read.\n"
 	"LEVEL specifies which level number to start with.\n"
 	"(Press ? during the game for further help.)\n";
@@ -86,6 +99,7 @@ int readlevel(void)
 {
     int	level = currentgame;
 
+    stopprefetch();
     while (level < 0) {
 	if (!currentseries)
 	    return FALSE;
@@ -189,6 +203,59 @@ static void pickstartinggame(char const *startfile, int startlevel)
     }
 }
 
+/* If the previous run left a puzzle unfinished, make it the current
+ * puzzle and return the events that were recorded for it. NULL is
+ * returned if there is no such puzzle, or if it can no longer be
+ * found, in which case the current puzzle is left as it was.
+ */
+static char *pickjournaledgame(void)
+{
+    char       *filename, *events;
+    int		oldseries, oldgame, level, i;
+
+    if (!readjournal(&filename, &level, &events))
+	return NULL;
+    for (i = 0 ; i < seriescount ; ++i)
+	if (!strcmp(serieslist[i].filename, filename))
+	    break;
+    free(filename);
+    if (i < seriescount) {
+	oldseries = currentseries;
+	oldgame = currentgame;
+	currentseries = i;
+	currentgame = level;
+	if (readlevel() && currentseries == i && currentgame == level)
+	    return events;
+	currentseries = oldseries;
+	currentgame = oldgame;
+	readlevel();
+    }
+    free(events);
+    return NULL;
+}
+
+/* Explore the positions of the current puzzle, or if all is TRUE,
+ * every puzzle in the current series, and print out how many
+ * positions lie at each distance from the start. Temporary files are
+ * created in $TMPDIR, or /tmp if that isn't set.
+ */
+static int explorepuzzles(int all)
+{
+    gameseries *series;
+    char const *tmpdir;
+    int		n;
+
+    if (!(tmpdir = getenv("TMPDIR")) || !*tmpdir)
+	tmpdir = "/tmp";
+    series = serieslist + currentseries;
+    if (!all)
+	return takecensus(series, currentgame, currentgame, tmpdir);
+    for (n = 0 ; readlevelinseries(series, n) ; ++n) ;
+    if (!series->count)
+	return FALSE;
+    return takecensus(series, 0, series->count - 1, tmpdir);
+}
+
 /*
  * User interface functions
  */
@@ -203,7 +270,9 @@ static void drawgoalscreen(void)
  */
 static int partialsave(void)
 {
-    return replaceanswer(TRUE) && saveanswers(serieslist + currentseries);
+    stopprefetch();
+    return replaceanswer(TRUE)
+	&& saveanswers(serieslist + currentseries, currentgame);
 }
 
 /* Display information on the various key commands during a game.
@@ -214,10 +283,13 @@ static void drawhelpscreen(void)
 				   "arrows\0move the selection cursorwise",
 				   "H J K L\0move the selected block",
 				   "g\0display the puzzle's goal",
+				   "i\0show a hint for the next step",
 				   "x\0undo move",
 				   "X\0undo step",
 				   "z\0redo undone move",
 				   "Z\0redo undone step",
+				   "[ ]\0undo or redo a tenth of the moves",
+				   "{ }\0undo or redo all of the moves",
 				   "R\0return to starting position",
 				   "s\0save current position",
 				   "r\0restore saved position",
@@ -255,11 +327,16 @@ static int doturn(void)
       case 'z':     if (!redomove())			ding();	break;
       case 'X':     if (!undostep())			ding();	break;
       case 'Z':     if (!redostep())			ding();	break;
+      case '[':     if (!seektenths(-1))		ding();	break;
+      case ']':     if (!seektenths(+1))		ding();	break;
+      case '{':     if (!seektenths(-10))		ding();	break;
+      case '}':     if (!seektenths(+10))		ding();	break;
       case 'R':     initgamestate();				break;
       case 's':     savestate();				break;
       case 'r':     if (!restorestate())		ding();	break;
       case 'S':     if (!partialsave())			ding();	break;
       case 'g':	    drawgoalscreen();				break;
+      case 'i':     if (!showhint())			ding();	break;
       case '?':     drawhelpscreen();				break;
       case '\f':						break;
       case 'P':     return -1;
@@ -291,7 +368,9 @@ static int endinput(int endofsession)
 }
 
 /* Play the current puzzle. Return when the user solves the puzzle or
- * requests a different puzzle.
+ * requests a different puzzle. The screen is not redrawn while more
+ * keystrokes are waiting, so that held-down keys do not leave the
+ * display lagging behind.
  */
 static void playgame(void)
 {
@@ -304,7 +383,10 @@ static void playgame(void)
 
     n = 0;
     if (drawscreen(index)) {
+	prefetchlevels(serieslist + currentseries, currentgame);
 	do {
+	    searchforhint();
+	    flushjournal();
 	    if ((n = doturn())) {
 		currentgame += n;
 		if (readlevel())
@@ -312,11 +394,16 @@ static void playgame(void)
 		currentgame -= n;
 		ding();
 	    }
-	    drawscreen(index);
+	    if (!inputpending() || checkfinished())
+		drawscreen(index);
 	} while (!checkfinished());
 	freesavedstates();
-	if (checkfinished() && replaceanswer(FALSE))
-	    saveanswers(serieslist + currentseries);
+	stopprefetch();
+	if (checkfinished()) {
+	    if (replaceanswer(FALSE))
+		saveanswers(serieslist + currentseries, currentgame);
+	    clearjournal();
+	}
     }
 
     if (!n) {
@@ -357,8 +444,12 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
     start->silence = FALSE;
     start->listseries = FALSE;
     start->writeanswer = FALSE;
+    start->explore = FALSE;
+    start->census = FALSE;
+    start->generate = FALSE;
+    start->cutloops = FALSE;
 
-    while ((ch = getopt(argc, argv, "0123456789D:S:hlqvw")) != EOF) {
+    while ((ch = getopt(argc, argv, "0123456789D:S:ceghlpqvw")) != EOF) {
 	switch (ch) {
 	  case '0': case '1': case '2': case '3': case '4':
 	  case '5': case '6': case '7': case '8': case '9':
@@ -368,7 +459,11 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
 	  case 'S':	copypath(savedir, optarg);			break;
 	  case 'q':	start->silence = TRUE;				break;
 	  case 'l':	start->listseries = TRUE;			break;
+	  case 'p':	start->cutloops = TRUE;				break;
 	  case 'w':	start->writeanswer = TRUE;			break;
+	  case 'e':	start->explore = TRUE;				break;
+	  case 'c':	start->census = TRUE;				break;
+	  case 'g':	start->generate = TRUE;				break;
 	  case 'h':	fputs(yowzitch, stdout); exit(EXIT_SUCCESS);
 	  case 'v':	fputs(vourzhon, stdout); exit(EXIT_SUCCESS);
 	  default:	fputs(yowzitch, stderr); exit(EXIT_FAILURE);
@@ -388,6 +483,7 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
 int main(int argc, char *argv[])
 {
     startupdata	start;
+    char       *events;
 
     initwithcmdline(argc, argv, &start);
 
@@ -410,12 +506,28 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
     }
 
+    if (start.explore || start.census)
+	return explorepuzzles(start.census) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (start.generate)
+	return generatepuzzles(serieslist[currentseries].games + currentgame)
+			? EXIT_SUCCESS : EXIT_FAILURE;
+
     if (!ioinitialize(start.silence))
 	die("Failed to initialize terminal.");
+    setloopcutting(start.cutloops);
+
+    events = *start.filename || start.level ? NULL : pickjournaledgame();
 
     for (;;) {
+	reservelevels(serieslist + currentseries, currentgame + 2);
 	selectgame(serieslist[currentseries].games + currentgame, currentgame);
-	initgamestate();
+	sethintgame(serieslist[currentseries].games + currentgame);
+	startjournal(serieslist[currentseries].filename, currentgame);
+	if (!events || !replayjournal(events))
+	    initgamestate();
+	free(events);
+	events = NULL;
 	playgame();
 	if (!readlevel())
 	    break;
@@ -9,14 +9,12 @@
 
 #include	<limits.h>
 
-/* The maximum dimensions of a puzzle.
+/* The maximum dimensions of a puzzle. Each map is allocated to the
+ * size of its own puzzle, and one row of a map array is as wide as
+ * the puzzle.
  */
-#define	MAXWIDTH	32
-#define	MAXHEIGHT	32
-
-/* The width of one row in a map array.
- */
-#define	XSIZE		MAXWIDTH
+#define	MAXWIDTH	255
+#define	MAXHEIGHT	255
 
 /* The four directions.
  */
@@ -31,30 +29,35 @@
 
 /* Bitmasks for isolating parts of a cell's value.
  */
-#define	BLOCKID_MASK	0x000000FF
-#define	DOORSTAMP_MASK	0x3FFF0000
+#define	BLOCKID_MASK	0x00000FFF
+#define	DOOR_MASK	0x30000000
 
 /* Special block IDs.
  */
 #define	WALLID		0x00000001
 #define	KEYID		0x00000002
 #define	FIRSTID		0x00000003
-#define	LASTID		0x000000FF
+#define	LASTID		0x00000FFF
 
 /* Bitflags added to objects indicating how they adjoin across cells.
  */
-#define	EXTENDNORTH	0x00000100
-#define	EXTENDEAST	0x00000200
-#define	EXTENDSOUTH	0x00000400
-#define	EXTENDWEST	0x00000800
+#define	EXTENDNORTH	0x00001000
+#define	EXTENDEAST	0x00002000
+#define	EXTENDSOUTH	0x00004000
+#define	EXTENDWEST	0x00008000
 
 /* Bitflags added to objects that can be passed over indicating how
  * they adjoin across cells.
  */
-#define	FEXTENDNORTH	0x00001000
-#define	FEXTENDEAST	0x00002000
-#define	FEXTENDSOUTH	0x00004000
-#define	FEXTENDWEST	0x00008000
+#define	FEXTENDNORTH	0x00010000
+#define	FEXTENDEAST	0x00020000
+#define	FEXTENDSOUTH	0x00040000
+#define	FEXTENDWEST	0x00080000
+
+/* Bitflags marking a door cell, and a door that has not been opened.
+ */
+#define	DOOR		0x20000000
+#define	DOORCLOSED	0x10000000
 
 /* Other cell bitflags.
  */
@@ -65,9 +68,9 @@
  */
 #define	blockid(c)	((int)((c) & BLOCKID_MASK))
 
-/* Extract a door cell's timestamp.
+/* Return TRUE if a cell is a door that has not been opened.
  */
-#define	doortime(c)	((int)(((c) & DOORSTAMP_MASK) >> 16))
+#define	isdoorclosed(c)	((c) & DOORCLOSED)
 
 /* The cells of our map are stored in a regular unsigned 32-bit value.
  */
@@ -0,0 +1,176 @@
+/* census.c: Functions for counting the positions of many puzzles.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<pthread.h>
+#include	"gen.h"
+#include	"cblocks.h"
+#include	"fileread.h"
+#include	"search.h"
+#include	"census.h"
+
+/* The least amount of memory given to each thread's search.
+ */
+#define	MINBUFSIZE	(1024 * 1024)
+
+/* The possible outcomes of exploring a puzzle.
+ */
+enum { CENSUS_PENDING, CENSUS_DONE, CENSUS_TOOBIG, CENSUS_FILEERR };
+
+/* The work shared among the threads.
+ */
+typedef	struct census {
+    gameseries	       *series;		/* the puzzles to explore */
+    char const	       *tmpdir;		/* where to put temporary files */
+    long		bufsize;	/* memory for each thread's search */
+    int			first;		/* the first puzzle to explore */
+    int			next;		/* the next puzzle to be taken */
+    int			last;		/* the last puzzle to explore */
+    searchstats	       *results;	/* the results for each puzzle */
+    char	       *outcomes;	/* the outcome for each puzzle */
+} census;
+
+/* The lock protecting the census's next and outcomes fields, and the
+ * condition that signals a newly finished puzzle.
+ */
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	finished = PTHREAD_COND_INITIALIZER;
+
+/* Return the number of processors available.
+ */
+static int getcpucount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long	n;
+
+    if ((n = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+	return (int)n;
+#endif
+    return 1;
+}
+
+/* Explore puzzles, taking the next unclaimed one each time, until
+ * none are left.
+ */
+static void *censusthread(void *data)
+{
+    census     *c = data;
+    searchinfo *info;
+    int		n, outcome;
+
+    if (!(info = malloc(sizeof *info)))
+	memerrexit();
+    for (;;) {
+	pthread_mutex_lock(&lock);
+	n = c->next++;
+	pthread_mutex_unlock(&lock);
+	if (n > c->last)
+	    break;
+	if (!initsearch(info, c->series->games + n))
+	    outcome = CENSUS_TOOBIG;
+	else if (!exploreondisk(info, c->tmpdir, c->bufsize,
+				c->results + n - c->first))
+	    outcome = CENSUS_FILEERR;
+	else
+	    outcome = CENSUS_DONE;
+	pthread_mutex_lock(&lock);
+	c->outcomes[n - c->first] = outcome;
+	pthread_cond_broadcast(&finished);
+	pthread_mutex_unlock(&lock);
+    }
+    free(info);
+    return NULL;
+}
+
+/* Print out the results for one puzzle. If the series file gives the
+ * length of the shortest solution and it disagrees, that is noted.
+ */
+static void printresults(gamesetup const *game, int number,
+			 searchstats const *stats)
+{
+    int	i;
+
+    printf("; Puzzle %d: %s\n", number, game->name);
+    for (i = 0 ; i < stats->depth ; ++i)
+	printf("%5d steps: %ld\n", i, stats->layers[i]);
+    printf("%ld positions, %ld solved, farthest %d steps",
+	   stats->statecount, stats->goalcount, stats->depth - 1);
+    if (stats->firstgoal >= 0)
+	printf(", shortest solution %d steps", stats->firstgoal);
+    if (game->beststepknown && game->beststepknown != stats->firstgoal)
+	printf(" (file says %d)", game->beststepknown);
+    putchar('\n');
+}
+
+/* Explore every position of each puzzle from first to last.
+ */
+int takecensus(gameseries *series, int first, int last, char const *tmpdir)
+{
+    census	c;
+    pthread_t  *threads;
+    int		threadcount, started, n;
+    int		ret = TRUE;
+
+    c.series = series;
+    c.tmpdir = tmpdir;
+    c.first = c.next = first;
+    c.last = last;
+    if (!(c.results = calloc(last - first + 1, sizeof *c.results)))
+	memerrexit();
+    if (!(c.outcomes = calloc(last - first + 1, sizeof *c.outcomes)))
+	memerrexit();
+
+    threadcount = getcpucount();
+    if (threadcount > last - first + 1)
+	threadcount = last - first + 1;
+    c.bufsize = SEARCHBUFSIZE / threadcount;
+    if (c.bufsize < MINBUFSIZE)
+	c.bufsize = MINBUFSIZE;
+    if (!(threads = malloc(threadcount * sizeof *threads)))
+	memerrexit();
+    for (started = 0 ; started < threadcount ; ++started)
+	if (pthread_create(threads + started, NULL, censusthread, &c))
+	    break;
+    if (!started)
+	censusthread(&c);
+
+    for (n = first ; n <= last ; ++n) {
+	pthread_mutex_lock(&lock);
+	while (c.outcomes[n - first] == CENSUS_PENDING)
+	    pthread_cond_wait(&finished, &lock);
+	pthread_mutex_unlock(&lock);
+	switch (c.outcomes[n - first]) {
+	  case CENSUS_DONE:
+	    printresults(series->games + n, n + 1, c.results + n - first);
+	    freesearchstats(c.results + n - first);
+	    break;
+	  case CENSUS_TOOBIG:
+	    printf("; Puzzle %d: %s\n", n + 1, series->games[n].name);
+	    printf("too large to be searched\n");
+	    ret = FALSE;
+	    break;
+	  default:
+	    currentfilename = tmpdir;
+	    errno = c.results[n - first].error;
+	    fileerr(NULL);
+	    freesearchstats(c.results + n - first);
+	    ret = FALSE;
+	    break;
+	}
+	fflush(stdout);
+    }
+
+    while (started--)
+	pthread_join(threads[started], NULL);
+    free(threads);
+    free(c.outcomes);
+    free(c.results);
+    return ret;
+}
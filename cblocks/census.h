@@ -0,0 +1,24 @@
+/* census.h: Functions for counting the positions of many puzzles.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_census_h_
+#define	_census_h_
+
+#include	"fileread.h"
+
+/* Explore every position of the puzzles in series from first to last,
+ * and print out for each one the number of positions at each distance
+ * from the start, the number of positions that are solved, the
+ * distance to the farthest position, and the length of the shortest
+ * solution. The puzzles are divided among as many threads as there
+ * are processors, and the results are printed in order. Temporary
+ * files are created in tmpdir. FALSE is returned if any puzzle could
+ * not be explored.
+ */
+extern int takecensus(gameseries *series, int first, int last,
+		      char const *tmpdir);
+
+#endif
@@ -12,6 +12,7 @@
 #include	<errno.h>
 #include	<ncurses.h>
 #include	<unistd.h>
+#include	<sys/ioctl.h>
 #include	"gen.h"
 #include	"cblocks.h"
 #include	"userio.h"
@@ -193,7 +194,7 @@ int displaygame(cell const *map, int ysize, int xsize,
     }
 
     p = map;
-    for (y = 0 ; y < ysize ; ++y, p += XSIZE) {
+    for (y = 0 ; y < ysize ; ++y, p += xsize) {
 	for (x = 0 ; x < xsize ; ++x) {
 	    if (!p[x])
 		continue;
@@ -210,7 +211,7 @@ int displaygame(cell const *map, int ysize, int xsize,
 	    } else {
 		if (p[x] & GOAL)
 		    attr = goalattr;
-		else if (doortime(p[x]) > movecount)
+		else if (isdoorclosed(p[x]))
 		    attr = closedoorattr;
 		else
 		    attr = opendoorattr;
@@ -368,6 +369,20 @@ int input(void)
     }
 }
 
+/* Return TRUE if keystrokes are waiting to be read. curses reads the
+ * terminal a byte at a time, so the terminal's own queue is checked.
+ */
+int inputpending(void)
+{
+#ifdef FIONREAD
+    int	n;
+
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+#else
+    return FALSE;
+#endif
+}
+
 /*
  * Initialization functions
  */
@@ -29,11 +29,38 @@ extern int isfilename(char const *name);
  */
 extern int finddir(char const *dir);
 
+/* Store the size and the modification time of an open file. FALSE is
+ * returned if they cannot be determined.
+ */
+extern int getfilestamp(FILE *fp, long *size, long *mtime);
+
 /* Open a file, using dir as the directory if filename is not a path.
  */
 extern FILE *openfileindir(char const *dir, char const *filename,
 			   char const *mode);
 
+/* Create and open a temporary file in dir. The file is removed from
+ * the directory immediately, and so disappears when it is closed.
+ */
+extern FILE *opentempfile(char const *dir);
+
+/* Rename the file from to to, using dir as the directory of both if
+ * they are not paths. FALSE is returned if the rename fails.
+ */
+extern int renamefileindir(char const *dir, char const *from,
+			   char const *to);
+
+/* Map the file filename in dir into memory, read-only, and store its
+ * size and modification time. NULL is returned if the file cannot be
+ * opened or mapped.
+ */
+extern char const *mapfileindir(char const *dir, char const *filename,
+				long *size, long *mtime);
+
+/* Release a file mapped by mapfileindir(), given its size.
+ */
+extern void unmapfile(char const *data, long size);
+
 /* Call filecallback once for every file in dir; the first argument to
  * the callback function is an allocated buffer containing the
  * filename. If the callback's return value is zero, the buffer is
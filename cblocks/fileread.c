@@ -46,41 +46,64 @@ int getnline(FILE *fp, char *buf, int len)
     return n;
 }
 
+/* Return the line beginning at fb's current position, and advance
+ * the position to the start of the next line.
+ */
+char const *nextline(filebuf *fb, int *len)
+{
+    char const *line, *end;
+
+    if (fb->pos >= fb->size)
+	return NULL;
+    line = fb->data + fb->pos;
+    if ((end = memchr(line, '\n', fb->size - fb->pos))) {
+	*len = end - line;
+	fb->pos += *len + 1;
+    } else {
+	*len = fb->size - fb->pos;
+	fb->pos = fb->size;
+    }
+    return line;
+}
+
+/* Release the memory holding the puzzle file for series.
+ */
+static void closemapfile(gameseries *series)
+{
+    unmapfile(series->mapfile.data, series->mapfile.size);
+    series->mapfile.data = NULL;
+}
+
 /* Examine the top of the file for series and extract the display
  * string, if present. FALSE is returned if the file appears to be
  * invalid or bereft of maps.
  */
 static int readseriesheader(gameseries *series)
 {
-    char	buf[256];
-    int		ch;
-    int		n;
-
-    for (;;) {
-	ch = fgetc(series->mapfp);
-	if (ch == ';') {
-	    getnline(series->mapfp, buf, sizeof buf);
-	    if (*buf == ';') {
-		for (n = 1 ; isspace(buf[n]) ; ++n) ;
-		strncpy(series->name, buf + n, sizeof series->name - 1);
-		series->name[sizeof series->name - 1] = '\0';
-		n = strlen(series->name);
-		for (--n ; isspace(series->name[n]) ; --n) ;
-		series->name[n + 1] = '\0';
-		return TRUE;
-	    }
-	} else if (ch != '\n')
-	    break;
+    filebuf    *fb = &series->mapfile;
+    char const *line;
+    int		ch, n;
+
+    while (fb->pos < fb->size) {
+	ch = fb->data[fb->pos];
+	if (ch != ';' && ch != '\n')
+	    return TRUE;
+	line = nextline(fb, &n);
+	if (ch == ';' && n > 1 && line[1] == ';') {
+	    for (line += 2, n -= 2 ; n && isspace((unsigned char)*line) ;
+		 ++line, --n) ;
+	    if (n >= (int)(sizeof series->name))
+		n = sizeof series->name - 1;
+	    for ( ; n && isspace((unsigned char)line[n - 1]) ; --n) ;
+	    memcpy(series->name, line, n);
+	    series->name[n] = '\0';
+	    return TRUE;
+	}
     }
 
-    if (ch == EOF) {
-	fclose(series->mapfp);
-	series->mapfp = NULL;
-	series->allmapsread = TRUE;
-	return FALSE;
-    }
-    ungetc(ch, series->mapfp);
-    return TRUE;
+    closemapfile(series);
+    series->allmapsread = TRUE;
+    return FALSE;
 }
 
 /* A callback function that initializes a gameseries structure for
@@ -100,10 +123,15 @@ static int getseriesfile(char *filename, void *data)
     }
     series = sdata->list + sdata->count++;
     series->filename = filename;
-    series->mapfp = NULL;
+    series->mapfile.data = NULL;
     series->answerfp = NULL;
     series->allmapsread = FALSE;
-    series->allanswersread = FALSE;
+    series->background = FALSE;
+    series->answercount = 0;
+    series->answers = NULL;
+    series->answerlive = 0;
+    series->answercache = NULL;
+    series->answercachesize = 0;
     series->allocated = 0;
     series->count = 0;
     series->games = NULL;
@@ -144,15 +172,37 @@ int getseriesfiles(char *filename, gameseries **list, int *count)
     return TRUE;
 }
 
+/* Make room in series for at least count puzzles.
+ */
+void reservelevels(gameseries *series, int count)
+{
+    int	n;
+
+    if (count <= series->allocated)
+	return;
+    n = series->allocated ? series->allocated : 16;
+    while (n < count)
+	n *= 2;
+    if (!(series->games = realloc(series->games, n * sizeof *series->games)))
+	memerrexit();
+    memset(series->games + series->allocated, 0,
+	   (n - series->allocated) * sizeof *series->games);
+    series->allocated = n;
+}
+
 /* Read the puzzle file corresponding to series, and the corresponding
  * solutions in the answer file, until at least level maps have been
  * successfully parsed, or the end is reached. The files are opened if
  * they have not been already. No files are opened if the requested
- * level is already in memory.
+ * level is already in memory. While series->background is TRUE, no
+ * files are opened and no errors are displayed: the reading stops at
+ * the first map that cannot be parsed, so that the map is read again,
+ * and its errors reported, when the puzzle is requested from the main
+ * thread.
  */
 int readlevelinseries(gameseries *series, int level)
 {
-    int		n;
+    long	mtime, pos;
 
     if (level < 0)
 	return FALSE;
@@ -160,47 +210,35 @@ int readlevelinseries(gameseries *series, int level)
 	return TRUE;
 
     if (!series->allmapsread) {
-	if (!series->mapfp) {
+	if (!series->mapfile.data) {
+	    if (series->background)
+		return FALSE;
 	    currentfilename = series->filename;
-	    series->mapfp = openfileindir(datadir, series->filename, "r");
-	    if (!series->mapfp)
+	    series->mapfile.data = mapfileindir(datadir, series->filename,
+						&series->mapfile.size, &mtime);
+	    if (!series->mapfile.data)
 		return fileerr(NULL);
+	    series->mapfile.pos = 0;
 	    if (!readseriesheader(series))
 		return fileerr("file contains no maps");
-	    if (*savedir) {
-		series->answerfp = openfileindir(savedir, 
-						 series->filename, "r");
-		if (series->answerfp) {
-		    savedirchecked = TRUE;
-		    series->answersreadonly = TRUE;
-		}
-	    } else
-		series->answerfp = NULL;
+	    openanswers(series);
 	}
 	while (!series->allmapsread && series->count <= level) {
-	    while (series->count >= series->allocated) {
-		n = series->allocated ? series->allocated * 2 : 16;
-		if (!(series->games = realloc(series->games,
-					      n * sizeof *series->games)))
-		    memerrexit();
-		memset(series->games + series->allocated, 0,
-		       (n - series->allocated) * sizeof *series->games);
-		series->allocated = n;
-	    }
-	    if (readlevelmap(series->mapfp, series->games + series->count)) {
+	    reservelevels(series, series->count + 1);
+	    pos = series->mapfile.pos;
+	    if (readlevelmap(&series->mapfile, series->games + series->count,
+			     series->background)) {
 		series->games[series->count].seriesname = series->name;
-		if (!series->allanswersread)
-		    readanswers(series->answerfp,
-				series->games + series->count);
+		readanswers(series, series->count);
 		++series->count;
+	    } else if (series->background) {
+		series->mapfile.pos = pos;
+		break;
 	    }
-	    if (feof(series->mapfp)) {
-		fclose(series->mapfp);
-		series->mapfp = NULL;
+	    if (series->mapfile.pos >= series->mapfile.size) {
+		closemapfile(series);
 		series->allmapsread = TRUE;
 	    }
-	    if (series->answerfp && feof(series->answerfp))
-		series->allanswersread = TRUE;
 	}
     }
     return series->count > level;
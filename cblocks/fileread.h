@@ -17,18 +17,37 @@ typedef	struct gamesetup {
     short	ysize;			/* height of the map */
     short	xsize;			/* width of the map */
     short	blockcount;		/* total number of blocks */
+    int		doorcount;		/* total number of door cells */
     int		beststepcount;		/* least number of steps to finish */
     int		beststepknown;		/* least steps known to be necessary */
     actlist	answer;			/* user's best solution */
     int		level;			/* index of puzzle in series */
     char const *seriesname;		/* pointer to the name of the series */
     char	name[64];		/* name of the puzzle */
-    cell	map[MAXHEIGHT * MAXWIDTH];  /* the puzzle's map */
-    cell	goal[MAXHEIGHT * MAXWIDTH]; /* the puzzle's goal image */
-    unsigned char equivs[256];		/* equivalencies in the goal image */
-    char	colors[256];		/* how to color the blocks */
+    cell       *map;			/* the puzzle's map */
+    cell       *goal;			/* the puzzle's goal image */
+    unsigned short *equivs;		/* equivalencies in the goal image */
+    char       *colors;			/* how to color the blocks */
 } gamesetup;
 
+/* A file of puzzles mapped into memory, and the position of the
+ * parser within it.
+ */
+typedef	struct filebuf {
+    char const *data;			/* the contents of the file */
+    long	size;			/* the size of the file */
+    long	pos;			/* where the next line begins */
+} filebuf;
+
+/* Where the solutions for one puzzle are in the answer file. A pos
+ * of -1 indicates that the file has nothing for that puzzle.
+ */
+typedef	struct answerslot {
+    long	start;			/* where the entry and its label begin */
+    long	pos;			/* where the solutions themselves begin */
+    long	end;			/* where the entry ends */
+} answerslot;
+
 /* The collection of data maintained for each file of puzzles.
  */
 typedef	struct gameseries {
@@ -36,10 +55,16 @@ typedef	struct gameseries {
     int		count;			/* actual size of array */
     gamesetup  *games;			/* the list of puzzles */
     char       *filename;		/* the name of the files */
-    FILE       *mapfp;			/* the file containing the puzzles */
+    filebuf	mapfile;		/* the file containing the puzzles */
     FILE       *answerfp;		/* the file of the user's solutions */
-    int		allmapsread;		/* TRUE if mapfp has reached EOF */
-    int		allanswersread;		/* TRUE if answerfp has reached EOF */
+    int		allmapsread;		/* TRUE if mapfile has reached EOF */
+    int		background;		/* TRUE while being read by the
+					   prefetch thread */
+    int		answercount;		/* size of answers */
+    answerslot *answers;		/* where each puzzle is in answerfp */
+    long	answerlive;		/* bytes of answerfp still in use */
+    char const *answercache;		/* the answers' cache, if mapped */
+    long	answercachesize;	/* the size of the same */
     int		answersreadonly;	/* TRUE if answerfp is open readonly */
     char	name[64];		/* the series's name */
 } gameseries;
@@ -55,11 +80,23 @@ extern char    *datadir;
  */
 extern int getnline(FILE *fp, char *buf, int len);
 
+/* Return the line beginning at fb's current position and advance past
+ * it, storing the line's length, without the newline, in len. The
+ * line is left in the file's buffer, and so is not NUL-terminated.
+ * NULL is returned at the end of the file.
+ */
+extern char const *nextline(filebuf *fb, int *len);
+
 /* Find the puzzle files and allocate an array of gameseries
  * structures for them.
  */
 extern int getseriesfiles(char *filename, gameseries **list, int *count);
 
+/* Make room in series for at least count puzzles, so that reading
+ * more of the file will not move the puzzles already in memory.
+ */
+extern void reservelevels(gameseries *series, int count);
+
 /* Read the given puzzle file up to puzzle number level.
  */
 extern int readlevelinseries(gameseries *series, int level);
@@ -0,0 +1,540 @@
+/* generate.c: Functions for creating new puzzles from old ones.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	"gen.h"
+#include	"cblocks.h"
+#include	"fileread.h"
+#include	"search.h"
+#include	"generate.h"
+
+/* The most puzzles that will be printed out.
+ */
+#ifndef GENMAXPUZZLES
+#define	GENMAXPUZZLES	10
+#endif
+
+/* The positions are divided among this many separately locked
+ * shards, chosen by the low bits of each position's hash value.
+ */
+#define	SHARDBITS	6
+#define	SHARDCOUNT	(1 << SHARDBITS)
+
+/* Each shard stores its positions in chunks of this many, so that
+ * positions never move once they have been added.
+ */
+#define	CHUNKBITS	16
+#define	CHUNKSIZE	(1L << CHUNKBITS)
+#define	MAXCHUNKS	1024
+
+/* The number of positions a thread takes from the layer at a time.
+ */
+#define	WORKSIZE	256
+
+/* The distance given to positions that have not been reached.
+ */
+#define	UNSEEN		0xFFFF
+
+/* The characters used to identify blocks in the printed puzzles.
+ */
+static char const blockchars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz123456789"
+	"!&*+-=?@^~<>()[]{}/|:,'\"`_";
+
+/* A reference to a stored position: its index within the shard,
+ * shifted left, ORed with the shard's number.
+ */
+typedef	long	stateref;
+
+/* One shard of the set of positions. slots is a hash table of
+ * position indexes plus one, with zero marking an empty slot.
+ */
+typedef	struct shard {
+    pthread_mutex_t	lock;
+    long		count;			/* positions stored */
+    long		slotcount;		/* size of slots (power of 2) */
+    long	       *slots;			/* the hash table */
+    unsigned char      *states[MAXCHUNKS];	/* the packed positions */
+    unsigned short     *dists[MAXCHUNKS];	/* distances to the goal */
+} shard;
+
+/* A growable list of positions.
+ */
+typedef	struct reflist {
+    stateref	       *refs;
+    long		count;
+    long		allocated;
+} reflist;
+
+/* The data belonging to each thread.
+ */
+typedef	struct worker {
+    pthread_t		thread;
+    reflist		found;		/* positions for the next layer */
+    reflist		goals;		/* solved positions found */
+} worker;
+
+/* The puzzle being searched.
+ */
+static searchinfo	info;
+
+/* The set of positions found.
+ */
+static shard		shards[SHARDCOUNT];
+
+/* The positions in the current layer.
+ */
+static reflist		layer;
+
+/* The index of the next position in layer to be expanded, and the
+ * lock protecting it.
+ */
+static long		nextwork;
+static pthread_mutex_t	worklock = PTHREAD_MUTEX_INITIALIZER;
+
+/* FALSE while positions are being collected, and TRUE while their
+ * distances from the goal are being measured.
+ */
+static int		measuring;
+
+/* The distance from the goal of the current layer.
+ */
+static int		depth;
+
+/* TRUE if the search has run out of room.
+ */
+static int		overflow;
+
+/* Return the number of processors available.
+ */
+static int getcpucount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long	n;
+
+    if ((n = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+	return (int)n;
+#endif
+    return 1;
+}
+
+/* Return a hash value for a packed position.
+ */
+static unsigned long hashstate(unsigned char const *state)
+{
+    unsigned long	h = 2166136261UL;
+    int			i;
+
+    for (i = 0 ; i < info.statesize ; ++i)
+	h = (h ^ state[i]) * 16777619UL;
+    return h ^ (h >> 15);
+}
+
+/* Return a pointer to the stored position referred to by ref.
+ */
+static unsigned char *getstate(stateref ref)
+{
+    shard      *sh = shards + (ref & (SHARDCOUNT - 1));
+    long	n = ref >> SHARDBITS;
+
+    return sh->states[n >> CHUNKBITS]
+		+ (n & (CHUNKSIZE - 1)) * info.statesize;
+}
+
+/* Return a pointer to the distance of the position referred to by ref.
+ */
+static unsigned short *getdist(stateref ref)
+{
+    shard      *sh = shards + (ref & (SHARDCOUNT - 1));
+    long	n = ref >> SHARDBITS;
+
+    return sh->dists[n >> CHUNKBITS] + (n & (CHUNKSIZE - 1));
+}
+
+/* Add ref to the end of list. FALSE is returned if memory runs out.
+ */
+static int addref(reflist *list, stateref ref)
+{
+    stateref   *refs;
+    long	n;
+
+    if (list->count == list->allocated) {
+	n = list->allocated ? list->allocated * 2 : 1024;
+	if (!(refs = realloc(list->refs, n * sizeof *refs)))
+	    return FALSE;
+	list->refs = refs;
+	list->allocated = n;
+    }
+    list->refs[list->count++] = ref;
+    return TRUE;
+}
+
+/* Double the size of a shard's hash table. FALSE is returned if
+ * memory runs out.
+ */
+static int growslots(shard *sh)
+{
+    long       *slots;
+    long	size, i, n;
+
+    size = sh->slotcount ? sh->slotcount * 2 : 1024;
+    if (!(slots = calloc(size, sizeof *slots)))
+	return FALSE;
+    for (i = 0 ; i < sh->slotcount ; ++i) {
+	if (!sh->slots[i])
+	    continue;
+	n = hashstate(getstate((sh->slots[i] - 1) << SHARDBITS
+				| (sh - shards))) >> SHARDBITS;
+	for (n &= size - 1 ; slots[n] ; n = (n + 1) & (size - 1)) ;
+	slots[n] = sh->slots[i];
+    }
+    free(sh->slots);
+    sh->slots = slots;
+    sh->slotcount = size;
+    return TRUE;
+}
+
+/* Look up state in the set of positions, adding it if it is not
+ * already present and add is TRUE. The position's reference is stored
+ * in ref. The return value is TRUE if the position was added, FALSE
+ * if it was already present, or -1 if it is not present and could not
+ * be added. The caller must hold the shard's lock.
+ */
+static int findstate(shard *sh, unsigned long hash,
+		     unsigned char const *state, int add, stateref *ref)
+{
+    long	i, n;
+
+    if (sh->slotcount) {
+	for (i = (hash >> SHARDBITS) & (sh->slotcount - 1) ; sh->slots[i] ;
+	     i = (i + 1) & (sh->slotcount - 1)) {
+	    *ref = (sh->slots[i] - 1) << SHARDBITS | (sh - shards);
+	    if (!memcmp(getstate(*ref), state, info.statesize))
+		return FALSE;
+	}
+    }
+    if (!add)
+	return -1;
+
+    n = sh->count;
+    if ((n >> CHUNKBITS) >= MAXCHUNKS)
+	return -1;
+    if (!(n & (CHUNKSIZE - 1))) {
+	sh->states[n >> CHUNKBITS] = malloc(CHUNKSIZE * info.statesize);
+	sh->dists[n >> CHUNKBITS] = malloc(CHUNKSIZE * sizeof **sh->dists);
+	if (!sh->states[n >> CHUNKBITS] || !sh->dists[n >> CHUNKBITS])
+	    return -1;
+    }
+    if ((n + 1) * 2 > sh->slotcount && !growslots(sh))
+	return -1;
+    *ref = n << SHARDBITS | (sh - shards);
+    memcpy(getstate(*ref), state, info.statesize);
+    *getdist(*ref) = UNSEEN;
+    ++sh->count;
+    for (i = (hash >> SHARDBITS) & (sh->slotcount - 1) ; sh->slots[i] ;
+	 i = (i + 1) & (sh->slotcount - 1)) ;
+    sh->slots[i] = n + 1;
+    return TRUE;
+}
+
+/* Handle a position one step away from one in the current layer.
+ * While collecting, positions not seen before are added to the set
+ * and to the next layer. While measuring, positions not yet given a
+ * distance are given one and added to the next layer.
+ */
+static void visitstate(unsigned char const *state, int block, int dir,
+		       void *data)
+{
+    worker	       *w = data;
+    unsigned long	hash;
+    shard	       *sh;
+    stateref		ref;
+    int			f;
+
+    (void)block;
+    (void)dir;
+    hash = hashstate(state);
+    sh = shards + (hash & (SHARDCOUNT - 1));
+    pthread_mutex_lock(&sh->lock);
+    f = findstate(sh, hash, state, !measuring, &ref);
+    if (measuring && !f) {
+	if (*getdist(ref) == UNSEEN) {
+	    *getdist(ref) = depth + 1;
+	    f = TRUE;
+	}
+    }
+    pthread_mutex_unlock(&sh->lock);
+    if (f < 0) {
+	overflow = TRUE;
+	return;
+    }
+    if (!f)
+	return;
+    if (!addref(&w->found, ref))
+	overflow = TRUE;
+    if (!measuring && isgoalstate(&info, state) && !addref(&w->goals, ref))
+	overflow = TRUE;
+}
+
+/* Expand the positions in the current layer, taking a handful at a
+ * time, until none are left.
+ */
+static void *expandlayer(void *data)
+{
+    long	i, n;
+
+    for (;;) {
+	pthread_mutex_lock(&worklock);
+	i = nextwork;
+	nextwork += WORKSIZE;
+	pthread_mutex_unlock(&worklock);
+	if (i >= layer.count || overflow)
+	    break;
+	n = i + WORKSIZE < layer.count ? i + WORKSIZE : layer.count;
+	for ( ; i < n ; ++i)
+	    getsuccessors(&info, getstate(layer.refs[i]), visitstate, data);
+    }
+    return NULL;
+}
+
+/* Replace the current layer with the positions the workers found.
+ * If they found none, the current layer is left alone and FALSE is
+ * returned.
+ */
+static int collectlayer(worker *workers, int workercount)
+{
+    long	total;
+    int		n;
+
+    total = 0;
+    for (n = 0 ; n < workercount ; ++n)
+	total += workers[n].found.count;
+    if (!total)
+	return FALSE;
+    if (total > layer.allocated) {
+	layer.allocated = total;
+	if (!(layer.refs = realloc(layer.refs, total * sizeof *layer.refs)))
+	    memerrexit();
+    }
+    layer.count = 0;
+    for (n = 0 ; n < workercount ; ++n) {
+	memcpy(layer.refs + layer.count, workers[n].found.refs,
+	       workers[n].found.count * sizeof *layer.refs);
+	layer.count += workers[n].found.count;
+	workers[n].found.count = 0;
+    }
+    return TRUE;
+}
+
+/* Expand every position in the current layer, dividing them among
+ * the workers, and make the positions found into the new layer.
+ * FALSE is returned if no new positions were found.
+ */
+static int advancelayer(worker *workers, int workercount)
+{
+    int	started, n;
+
+    nextwork = 0;
+    for (started = 0 ; started < workercount ; ++started)
+	if (pthread_create(&workers[started].thread, NULL,
+			   expandlayer, workers + started))
+	    break;
+    if (!started)
+	expandlayer(workers);
+    for (n = 0 ; n < started ; ++n)
+	pthread_join(workers[n].thread, NULL);
+    return collectlayer(workers, workercount);
+}
+
+/* Print out one map row, with trailing spaces removed.
+ */
+static void printrow(char const *row, int width)
+{
+    while (width && row[width - 1] == ' ')
+	--width;
+    printf("%.*s\n", width, row);
+}
+
+/* Print out the position referred to by ref as a puzzle, using the
+ * original puzzle's target and block attributes.
+ */
+static void printpuzzle(gamesetup const *game, stateref ref, int number,
+			int steps)
+{
+    cell	       *map;
+    char		ids[LASTID + 1];
+    char		row[MAXWIDTH];
+    unsigned char	done[LASTID + 1];
+    int			etch = FALSE;
+    int			y, x, n, id;
+
+    memset(ids, 0, sizeof ids);
+    n = 0;
+    for (id = FIRSTID ; id < game->blockcount ; ++id)
+	ids[id] = blockchars[n++];
+    ids[KEYID] = '0';
+    ids[WALLID] = '#';
+
+    if (!(map = malloc(game->ysize * game->xsize * sizeof *map)))
+	memerrexit();
+    unpackstate(&info, getstate(ref), map);
+    printf("\n; %d\n\ndisplay %.40s (variant %d)\n", number, game->name, number);
+    printf("size %d %d\n", game->xsize - 2, game->ysize - 2);
+    printf("step %d\n\ninitial\n", steps);
+    for (y = 1 ; y < game->ysize - 1 ; ++y) {
+	for (x = 1 ; x < game->xsize - 1 ; ++x) {
+	    id = blockid(map[y * game->xsize + x]);
+	    row[x - 1] = id ? ids[id] : ' ';
+	}
+	printrow(row, game->xsize - 2);
+    }
+    free(map);
+    printf("\ntarget\n");
+    for (y = 1 ; y < game->ysize - 1 ; ++y) {
+	for (x = 1 ; x < game->xsize - 1 ; ++x) {
+	    id = blockid(game->goal[y * game->xsize + x]);
+	    row[x - 1] = id ? ids[id] : ' ';
+	    if (game->map[y * game->xsize + x] & GOAL)
+		etch = TRUE;
+	}
+	printrow(row, game->xsize - 2);
+    }
+    putchar('\n');
+
+    if (info.keyblock >= 0)
+	printf("key 0\n");
+    memset(done, 0, sizeof done);
+    for (id = KEYID ; id < game->blockcount ; ++id) {
+	if (done[id] || !game->equivs[id] || game->equivs[id] == id)
+	    continue;
+	printf("equiv ");
+	for (n = id ; !done[n] ; n = game->equivs[n]) {
+	    putchar(ids[n]);
+	    done[n] = TRUE;
+	}
+	putchar('\n');
+    }
+    for (id = KEYID ; id < game->blockcount ; ++id)
+	if (game->colors[id])
+	    printf("color %c %d %d %d\n", ids[id],
+		   game->colors[id] & 1 ? 255 : 0,
+		   game->colors[id] & 2 ? 255 : 0,
+		   game->colors[id] & 4 ? 255 : 0);
+    if (etch)
+	printf("etchtarget\n");
+    printf("end\n");
+}
+
+/* Free all of the memory used by the search.
+ */
+static void freegenerator(worker *workers, int workercount)
+{
+    int	i, n;
+
+    for (n = 0 ; n < workercount ; ++n) {
+	free(workers[n].found.refs);
+	free(workers[n].goals.refs);
+    }
+    free(workers);
+    for (n = 0 ; n < SHARDCOUNT ; ++n) {
+	for (i = 0 ; i < MAXCHUNKS && shards[n].states[i] ; ++i) {
+	    free(shards[n].states[i]);
+	    free(shards[n].dists[i]);
+	}
+	free(shards[n].slots);
+	pthread_mutex_destroy(&shards[n].lock);
+    }
+    memset(shards, 0, sizeof shards);
+    free(layer.refs);
+    memset(&layer, 0, sizeof layer);
+}
+
+/* Collect every position reachable from game's starting position,
+ * then measure each one's distance from the nearest solved position,
+ * and print out the positions that are the farthest.
+ */
+int generatepuzzles(gamesetup const *game)
+{
+    worker     *workers;
+    stateref   *best;
+    reflist	list;
+    long	statecount, goalcount, i;
+    int		workercount, bestcount, n, m;
+
+    if (!initsearch(&info, game))
+	return fileerr("puzzle is too large to be searched");
+    if (info.doorcount)
+	return fileerr("puzzles with doors cannot be searched backwards");
+    if (game->blockcount - FIRSTID > (int)(sizeof blockchars - 1))
+	return fileerr("too many blocks to write out as a puzzle");
+    workercount = getcpucount();
+    if (!(workers = calloc(workercount, sizeof *workers)))
+	memerrexit();
+    for (n = 0 ; n < SHARDCOUNT ; ++n)
+	pthread_mutex_init(&shards[n].lock, NULL);
+    overflow = FALSE;
+
+    measuring = FALSE;
+    visitstate(info.start, 0, 0, workers);
+    collectlayer(workers, workercount);
+    while (!overflow && advancelayer(workers, workercount)) ;
+    if (overflow) {
+	freegenerator(workers, workercount);
+	return fileerr("too many positions to be searched");
+    }
+
+    statecount = 0;
+    for (n = 0 ; n < SHARDCOUNT ; ++n)
+	statecount += shards[n].count;
+    goalcount = 0;
+    for (n = 0 ; n < workercount ; ++n) {
+	for (i = 0 ; i < workers[n].goals.count ; ++i)
+	    *getdist(workers[n].goals.refs[i]) = 0;
+	goalcount += workers[n].goals.count;
+	list = workers[n].found;
+	workers[n].found = workers[n].goals;
+	workers[n].goals = list;
+    }
+    if (!collectlayer(workers, workercount)) {
+	freegenerator(workers, workercount);
+	return fileerr("puzzle cannot be solved");
+    }
+
+    measuring = TRUE;
+    for (depth = 0 ; depth + 1 < UNSEEN && advancelayer(workers, workercount)
+		    ; ++depth) ;
+
+    bestcount = layer.count < GENMAXPUZZLES ? layer.count : GENMAXPUZZLES;
+    if (!(best = malloc(bestcount * sizeof *best)))
+	memerrexit();
+    for (n = 0 ; n < bestcount ; ++n) {
+	m = -1;
+	for (i = 0 ; i < layer.count ; ++i) {
+	    if (n && memcmp(getstate(layer.refs[i]), getstate(best[n - 1]),
+			    info.statesize) <= 0)
+		continue;
+	    if (m < 0 || memcmp(getstate(layer.refs[i]), getstate(best[n]),
+				info.statesize) < 0) {
+		best[n] = layer.refs[i];
+		m = 0;
+	    }
+	}
+    }
+
+    printf(";;%.40s (variants)\n", game->name);
+    printf("; %ld positions, %ld solved, farthest %d steps from a solution\n",
+	   statecount, goalcount, depth);
+    for (n = 0 ; n < bestcount ; ++n)
+	printpuzzle(game, best[n], n + 1, depth);
+
+    free(best);
+    freegenerator(workers, workercount);
+    return TRUE;
+}
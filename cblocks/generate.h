@@ -0,0 +1,23 @@
+/* generate.h: Functions for creating new puzzles from old ones.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_generate_h_
+#define	_generate_h_
+
+#include	"fileread.h"
+
+/* Find the positions of game's blocks that are the farthest from its
+ * goal, and print them out as a new series of puzzles that share the
+ * original's blocks and target. Every position that can be reached
+ * from the starting position is collected, and then a breadth-first
+ * search is made backwards from all of the solved positions at once.
+ * The work is divided among as many threads as there are processors.
+ * FALSE is returned if the puzzle has doors, is too large to search,
+ * or cannot be solved.
+ */
+extern int generatepuzzles(gamesetup const *game);
+
+#endif
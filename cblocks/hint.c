@@ -0,0 +1,474 @@
+/* hint.c: Functions for finding the best next step in the background.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<pthread.h>
+#include	"gen.h"
+#include	"cblocks.h"
+#include	"fileread.h"
+#include	"search.h"
+#include	"hint.h"
+
+/* The most positions a single search will visit before giving up.
+ */
+#ifndef	HINTMAXSTATES
+#define	HINTMAXSTATES	(4 * 1024 * 1024)
+#endif
+
+/* How many positions are expanded between checks for a new request.
+ */
+#define	CHECKINTERVAL	256
+
+/* A hash table of packed positions.
+ */
+typedef	struct statetable {
+    unsigned char      *states;		/* the positions, in order added */
+    long	       *slots;		/* one more than a position's index */
+    long		count;		/* number of positions stored */
+    long		allocated;	/* number of positions states can hold */
+    long		slotcount;	/* size of slots, a power of two */
+} statetable;
+
+/* What is known about a position whose distance from a solution has
+ * been found.
+ */
+typedef	struct hintentry {
+    int			distance;	/* steps to a solution, or -1 if none */
+    short		pos;		/* a cell of the block to move next */
+    short		dir;		/* direction of the step's first move */
+} hintentry;
+
+/* A position visited while searching.
+ */
+typedef	struct searchnode {
+    long		parent;		/* the position it was reached from */
+    short		block;		/* the block that moved to reach it */
+    short		dir;		/* the direction of the first move */
+} searchnode;
+
+/* The data used while expanding one layer of a search.
+ */
+typedef	struct searchctx {
+    long		parent;		/* the position being expanded */
+    int			depth;		/* the number of steps to reach it */
+    long		best;		/* position ending the best route */
+    int			bestlength;	/* length of that route, or -1 */
+    int			full;		/* TRUE if no more positions fit */
+} searchctx;
+
+/* The puzzle being searched.
+ */
+static searchinfo	info;
+
+/* FALSE if hints cannot be given for the current puzzle.
+ */
+static int		enabled = FALSE;
+
+/* TRUE once the background thread is running.
+ */
+static int		started = FALSE;
+
+/* The positions whose distance from a solution is known. Only the
+ * background thread changes this table, and then only while holding
+ * the lock.
+ */
+static statetable	known;
+static hintentry       *knownhints = NULL;
+static long		knownallocated = 0;
+
+/* The positions seen during the current search, and how they were
+ * reached.
+ */
+static statetable	visited;
+static searchnode      *nodes = NULL;
+static long		nodesallocated = 0;
+
+/* The position the background thread was last asked to search.
+ */
+static unsigned char	request[MAXSTATESIZE];
+
+/* TRUE if request holds a position.
+ */
+static int		requested = FALSE;
+
+/* TRUE if a new request has not yet been taken up.
+ */
+static int		pending = FALSE;
+
+/* TRUE while the tables are being reset for a new puzzle.
+ */
+static int		resetting = FALSE;
+
+/* TRUE while the background thread is searching.
+ */
+static int		busy = FALSE;
+
+/* The lock shared by both threads, and the conditions they wait on.
+ */
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	idle = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Position table functions
+ */
+
+/* Return a hash value for a packed position.
+ */
+static unsigned long hashstate(unsigned char const *state)
+{
+    unsigned long	h = 2166136261UL;
+    int			i;
+
+    for (i = 0 ; i < info.statesize ; ++i)
+	h = (h ^ state[i]) * 16777619UL;
+    return h;
+}
+
+/* Free the memory allocated to table, leaving it empty.
+ */
+static void freetable(statetable *table)
+{
+    free(table->states);
+    free(table->slots);
+    memset(table, 0, sizeof *table);
+}
+
+/* Empty table, keeping the memory allocated to it.
+ */
+static void cleartable(statetable *table)
+{
+    table->count = 0;
+    if (table->slots)
+	memset(table->slots, 0, table->slotcount * sizeof *table->slots);
+}
+
+/* Return the index of state in table, or -1 if it is not present.
+ */
+static long findstate(statetable const *table, unsigned char const *state)
+{
+    unsigned long	n;
+    long		i;
+
+    if (!table->count)
+	return -1;
+    n = hashstate(state);
+    for (;;) {
+	n &= table->slotcount - 1;
+	if (!(i = table->slots[n]))
+	    return -1;
+	--i;
+	if (!memcmp(table->states + i * info.statesize, state, info.statesize))
+	    return i;
+	++n;
+    }
+}
+
+/* Add state to table, which must not already contain it. The index
+ * of the new entry is returned, or -1 if the table cannot be made
+ * large enough.
+ */
+static long addstate(statetable *table, unsigned char const *state)
+{
+    unsigned char      *states;
+    long	       *slots;
+    unsigned long	n;
+    long		i, size;
+
+    if (table->count >= table->allocated) {
+	size = table->allocated ? 2 * table->allocated : 1024;
+	if (!(states = realloc(table->states, size * info.statesize)))
+	    return -1;
+	table->states = states;
+	table->allocated = size;
+    }
+    if (2 * (table->count + 1) > table->slotcount) {
+	size = table->slotcount ? 2 * table->slotcount : 4096;
+	if (!(slots = calloc(size, sizeof *slots)))
+	    return -1;
+	free(table->slots);
+	table->slots = slots;
+	table->slotcount = size;
+	for (i = 0 ; i < table->count ; ++i) {
+	    n = hashstate(table->states + i * info.statesize) & (size - 1);
+	    while (slots[n])
+		n = (n + 1) & (size - 1);
+	    slots[n] = i + 1;
+	}
+    }
+    n = hashstate(state) & (table->slotcount - 1);
+    while (table->slots[n])
+	n = (n + 1) & (table->slotcount - 1);
+    i = table->count++;
+    table->slots[n] = i + 1;
+    memcpy(table->states + i * info.statesize, state, info.statesize);
+    return i;
+}
+
+/* Record what is known about a position, unless it is known already.
+ * The lock must be held by the caller.
+ */
+static void addknown(unsigned char const *state, int distance,
+		     int pos, int dir)
+{
+    hintentry  *hints;
+    long	i, size;
+
+    if (findstate(&known, state) >= 0)
+	return;
+    if (known.count >= knownallocated) {
+	size = knownallocated ? 2 * knownallocated : 256;
+	if (!(hints = realloc(knownhints, size * sizeof *hints)))
+	    return;
+	knownhints = hints;
+	knownallocated = size;
+    }
+    if ((i = addstate(&known, state)) < 0)
+	return;
+    knownhints[i].distance = distance;
+    knownhints[i].pos = pos;
+    knownhints[i].dir = dir;
+}
+
+/*
+ * Searching functions
+ */
+
+/* Return TRUE if the current search should be abandoned.
+ */
+static int cancelled(void)
+{
+    int	f;
+
+    pthread_mutex_lock(&lock);
+    f = pending || resetting;
+    pthread_mutex_unlock(&lock);
+    return f;
+}
+
+/* A successorfunc that adds a newly found position to the search. A
+ * route that ends at a solution, or at a position whose distance is
+ * already known, is remembered if it is the shortest so far.
+ */
+static void addsuccessor(unsigned char const *state, int block, int dir,
+			 void *data)
+{
+    searchctx  *ctx = data;
+    searchnode *n;
+    long	i, size;
+    int		length;
+
+    if (ctx->full || findstate(&visited, state) >= 0)
+	return;
+    if (visited.count >= nodesallocated) {
+	size = nodesallocated ? 2 * nodesallocated : 1024;
+	if (size > HINTMAXSTATES || !(n = realloc(nodes, size * sizeof *n))) {
+	    ctx->full = TRUE;
+	    return;
+	}
+	nodes = n;
+	nodesallocated = size;
+    }
+    if ((i = addstate(&visited, state)) < 0) {
+	ctx->full = TRUE;
+	return;
+    }
+    nodes[i].parent = ctx->parent;
+    nodes[i].block = block;
+    nodes[i].dir = dir;
+
+    if (isgoalstate(&info, state)) {
+	length = ctx->depth + 1;
+    } else {
+	size = findstate(&known, state);
+	if (size < 0 || knownhints[size].distance < 0)
+	    return;
+	length = ctx->depth + 1 + knownhints[size].distance;
+    }
+    if (ctx->bestlength < 0 || length < ctx->bestlength) {
+	ctx->best = i;
+	ctx->bestlength = length;
+    }
+}
+
+/* Record the distance of every position along the route ending at
+ * the given search node, whose total length is given.
+ */
+static void recordroute(long end, int length)
+{
+    long	i, child;
+    int		depth;
+
+    for (depth = 0, i = end ; nodes[i].parent >= 0 ; i = nodes[i].parent)
+	++depth;
+    pthread_mutex_lock(&lock);
+    if (isgoalstate(&info, visited.states + end * info.statesize))
+	addknown(visited.states + end * info.statesize, 0, 0, 0);
+    for (child = end, i = nodes[end].parent ; i >= 0 ;
+					      child = i, i = nodes[i].parent) {
+	--depth;
+	addknown(visited.states + i * info.statesize, length - depth,
+		 getblockcell(&info, visited.states + i * info.statesize,
+			      nodes[child].block),
+		 nodes[child].dir);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Search breadth-first from start for the nearest solution. The
+ * search stops early once no unexplored route can be shorter than
+ * the best one found. Nothing is recorded if the search grows too
+ * large. FALSE is returned if the search was abandoned.
+ */
+static int searchfrom(unsigned char const *start)
+{
+    searchctx	ctx;
+    long	first, last;
+
+    cleartable(&visited);
+    if (!nodesallocated) {
+	if (!(nodes = malloc(1024 * sizeof *nodes)))
+	    return FALSE;
+	nodesallocated = 1024;
+    }
+    if (addstate(&visited, start) < 0)
+	return FALSE;
+    nodes[0].parent = -1;
+    if (isgoalstate(&info, start)) {
+	recordroute(0, 0);
+	return TRUE;
+    }
+
+    ctx.best = -1;
+    ctx.bestlength = -1;
+    ctx.full = FALSE;
+    ctx.depth = 0;
+    for (first = 0, last = 1 ; first < last ; first = last,
+					       last = visited.count) {
+	for (ctx.parent = first ; ctx.parent < last ; ++ctx.parent) {
+	    if (ctx.parent % CHECKINTERVAL == 0 && cancelled())
+		return FALSE;
+	    getsuccessors(&info, visited.states + ctx.parent * info.statesize,
+			  addsuccessor, &ctx);
+	    if (ctx.full)
+		break;
+	}
+	++ctx.depth;
+	if (ctx.full || (ctx.bestlength >= 0
+				&& ctx.bestlength <= ctx.depth + 1))
+	    break;
+    }
+
+    if (ctx.full)
+	return TRUE;
+    if (ctx.bestlength >= 0) {
+	recordroute(ctx.best, ctx.bestlength);
+    } else {
+	pthread_mutex_lock(&lock);
+	addknown(start, -1, 0, 0);
+	pthread_mutex_unlock(&lock);
+    }
+    return TRUE;
+}
+
+/* The background thread. It sleeps until a position is requested,
+ * and then searches from it unless its distance is already known.
+ */
+static void *hintthread(void *data)
+{
+    unsigned char	state[MAXSTATESIZE];
+
+    (void)data;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+	while (!pending || resetting)
+	    pthread_cond_wait(&wakeup, &lock);
+	memcpy(state, request, info.statesize);
+	pending = FALSE;
+	if (findstate(&known, state) >= 0)
+	    continue;
+	busy = TRUE;
+	pthread_mutex_unlock(&lock);
+	searchfrom(state);
+	pthread_mutex_lock(&lock);
+	busy = FALSE;
+	pthread_cond_broadcast(&idle);
+    }
+    return NULL;
+}
+
+/*
+ * Exported functions
+ */
+
+/* Prepare to give hints for game. Any search in progress is abandoned,
+ * and the background thread is left idle while the tables are reset.
+ */
+void sethintgame(gamesetup const *game)
+{
+    pthread_t	thread;
+
+    pthread_mutex_lock(&lock);
+    resetting = TRUE;
+    while (busy)
+	pthread_cond_wait(&idle, &lock);
+    requested = FALSE;
+    pending = FALSE;
+    resetting = FALSE;
+
+    enabled = initsearch(&info, game);
+    freetable(&known);
+    freetable(&visited);
+    if (!started && enabled) {
+	if (pthread_create(&thread, NULL, hintthread, NULL))
+	    enabled = FALSE;
+	else
+	    started = TRUE;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Ask for the position in map to be searched in the background.
+ */
+void requesthint(cell const *map)
+{
+    unsigned char	state[MAXSTATESIZE];
+
+    if (!enabled)
+	return;
+    packstate(&info, map, state);
+    pthread_mutex_lock(&lock);
+    if (!requested || memcmp(state, request, info.statesize)) {
+	memcpy(request, state, info.statesize);
+	requested = TRUE;
+	pending = TRUE;
+	pthread_cond_signal(&wakeup);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Look up the next step of a shortest solution from the position in
+ * map.
+ */
+int gethint(cell const *map, int *pos, int *dir)
+{
+    unsigned char	state[MAXSTATESIZE];
+    long		i;
+    int			f = FALSE;
+
+    if (!enabled)
+	return FALSE;
+    packstate(&info, map, state);
+    pthread_mutex_lock(&lock);
+    if ((i = findstate(&known, state)) >= 0 && knownhints[i].distance > 0) {
+	*pos = knownhints[i].pos;
+	*dir = knownhints[i].dir;
+	f = TRUE;
+    }
+    pthread_mutex_unlock(&lock);
+    return f;
+}
@@ -0,0 +1,33 @@
+/* hint.h: Functions for finding the best next step in the background.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_hint_h_
+#define	_hint_h_
+
+#include	"cblocks.h"
+#include	"fileread.h"
+
+/* Prepare to give hints for game, discarding everything learned about
+ * the previous puzzle. The background thread is started the first
+ * time this function is called.
+ */
+extern void sethintgame(gamesetup const *game);
+
+/* Ask for the position in map to be searched in the background. Any
+ * search already in progress for a different position is abandoned.
+ * This function never waits for the search.
+ */
+extern void requesthint(cell const *map);
+
+/* Look up the next step of a shortest solution from the position in
+ * map. If one is known, a cell of the block to move is stored in pos,
+ * the direction of the step's first move is stored in dir, and TRUE
+ * is returned. FALSE is returned if the search has not finished yet,
+ * or if the position cannot be solved.
+ */
+extern int gethint(cell const *map, int *pos, int *dir);
+
+#endif
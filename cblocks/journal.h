@@ -0,0 +1,40 @@
+/* journal.h: Functions for recording the progress of the current
+ * puzzle as it is made.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_journal_h_
+#define	_journal_h_
+
+/* Read the journal left by a previous run. If it describes a puzzle
+ * that was not finished, the name of the puzzle file, the puzzle's
+ * index within it, and the events recorded for it are returned in
+ * allocated buffers, which the caller must free. FALSE is returned if
+ * there is no such journal.
+ */
+extern int readjournal(char **filename, int *level, char **events);
+
+/* Begin a new journal for the given puzzle, discarding the previous
+ * one. Nothing is recorded if the journal cannot be created.
+ */
+extern void startjournal(char const *filename, int level);
+
+/* Add an event to the journal. The event is only buffered, and is not
+ * written out until flushjournal() is called.
+ */
+extern void addtojournal(char const *event);
+
+/* Write out the events added since the last call. They are made sure
+ * to reach the disk within a few seconds, by a background thread, so
+ * that the caller never waits on it.
+ */
+extern void flushjournal(void);
+
+/* Empty the journal, so that the next run will not resume the
+ * current puzzle.
+ */
+extern void clearjournal(void);
+
+#endif
@@ -13,7 +13,9 @@
 #include	<errno.h>
 #include	<unistd.h>
 #include	<termios.h>
+#include	<poll.h>
 #include	<sys/ioctl.h>
+#include	<sys/signalfd.h>
 #include	<linux/kd.h>
 #include	"gen.h"
 #include 	"cblocks.h"
@@ -78,6 +80,20 @@ static Gpm_Connect	gpmconnection;
 #define	DONE_LEVELNAME	0x08
 #define	DONE_ALL	0x0F
 
+/* The largest number of unchanged cells that are rewritten rather
+ * than skipped over with a cursor movement.
+ */
+#define	MAXREWRITE	4
+
+/* The fewest blank cells that are cleared with a single erase
+ * sequence rather than being written out.
+ */
+#define	MINERASE	8
+
+/* The most bytes that a single call to out() may add to the output.
+ */
+#define	MAXOUTPUT	256
+
 /* Attributes used in the translation of the map to its display.
  */
 #define	ATTR_NORTH	0x0001
@@ -100,6 +116,16 @@ static Gpm_Connect	gpmconnection;
 #define	attr_bgcolor(a)		(((a) >> 4) & 15)
 #define	attr_colors(f, b)	((((f) & 15) << 8) | (((b) & 15) << 4))
 
+/* One character cell of the screen, holding either an ASCII
+ * character or, with FONTCELL set, a character from the console font,
+ * together with the display attribute it is shown in.
+ */
+typedef	unsigned long	screencell;
+#define	FONTCELL	0x100
+#define	cell_attr(c)		((int)((c) >> 16))
+#define	cell_char(c)		((int)((c) & 0xFF))
+#define	mkscreencell(a, ch)	(((screencell)(a) << 16) | (ch))
+
 /* Given a console font and a character, calculate a pointer to the
  * data for that character.
  */
@@ -176,6 +202,17 @@ static int			usingmouse = FALSE;
  */
 static int			redrawrequest = FALSE;
 
+/* Keystrokes that have been read but not yet returned by getkey().
+ */
+static unsigned char		inbuf[64];
+static int			inpos = 0;
+static int			incount = 0;
+
+/* A descriptor that receives SIGWINCH, or -1 if the signal is caught
+ * by a handler instead.
+ */
+static int			winchfd = -1;
+
 /* Signal handlers that were installed on startup that may need to be
  * reinstalled.
  */
@@ -222,6 +259,35 @@ static int			sidebar;
  */
 static int			silence = FALSE;
 
+/* The contents of the screen as of the last update, the contents
+ * being composed for the next one, and their dimensions.
+ */
+static screencell	       *shownscreen = NULL;
+static screencell	       *nextscreen = NULL;
+static int			screenlines = 0;
+static int			screencols = 0;
+
+/* FALSE if the screen may not hold what shownscreen says it does.
+ */
+static int			screenshown = FALSE;
+
+/* The display attribute currently in effect while updating the screen.
+ */
+static int			outattr = 0;
+
+/* The output waiting to be written to the screen, and the size of
+ * the buffer holding it.
+ */
+static char		       *outbuf = NULL;
+static int			outlen = 0;
+static int			outsize = 0;
+
+/* The UTF-8 encodings of the characters in the console font. The
+ * user-defined Unicode area U+F000 to U+F0FF is defined on the Linux
+ * console to map directly to the current font character.
+ */
+static char			fontcodes[256][3];
+
 /* The name of the program and the file currently being accessed,
  * for use in error messages (declared in gen.h).
  */
@@ -354,6 +420,19 @@ static void makewalls(char *chardata)
     }
 }
 
+/* Fill in the UTF-8 encodings of the font characters.
+ */
+static void makefontcodes(void)
+{
+    int	n;
+
+    for (n = 0 ; n < 256 ; ++n) {
+	fontcodes[n][0] = (char)0xEF;
+	fontcodes[n][1] = (char)(0x80 | (n >> 6));
+	fontcodes[n][2] = (char)(0x80 | (n & 0x3F));
+    }
+}
+
 /*
  * Output functions
  */
@@ -409,29 +488,224 @@ static int measurescreen(void)
     return TRUE;
 }
 
-/* Enqueue characters for output formatted according to fmt. If fmt is
- * NULL, the accumulated characters are flushed to the screen. The
- * cursor is always left in the bottom right.
+/* Make room in the output buffer for n more bytes.
+ */
+static void reserveout(int n)
+{
+    if (outlen + n <= outsize)
+	return;
+    if (!outsize)
+	outsize = 8192;
+    while (outlen + n > outsize)
+	outsize *= 2;
+    if (!(outbuf = realloc(outbuf, outsize)))
+	memerrexit();
+}
+
+/* Add n bytes to the output as they are.
+ */
+static void outbytes(char const *bytes, int n)
+{
+    reserveout(n);
+    memcpy(outbuf + outlen, bytes, n);
+    outlen += n;
+}
+
+/* Write out everything in the output buffer at once.
+ */
+static void flushout(void)
+{
+    int	n, i;
+
+    i = 0;
+    while (i < outlen) {
+	n = write(STDOUT_FILENO, outbuf + i, outlen - i);
+	if (n > 0)
+	    i += n;
+	else if (errno != EINTR)
+	    break;
+    }
+    outlen = 0;
+}
+
+/* Enqueue characters for output formatted according to fmt, which
+ * may produce no more than MAXOUTPUT bytes. If fmt is NULL, the
+ * accumulated characters are flushed to the screen.
  */
 static void out(char const *fmt, ...)
 {
-    static char	out[8192];
-    static int	size = 0;
     va_list	args;
 
     if (fmt) {
+	reserveout(MAXOUTPUT);
 	va_start(args, fmt);
-	size += vsprintf(out + size, fmt, args);
+	outlen += vsprintf(outbuf + outlen, fmt, args);
 	va_end(args);
+    } else
+	flushout();
+}
+
+/* Begin composing the next update of the screen, starting from a
+ * blank screen of the current size.
+ */
+static void startframe(void)
+{
+    int	n, i;
+
+    n = lastline * (sidebar + SIDEBARWIDTH);
+    if (screenlines != lastline || screencols != sidebar + SIDEBARWIDTH) {
+	free(shownscreen);
+	free(nextscreen);
+	shownscreen = malloc(n * sizeof *shownscreen);
+	nextscreen = malloc(n * sizeof *nextscreen);
+	if (!shownscreen || !nextscreen)
+	    memerrexit();
+	screenlines = lastline;
+	screencols = sidebar + SIDEBARWIDTH;
+	screenshown = FALSE;
+    }
+    for (i = 0 ; i < n ; ++i)
+	nextscreen[i] = ' ';
+}
+
+/* Add characters formatted according to fmt to the next update,
+ * starting at line y and column x. Anything that runs past the right
+ * edge is dropped.
+ */
+static void frametext(int y, int x, char const *fmt, ...)
+{
+    char	buf[256];
+    screencell *p;
+    va_list	args;
+    int		i;
+
+    if (y < 0 || y >= screenlines)
+	return;
+    va_start(args, fmt);
+    vsprintf(buf, fmt, args);
+    va_end(args);
+    p = nextscreen + y * screencols;
+    for (i = 0 ; buf[i] && x < screencols ; ++i, ++x)
+	if (x >= 0)
+	    p[x] = (unsigned char)buf[i];
+}
+
+/* Add two characters from the current console font, shown with the
+ * display attribute attr, to the next update at line y and column x.
+ */
+static void framepair(int y, int x, int attr, char const pair[2])
+{
+    screencell *p;
+
+    if (y < 0 || y >= screenlines || x < 0 || x + 1 >= screencols)
+	return;
+    p = nextscreen + y * screencols + x;
+    p[0] = mkscreencell(attr, FONTCELL | (unsigned char)pair[0]);
+    p[1] = mkscreencell(attr, FONTCELL | (unsigned char)pair[1]);
+}
+
+/* Change the display attribute in effect, if it is not already attr.
+ */
+static void setattr(int attr)
+{
+    static char const  *levelstr[] = { "22", "1", "2" };
+
+    if (attr == outattr)
+	return;
+    if (attr)
+	out("\033[%s;3%c;4%cm", levelstr[attr_level(attr)],
+				'0' + attr_fgcolor(attr),
+				'0' + attr_bgcolor(attr));
+    else
+	out("\033[22;39;49m");
+    outattr = attr;
+}
+
+/* Output the character in one cell, changing the display attribute
+ * first if necessary. A blank only needs the right background.
+ */
+static void outcell(screencell cell)
+{
+    char	ch;
+
+    if (cell == ' ') {
+	if (outattr && attr_bgcolor(outattr) != 9)
+	    setattr(0);
+	outbytes(" ", 1);
     } else {
-	write(STDOUT_FILENO, out, size);
-	size = 0;
+	setattr(cell_attr(cell));
+	if (cell & FONTCELL)
+	    outbytes(fontcodes[cell_char(cell)], 3);
+	else {
+	    ch = (char)cell_char(cell);
+	    outbytes(&ch, 1);
+	}
     }
 }
 
-/* Output a single line's worth of a string without breaking up words.
+/* Return the number of blank cells at the start of the n cells in
+ * row.
+ */
+static int blankrun(screencell const *row, int n)
+{
+    int	i;
+
+    for (i = 0 ; i < n && row[i] == ' ' ; ++i) ;
+    return i;
+}
+
+/* Bring the screen up to date with the next update. Only the cells
+ * that differ from the last update are output, each run of them
+ * preceded by a cursor movement, and long stretches of blanks are
+ * erased instead of written out. If the screen's contents are not
+ * known, it is erased and then treated as blank.
  */
-static int lineout(char const *str, int index)
+static void endframe(void)
+{
+    screencell const   *shown;
+    screencell const   *next;
+    int			y, x, cx, n, blanks;
+
+    n = screenlines * screencols;
+    if (!screenshown) {
+	out("\033[H\033[J");
+	for (x = 0 ; x < n ; ++x)
+	    shownscreen[x] = ' ';
+	screenshown = TRUE;
+    }
+    outattr = 0;
+    for (y = 0 ; y < screenlines ; ++y) {
+	shown = shownscreen + y * screencols;
+	next = nextscreen + y * screencols;
+	cx = -1;
+	for (x = 0 ; x < screencols ; ++x) {
+	    if (next[x] == shown[x])
+		continue;
+	    if (cx < 0 || x - cx > MAXREWRITE)
+		out("\033[%d;%dH", y + 1, x + 1);
+	    else
+		for ( ; cx < x ; ++cx)
+		    outcell(next[cx]);
+	    blanks = blankrun(next + x, screencols - x);
+	    if (blanks >= MINERASE) {
+		setattr(0);
+		out("\033[%dX", blanks);
+		x += blanks - 1;
+		cx = -1;
+	    } else {
+		outcell(next[x]);
+		cx = x + 1;
+	    }
+	}
+    }
+    setattr(0);
+    memcpy(shownscreen, nextscreen, n * sizeof *shownscreen);
+}
+
+/* Add a single line's worth of a string to line y of the next update
+ * without breaking up words.
+ */
+static int lineout(int y, char const *str, int index)
 {
     int	n;
 
@@ -440,7 +714,7 @@ static int lineout(char const *str, int index)
     if (str[index]) {
 	n = strlen(str + index);
 	if (n < SIDEBARWIDTH) {
-	    out("%*s", SIDEBARWIDTH, str + index);
+	    frametext(y, sidebar - 1, "%*s", SIDEBARWIDTH, str + index);
 	    index += n;
 	} else {
 	    if (n > SIDEBARWIDTH)
@@ -448,12 +722,13 @@ static int lineout(char const *str, int index)
 	    while (!isspace(str[index + n]) && n >= 0)
 		--n;
 	    if (n < 0) {
-		out("%.*s", SIDEBARWIDTH, str + index);
+		frametext(y, sidebar - 1, "%.*s", SIDEBARWIDTH, str + index);
 		index += SIDEBARWIDTH;
 		while (str[index] && !isspace(str[index]))
 		    ++index;
 	    } else {
-		out("%*.*s", SIDEBARWIDTH, n, str + index);
+		frametext(y, sidebar - 1, "%*.*s", SIDEBARWIDTH, n,
+					  str + index);
 		index += n + 1;
 	    }
 	}
@@ -461,70 +736,52 @@ static int lineout(char const *str, int index)
     return index;
 }
 
-/* Copy the map into screengrid, translating cell contents into
- * display attributes.
- */
-static void maptogrid(short screengrid[MAXHEIGHT][MAXWIDTH],
-		      cell const *map, char const *colors,
-		      int ysize, int xsize, int currblock, int movecount)
-{
-    cell const *p;
-    int		y, x, n;
-
-    memset(screengrid, 0, MAXHEIGHT * MAXWIDTH * sizeof screengrid[0][0]);
-    p = map;
-    for (y = 0 ; y < ysize ; ++y, p += XSIZE) {
-	for (x = 0 ; x < xsize ; ++x) {
-	    n = blockid(p[x]);
-	    if (n) {
-		if (n == WALLID)
-		    screengrid[y][x] = ATTR_FRAME;
-		else {
-		    if (colors[n])
-			screengrid[y][x] = attr_colors(colors[n], 9);
-		    else
-			screengrid[y][x] = ATTR_WHITEBLOCK;
-		    if (currblock && n == currblock)
-			screengrid[y][x] |= ATTR_SELECTED;
-		}
-		if (p[x] & EXTENDNORTH)
-		    screengrid[y][x] |= ATTR_NORTH;
-		if (p[x] & EXTENDEAST)
-		    screengrid[y][x] |= ATTR_EAST;
-		if (p[x] & EXTENDSOUTH)
-		    screengrid[y][x] |= ATTR_SOUTH;
-		if (p[x] & EXTENDWEST)
-		    screengrid[y][x] |= ATTR_WEST;
-	    } else if (p[x] & (GOAL | DOORSTAMP_MASK)) {
-		if (p[x] & GOAL)
-		    screengrid[y][x] = ATTR_GOAL;
-		else if (doortime(p[x]) > movecount)
-		    screengrid[y][x] = ATTR_CLOSEDOOR;
-		else
-		    screengrid[y][x] = ATTR_OPENDOOR;
-		if (p[x] & FEXTENDNORTH)
-		    screengrid[y][x] |= ATTR_NORTH;
-		if (p[x] & FEXTENDEAST)
-		    screengrid[y][x] |= ATTR_EAST;
-		if (p[x] & FEXTENDSOUTH)
-		    screengrid[y][x] |= ATTR_SOUTH;
-		if (p[x] & FEXTENDWEST)
-		    screengrid[y][x] |= ATTR_WEST;
-	    }
-	}
-    }
-}
-
-/* Display two characters directly from the current console font. The
- * user-defined Unicode area U+F000 to U+F0FF is defined on the Linux
- * console to map directly to the current font character. The function
- * handles the conversion to UTF-8.
+/* Translate the contents of a cell into its display attribute,
+ * including the directions in which the object in it extends. Zero is
+ * returned for an empty cell.
  */
-static void outpair(char const pair[2])
+static int cellattr(cell c, char const *colors, int currblock)
 {
-    out("\xEF%c%c\xEF%c%c",
-	0x80 | ((unsigned char)pair[0] >> 6), 0x80 | (pair[0] & 0x3F),
-	0x80 | ((unsigned char)pair[1] >> 6), 0x80 | (pair[1] & 0x3F));
+    int	attr, n;
+
+    n = blockid(c);
+    if (n) {
+	if (n == WALLID)
+	    attr = ATTR_FRAME;
+	else {
+	    if (colors[n])
+		attr = attr_colors(colors[n], 9);
+	    else
+		attr = ATTR_WHITEBLOCK;
+	    if (currblock && n == currblock)
+		attr |= ATTR_SELECTED;
+	}
+	if (c & EXTENDNORTH)
+	    attr |= ATTR_NORTH;
+	if (c & EXTENDEAST)
+	    attr |= ATTR_EAST;
+	if (c & EXTENDSOUTH)
+	    attr |= ATTR_SOUTH;
+	if (c & EXTENDWEST)
+	    attr |= ATTR_WEST;
+    } else if (c & (GOAL | DOOR)) {
+	if (c & GOAL)
+	    attr = ATTR_GOAL;
+	else if (isdoorclosed(c))
+	    attr = ATTR_CLOSEDOOR;
+	else
+	    attr = ATTR_OPENDOOR;
+	if (c & FEXTENDNORTH)
+	    attr |= ATTR_NORTH;
+	if (c & FEXTENDEAST)
+	    attr |= ATTR_EAST;
+	if (c & FEXTENDSOUTH)
+	    attr |= ATTR_SOUTH;
+	if (c & FEXTENDWEST)
+	    attr |= ATTR_WEST;
+    } else
+	attr = 0;
+    return attr;
 }
 
 /* Display the game state on the console. The map is placed in the
@@ -537,85 +794,62 @@ int displaygame(cell const *map, int ysize, int xsize,
 		int saves, int movecount, int stepcount,
 		int beststepcount, int bestmovecount, int beststepknown)
 {
-    static char const  *levelstr[] = { "22", "1", "2" };
-    static short	screengrid[MAXHEIGHT][MAXWIDTH];
     char		buf[SIDEBARWIDTH + 1];
-    short	       *p;
+    cell const	       *p;
     int			done;
-    int			attr, lastattr;
+    int			attr;
     int			nameindex = 0;
     int			y, x;
 
-    out("\033[H");
-
     if (ysize > fieldheight || xsize > fieldwidth) {
-	out("Level %d won't fit on the screen.\033[J", index);
+	out("\033[HLevel %d won't fit on the screen.\033[J", index);
 	out(NULL);
+	screenshown = FALSE;
 	return FALSE;
     }
 
-    maptogrid(screengrid, map, colors, ysize, xsize, currblock, movecount);
-
-    p = screengrid[0];
+    startframe();
     for (y = 0, done = 0 ; done != DONE_ALL && y <= lastline ; ++y) {
-	if (y)
-	    out("\n");
 	if (y < ysize) {
-	    lastattr = 0;
+	    p = map + y * xsize;
 	    for (x = 0 ; x < xsize ; ++x) {
-		attr = screengrid[y][x] & ~ATTR_SHAPE;
-		if (!attr) {
-		    out(lastattr ? "\033[39;49m  " : "  ");
-		    lastattr = 0;
-		    continue;
-		}
-		if (lastattr != attr) {
-		    out("\033[%s;3%c;4%cm", levelstr[attr_level(attr)],
-					    '0' + attr_fgcolor(attr),
-					    '0' + attr_bgcolor(attr));
-		    lastattr = attr;
-		}
-		outpair(linecells[screengrid[y][x] & ATTR_SHAPE]);
+		attr = cellattr(p[x], colors, currblock);
+		if (attr)
+		    framepair(y, x * 2, attr & ~ATTR_SHAPE,
+			      linecells[attr & ATTR_SHAPE]);
 	    }
-	    out("\033[22;39;49m");
-	} else {
-	    x = 0;
+	} else
 	    done |= DONE_MAP;
-	}
 
 	switch (y) {
 	  case 0:
 	    if (index) {
 		sprintf(buf, "# %d", index);
-		out("%*s", sidebar + SIDEBARWIDTH - x * 2 - 1, buf);
+		frametext(0, sidebar - 1, "%*s", SIDEBARWIDTH, buf);
 	    }
 	    break;
 	  case 1:
-	    out("%*s  Steps: %d", sidebar - x * 2 - 1, "", stepcount);
-	    if (saves)
-		out("    S");
+	    frametext(1, sidebar - 1, "  Steps: %d%s", stepcount,
+		      saves ? "    S" : "");
 	    break;
 	  case 2:
-	    out("%*s  Moves: %d", sidebar - x * 2 - 1, "", movecount);
+	    frametext(2, sidebar - 1, "  Moves: %d", movecount);
 	    break;
 	  case 3:
 	    if (beststepknown)
-		out("%*sMinimum: %d steps", sidebar - x * 2 - 1, "",
-					    beststepknown);
+		frametext(3, sidebar - 1, "Minimum: %d steps", beststepknown);
 	    break;
 	  case 4:
-	    if (beststepcount) {
-		out("%*s   Best: %d", sidebar - x * 2 - 1, "", beststepcount);
-		if (beststepcount < 10000)
-		    out(" steps");
-	    }
+	    if (beststepcount)
+		frametext(4, sidebar - 1, "   Best: %d%s", beststepcount,
+			  beststepcount < 10000 ? " steps" : "");
 	    break;
 	  case 5:
 	    if (beststepcount && bestmovecount) {
 		if (bestmovecount < 10000)
-		    out("%*s%d moves", sidebar - x * 2 + 8, "", bestmovecount);
+		    frametext(5, sidebar + 8, "%d moves", bestmovecount);
 		else
-		    out("%*d moves", sidebar - x * 2 + 12, bestmovecount);
+		    frametext(5, sidebar - 1, "%13d moves", bestmovecount);
 	    }
 	    break;
 	  case 6:
@@ -625,16 +859,14 @@ int displaygame(cell const *map, int ysize, int xsize,
 	  default:
 	    if (!(done & DONE_SERIESNAME)) {
 		if (seriesname && seriesname[nameindex]) {
-		    out("%*s", sidebar - x * 2 - 1, "");
-		    nameindex = lineout(seriesname, nameindex);
+		    nameindex = lineout(y, seriesname, nameindex);
 		} else {
 		    done |= DONE_SERIESNAME;
 		    nameindex = 0;
 		}
 	    } else if (!(done & DONE_LEVELNAME)) {
 		if (levelname && levelname[nameindex]) {
-		    out("%*s", sidebar - x * 2 - 1, "");
-		    nameindex = lineout(levelname, nameindex);
+		    nameindex = lineout(y, levelname, nameindex);
 		} else {
 		    done |= DONE_LEVELNAME;
 		    nameindex = 0;
@@ -642,11 +874,9 @@ int displaygame(cell const *map, int ysize, int xsize,
 	    }
 	    break;
 	}
-	p += XSIZE;
-	out("\033[K");
     }
+    endframe();
 
-    out("\033[J");
     if (ycursor && xcursor)
 	out("\033[%d;%dH", ycursor + 1, xcursor * 2 + 1);
     else
@@ -692,6 +922,7 @@ void displayhelp(char const *keys[], int keycount)
 
     out("\033[J\n\nPress any key to return.");
     out(NULL);
+    screenshown = FALSE;
 }
 
 /* Display a closing message appropriate to the completion of a
@@ -703,46 +934,71 @@ void displayendmessage(int endofsession)
 	lastline - 1, sidebar + 1, lastline, sidebar + 1,
 	endofsession ? "  to exit" : "to continue");
     out(NULL);
+    screenshown = FALSE;
 }
 
 /*
  * Input functions
  */
 
-/* Read a single character. If redrawrequest has been set to TRUE,
- * reset the display and return a faked Ctrl-L.
+/* Discard the signals waiting in winchfd and arrange for the screen
+ * to be redrawn at its new size. The font is loaded again, in case the
+ * resizing replaced it.
+ */
+static void resized(void)
+{
+    struct signalfd_siginfo	info;
+
+    while (read(winchfd, &info, sizeof info) > 0) ;
+    if (usingfont)
+	setfontdata(newfontdata);
+    redrawrequest = TRUE;
+}
+
+/* Read a single character. The process sleeps in poll() until the
+ * keyboard, the mouse, or winchfd has something to say. Without the
+ * mouse, everything waiting to be read is taken in at once, so that
+ * inputpending() can see what is left. If redrawrequest has been set
+ * to TRUE, reset the display and return a faked Ctrl-L.
  */
 static int getkey(void)
 {
-    fd_set		in, empty;
-    int			max, n;
-    unsigned char	ch;
+    struct pollfd	fds[3];
+    int			n;
 
     for (;;) {
-	if (mousefd >= 0) {
-	    FD_ZERO(&in);
-	    FD_ZERO(&empty);
-	    FD_SET(STDIN_FILENO, &in);
-	    FD_SET(mousefd, &in);
-	    max = (STDIN_FILENO > mousefd ? STDIN_FILENO : mousefd) + 1;
-	    n = select(max, &in, &empty, &empty, NULL);
-	    if (n > 0)
-		return mousegetchar();
-	    else if (n == 0 || errno != EINTR)
-		return EOF;
-	} else {
-	    n = read(STDIN_FILENO, &ch, 1);
-	    if (n > 0)
-		return ch;
-	    else if (n == 0 || errno != EINTR)
-		return EOF;
-	}
+	if (inpos < incount)
+	    return inbuf[inpos++];
 	if (redrawrequest) {
 	    redrawrequest = FALSE;
 	    erasescreen();
 	    measurescreen();
+	    screenshown = FALSE;
 	    return '\f';
 	}
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = winchfd;
+	fds[1].events = POLLIN;
+	fds[2].fd = mousefd;
+	fds[2].events = POLLIN;
+	if (poll(fds, 3, -1) < 0) {
+	    if (errno != EINTR)
+		return EOF;
+	    continue;
+	}
+	if (fds[1].revents & POLLIN)
+	    resized();
+	if (mousefd >= 0 && (fds[0].revents || fds[2].revents))
+	    return mousegetchar();
+	if (fds[0].revents) {
+	    n = read(STDIN_FILENO, inbuf, sizeof inbuf);
+	    if (n > 0) {
+		inpos = 0;
+		incount = n;
+	    } else if (n == 0 || errno != EINTR)
+		return EOF;
+	}
     }
 }
 
@@ -775,9 +1031,22 @@ int input(void)
 	    }
 	}
     }
+    if (key == '\f')
+	screenshown = FALSE;
     return key;
 }
 
+/* Return TRUE if keystrokes are waiting to be read.
+ */
+int inputpending(void)
+{
+    int	n;
+
+    if (inpos < incount)
+	return TRUE;
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+}
+
 #ifndef NOMOUSE
 
 /* Handle mouse activity. The screen coordinates are translated into a
@@ -822,6 +1091,7 @@ static int startup(void)
 	return FALSE;
     usingmouse = openmouse();
     erasescreen();
+    screenshown = FALSE;
     return TRUE;
 }
 
@@ -884,6 +1154,7 @@ static void bailout(int signum)
 int ioinitialize(int silenceflag)
 {
     struct sigaction	act;
+    sigset_t		mask;
 
     silence = silenceflag;
 
@@ -902,8 +1173,15 @@ int ioinitialize(int silenceflag)
     act.sa_handler = chainandredraw;
     myhandler[SIGTSTP] = act;
     sigaction(SIGTSTP, &act, prevhandler + SIGTSTP);
-    myhandler[SIGWINCH] = act;
-    sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    winchfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (winchfd >= 0)
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+    else {
+	myhandler[SIGWINCH] = act;
+	sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    }
 
     act.sa_handler = bailout;
     sigaction(SIGINT, &act, prevhandler + SIGINT);
@@ -921,6 +1199,7 @@ int ioinitialize(int silenceflag)
 	memerrexit();
     memcpy(newfontdata, origfont.chardata, fullfontsize);
     makewalls(newfontdata);
+    makefontcodes();
 
     return startup();
 }
@@ -946,6 +1225,7 @@ int fileerr(char const *msg)
     fputs(": ", stderr);
     fputs(msg ? msg : errno ? strerror(errno) : "unknown error", stderr);
     fputc('\n', stderr);
+    screenshown = FALSE;
     return FALSE;
 }
 
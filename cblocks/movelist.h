@@ -7,10 +7,18 @@
 #ifndef	_movelist_h_
 #define	_movelist_h_
 
-/* A move is stored as a block identifier, block coordinates, and a
- * direction, plus one bit indicating if a door was opened.
- */
-typedef	struct action { int id:12, dir:3, door:1, y:8, x:8; } action;
+/* A move is stored in two bytes, as a block identifier in the low
+ * twelve bits, a direction in the next two, plus one bit indicating
+ * if a door was opened. The position of the block is not stored; it
+ * is found by following the moves from the start of the puzzle.
+ */
+typedef	unsigned short	action;
+
+#define	actionid(a)		((int)((a) & 0x0FFF))
+#define	actiondir(a)		((int)(((a) >> 12) & 3))
+#define	actiondoor(a)		(((a) & 0x4000) != 0)
+#define	mkaction(id, dir, door)	\
+	((action)((id) | ((dir) << 12) | ((door) ? 0x4000 : 0)))
 
 /* A list of moves.
  */
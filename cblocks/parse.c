@@ -32,12 +32,13 @@ typedef	struct filemapinfo {
 /* Read a pictorial map out of the given file, using the dimensions
  * stored in fmi. If fillcharset is TRUE, block characters are added
  * to fmi's charset; otherwise, block characters are required to be
- * listed there already. The return value is the map, or NULL if an
- * error was encountered.
+ * listed there already. The lines of the picture are examined where
+ * they lie in the file's buffer. The return value is the map, or NULL
+ * if an error was encountered.
  */
-static char *readpicture(FILE *fp, filemapinfo *fmi, int fillcharset)
+static char *readpicture(filebuf *fb, filemapinfo *fmi, int fillcharset)
 {
-    char	buf[256];
+    char const *buf;
     char       *map;
     char       *p;
     int		ok = TRUE;
@@ -50,8 +51,8 @@ static char *readpicture(FILE *fp, filemapinfo *fmi, int fillcharset)
     memset(map, ' ', fmi->ysize * fmi->xsize);
     p = map;
     for (y = 0 ; y < fmi->ysize ; ++y) {
-	n = getnline(fp, buf, sizeof buf);
-	if (n < 0 || *buf == ';')
+	buf = nextline(fb, &n);
+	if (!buf || (n && *buf == ';'))
 	    break;
 	if (!ok)
 	    continue;
@@ -87,26 +88,34 @@ static char *readpicture(FILE *fp, filemapinfo *fmi, int fillcharset)
  * an error message if an error is found, an empty string if no errors
  * were found, or NULL if the end of the puzzle was reached.
  */
-static char const *readmapinfoline(FILE *fp, filemapinfo *fmi)
+static char const *readmapinfoline(filebuf *fb, filemapinfo *fmi)
 {
-    char	buf[256];
-    char       *statement, *args;
-    char       *tmp;
-    int		r, g, b;
-    int		n;
+    static char	       *buf = NULL;
+    static int		bufsize = 0;
+    char const	       *line;
+    char	       *statement, *args;
+    char	       *tmp;
+    int			r, g, b;
+    int			n;
 
     for (;;) {
-	n = getnline(fp, buf, sizeof buf);
-	if (n < 0)
+	line = nextline(fb, &n);
+	if (!line)
 	    return NULL;
-	if (!n || *buf == ';')
+	if (!n || *line == ';')
 	    continue;
-	while (isspace(buf[n - 1]))
+	while (n && isspace((unsigned char)line[n - 1]))
 	    --n;
-	buf[n] = '\0';
 	if (n)
 	    break;
     }
+    if (n >= bufsize) {
+	bufsize = n + 1;
+	if (!(buf = realloc(buf, bufsize)))
+	    memerrexit();
+    }
+    memcpy(buf, line, n);
+    buf[n] = '\0';
 
     for (statement = buf ; isspace(*statement) ; ++statement) ;
     if ((args = strchr(statement, ' ')))
@@ -154,17 +163,17 @@ static char const *readmapinfoline(FILE *fp, filemapinfo *fmi)
 	}
 	fmi->charset[(int)args[-1]] = n;
     } else if (!strcmp(statement, "initial")) {
-	if (!(fmi->map = readpicture(fp, fmi, TRUE)))
+	if (!(fmi->map = readpicture(fb, fmi, TRUE)))
 	    return "invalid syntax in initial map";
     } else if (!strcmp(statement, "target")) {
 	if (!fmi->map)
 	    return "the initial section must precede the target section";
-	if (!(fmi->goal = readpicture(fp, fmi, FALSE)))
+	if (!(fmi->goal = readpicture(fb, fmi, FALSE)))
 	    return "invalid syntax in target map";
     } else if (!strcmp(statement, "hint")) {
 	if (!fmi->map)
 	    return "the initial section must precede the hint section";
-	if ((tmp = readpicture(fp, fmi, FALSE)))
+	if ((tmp = readpicture(fb, fmi, FALSE)))
 	    free(tmp);
     } else if (!strcmp(statement, "image")) {
 	/* nop */
@@ -177,21 +186,30 @@ static char const *readmapinfoline(FILE *fp, filemapinfo *fmi)
     return "";
 }
 
-/* Recursively replace all connected occurrences of a block character
- * with the given block ID.
+/* Return the representative of the set of cells containing pos, and
+ * point every cell passed along the way directly at it.
+ */
+static int findset(int *parent, int pos)
+{
+    int	root, next;
+
+    for (root = pos ; parent[root] != root ; root = parent[root]) ;
+    while (parent[pos] != root) {
+	next = parent[pos];
+	parent[pos] = root;
+	pos = next;
+    }
+    return root;
+}
+
+/* Merge the sets of cells containing a and b.
  */
-static void fillblockid(cell *pos, cell rawid, cell numid)
+static void joinsets(int *parent, int a, int b)
 {
-    *pos &= ~(MARK | BLOCKID_MASK);
-    *pos |= numid;
-    if ((pos[-XSIZE] & (MARK | BLOCKID_MASK)) == rawid)
-	fillblockid(pos - XSIZE, rawid, numid);
-    if ((pos[+1] & (MARK | BLOCKID_MASK)) == rawid)
-	fillblockid(pos + 1, rawid, numid);
-    if ((pos[+XSIZE] & (MARK | BLOCKID_MASK)) == rawid)
-	fillblockid(pos + XSIZE, rawid, numid);
-    if ((pos[-1] & (MARK | BLOCKID_MASK)) == rawid)
-	fillblockid(pos - 1, rawid, numid);
+    a = findset(parent, a);
+    b = findset(parent, b);
+    if (a != b)
+	parent[b] = a;
 }
 
 /* Join neighboring cells containing part of the same object, where
@@ -200,25 +218,26 @@ static void fillblockid(cell *pos, cell rawid, cell numid)
 static void connectcells(gamesetup *game, cell *map)
 {
     cell       *p;
+    int		w = game->xsize;
     int		y, x, n;
 
     p = map;
-    for (y = 0 ; y < game->ysize ; ++y, p += XSIZE) {
-	for (x = 0 ; x < game->xsize ; ++x) {
+    for (y = 0 ; y < game->ysize ; ++y, p += w) {
+	for (x = 0 ; x < w ; ++x) {
 	    if ((n = blockid(p[x]))) {
-		if (y && blockid(p[x - XSIZE]) == n) {
+		if (y && blockid(p[x - w]) == n) {
 		    p[x] |= EXTENDNORTH;
-		    p[x - XSIZE] |= EXTENDSOUTH;
+		    p[x - w] |= EXTENDSOUTH;
 		}
 		if (x && blockid(p[x - 1]) == n) {
 		    p[x] |= EXTENDWEST;
 		    p[x - 1] |= EXTENDEAST;
 		}
 	    }
-	    if ((n = p[x] & (GOAL | DOORSTAMP_MASK))) {
-		if (y && (p[x - XSIZE] & n)) {
+	    if ((n = p[x] & (GOAL | DOOR))) {
+		if (y && (p[x - w] & n)) {
 		    p[x] |= FEXTENDNORTH;
-		    p[x - XSIZE] |= FEXTENDSOUTH;
+		    p[x - w] |= FEXTENDSOUTH;
 		}
 		if (x && (p[x - 1] & n)) {
 		    p[x] |= FEXTENDWEST;
@@ -229,85 +248,158 @@ static void connectcells(gamesetup *game, cell *map)
     }
 }
 
+/* Free the maps read in by readmapinfoline().
+ */
+static void freemapinfo(filemapinfo *fmi)
+{
+    free(fmi->map);
+    free(fmi->goal);
+    fmi->map = fmi->goal = NULL;
+}
+
+/* Free the memory allocated for a puzzle by readlevelmap().
+ */
+static void freegamesetup(gamesetup *game)
+{
+    free(game->map);
+    free(game->goal);
+    free(game->equivs);
+    free(game->colors);
+    game->map = game->goal = NULL;
+    game->equivs = NULL;
+    game->colors = NULL;
+}
+
 /* Read the specification for a single puzzle out of the given file
  * and initialize the gamesetup structure for that puzzle. Blocks and
  * other objects are identified and located, and the map and goal
- * image are rendered into their final states.
+ * image are rendered into their final states. The maps and the
+ * per-block arrays are allocated to fit the puzzle. If quiet is TRUE,
+ * errors are not displayed, and FALSE is simply returned.
  */
-int readlevelmap(FILE *fp, gamesetup *game)
+int readlevelmap(filebuf *fb, gamesetup *game, int quiet)
 {
     filemapinfo		info = { 0 };
-    unsigned char	idset[256] = { 0 };
+    unsigned short	idset[256] = { 0 };
     char const	       *p1;
+    char const	       *msg;
     cell	       *p2;
+    int		       *parent, *ids;
     int			errorcount;
-    int			rawid, nextid, id;
-    int 		y, x, n;
+    int			rawid, nextid;
+    int 		w, y, x, n, pos, root;
 
     memset(game, 0, sizeof *game);
     errorcount = 0;
-    while ((p1 = readmapinfoline(fp, &info)) != NULL) {
+    while ((p1 = readmapinfoline(fb, &info)) != NULL) {
 	if (*p1) {
-	    fileerr(p1);
+	    if (!quiet)
+		fileerr(p1);
 	    ++errorcount;
 	}
     }
+    msg = NULL;
     if (errorcount || !info.ysize || !info.xsize)
-	return FALSE;
+	msg = "";
     else if (!info.map || !info.goal)
-	return fileerr("Puzzle specification contains errors");
+	msg = "Puzzle specification contains errors";
     else if (info.ysize > MAXHEIGHT - 2 || info.xsize > MAXWIDTH - 2)
-	return fileerr("ignoring map which exceeds maximum dimensions");
+	msg = "ignoring map which exceeds maximum dimensions";
+    if (msg) {
+	freemapinfo(&info);
+	return *msg && !quiet ? fileerr(msg) : FALSE;
+    }
     game->ysize = info.ysize + 2;
-    game->xsize = info.xsize + 2;
+    game->xsize = w = info.xsize + 2;
     game->beststepknown = info.beststepknown;
     strcpy(game->name, info.name);
+    n = game->ysize * game->xsize;
+    if (!(game->map = calloc(n, sizeof *game->map)))
+	memerrexit();
+    if (!(game->goal = calloc(n, sizeof *game->goal)))
+	memerrexit();
     p2 = game->map;
     for (y = 1, p1 = info.map ; y <= info.ysize ; ++y) {
-	p2 += XSIZE;
+	p2 += w;
 	for (x = 1 ; x <= info.xsize ; ++x, ++p1) {
 	    if (*p1 == '#') {
 		p2[x] = WALLID;
 		info.goal[p1 - info.map] = '#';
 	    }
-	    else if (*p1 == '%')
-		p2[x] = DOORSTAMP_MASK;
-	    else if (*p1 != ' ')
+	    else if (*p1 == '%') {
+		p2[x] = DOOR | DOORCLOSED;
+		++game->doorcount;
+	    } else if (*p1 != ' ')
 		p2[x] = MARK | *p1;
 	}
     }
+
+    /* Connected cells marked with the same block character (other
+     * than $, which always marks a block of one cell) are gathered
+     * into sets. Each set is then numbered in the order that its
+     * top-left cell appears in the map.
+     */
+    if (!(parent = malloc(n * sizeof *parent)))
+	memerrexit();
+    if (!(ids = calloc(n, sizeof *ids)))
+	memerrexit();
+    for (pos = 0 ; pos < n ; ++pos)
+	parent[pos] = pos;
+    for (y = 1 ; y <= info.ysize ; ++y) {
+	for (x = 1, pos = y * w + 1 ; x <= info.xsize ; ++x, ++pos) {
+	    if (!(game->map[pos] & MARK) || blockid(game->map[pos]) == '$')
+		continue;
+	    if (game->map[pos - w] == game->map[pos])
+		joinsets(parent, pos - w, pos);
+	    if (game->map[pos - 1] == game->map[pos])
+		joinsets(parent, pos - 1, pos);
+	}
+    }
     nextid = FIRSTID;
-    p2 = game->map;
-    for (y = 1, p1 = info.map ; y <= info.ysize ; ++y) {
-	p2 += XSIZE;
-	for (x = 1 ; x <= info.xsize ; ++x, ++p1) {
-	    if (!(p2[x] & MARK))
+    for (y = 1 ; y <= info.ysize ; ++y) {
+	for (x = 1, pos = y * w + 1 ; x <= info.xsize ; ++x, ++pos) {
+	    if (!(game->map[pos] & MARK))
 		continue;
-	    rawid = blockid(p2[x]);
-	    id = rawid == info.key ? KEYID : nextid++;
-	    p2[x] &= ~(MARK | BLOCKID_MASK);
-	    p2[x] |= id;
-	    if (rawid != '$') {
-		fillblockid(p2 + x, MARK | rawid, id);
-		idset[rawid] = id;
+	    rawid = blockid(game->map[pos]);
+	    root = findset(parent, pos);
+	    if (!ids[root]) {
+		if (rawid != info.key && nextid > LASTID) {
+		    free(parent);
+		    free(ids);
+		    freegamesetup(game);
+		    freemapinfo(&info);
+		    return quiet ? FALSE
+				 : fileerr("too many blocks in puzzle");
+		}
+		ids[root] = rawid == info.key ? KEYID : nextid++;
+		if (rawid != '$')
+		    idset[rawid] = ids[root];
 	    }
+	    game->map[pos] &= ~(MARK | BLOCKID_MASK);
+	    game->map[pos] |= ids[root];
 	}
     }
+    free(parent);
+    free(ids);
     game->blockcount = nextid;
+    if (!(game->equivs = calloc(nextid, sizeof *game->equivs)))
+	memerrexit();
+    if (!(game->colors = calloc(nextid, sizeof *game->colors)))
+	memerrexit();
     for (n = 0 ; n < (int)(sizeof info.charset) ; ++n) {
 	if (idset[n]) {
-	    game->equivs[(int)idset[n]] = idset[(int)info.charset[n]];
-	    game->colors[(int)idset[n]] = info.colors[n];
+	    game->equivs[idset[n]] = idset[(int)info.charset[n]];
+	    game->colors[idset[n]] = info.colors[n];
 	}
     }
     p2 = game->goal;
     for (y = 1, p1 = info.goal ; y <= info.ysize ; ++y) {
-	p2 += XSIZE;
+	p2 += w;
 	for (x = 1 ; x <= info.xsize ; ++x, ++p1) {
 	    if (*p1 == '#')
 		p2[x] = WALLID;
 	    else if (*p1 == '%')
-		p2[x] = DOORSTAMP_MASK;
+		p2[x] = DOOR | DOORCLOSED;
 	    else if (*p1 != ' ') {
 		p2[x] = idset[(int)*p1];
 		if (info.etch)
@@ -315,16 +407,17 @@ int readlevelmap(FILE *fp, gamesetup *game)
 	    }
 	}
     }
+    freemapinfo(&info);
 
-    for (x = 0 ; x < game->xsize ; ++x)
+    for (x = 0 ; x < w ; ++x)
 	game->map[x] = game->goal[x] = WALLID;
     for (y = 1 ; y < game->ysize - 1 ; ++y)
-	game->map[y * XSIZE] = game->goal[y * XSIZE]
-			     = game->map[y * XSIZE + game->xsize - 1]
-			     = game->goal[y * XSIZE + game->xsize - 1]
-			     = WALLID;
-    for (x = 0 ; x < game->xsize ; ++x)
-	game->map[y * XSIZE + x] = game->goal[y * XSIZE + x] = WALLID;
+	game->map[y * w] = game->goal[y * w]
+			 = game->map[y * w + w - 1]
+			 = game->goal[y * w + w - 1]
+			 = WALLID;
+    for (x = 0 ; x < w ; ++x)
+	game->map[y * w + x] = game->goal[y * w + x] = WALLID;
 
     connectcells(game, game->map);
     connectcells(game, game->goal);
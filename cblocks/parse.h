@@ -9,9 +9,10 @@
 #include	<stdio.h>
 #include	"fileread.h"
 
-/* Read a single map from the current position of fp and use it to
- * initialize the given gamesetup structure.
+/* Read a single map from the current position of fb and use it to
+ * initialize the given gamesetup structure. If quiet is TRUE, errors
+ * in the map are not displayed.
  */
-extern int readlevelmap(FILE *fp, gamesetup *game);
+extern int readlevelmap(filebuf *fb, gamesetup *game, int quiet);
 
 #endif
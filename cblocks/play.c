@@ -5,10 +5,13 @@
  */
 
 #include	<stdlib.h>
+#include	<stdio.h>
 #include	<string.h>
 #include	"gen.h"
 #include	"cblocks.h"
 #include	"userio.h"
+#include	"hint.h"
+#include	"journal.h"
 #include	"play.h"
 
 /* The bits of a cell that move with a block.
@@ -16,158 +19,328 @@
 #define	BLOCK_MASK	(BLOCKID_MASK | EXTENDNORTH | EXTENDEAST	\
 				      | EXTENDSOUTH | EXTENDWEST)
 
-/* Set the timestamp on a door cell.
+/* How many moves apart the checkpoints are.
  */
-#define	stampdoor(c, m)	((cell)(((c) & ~DOORSTAMP_MASK)	\
-				| (((m) << 16) & DOORSTAMP_MASK)))
+#ifndef CHECKPOINTINTERVAL
+#define	CHECKPOINTINTERVAL	128
+#endif
 
-/* One entry on the saved-state stack.
+/* A copy of the position after a multiple of CHECKPOINTINTERVAL moves
+ * along the current line of play, which is the undo list followed by
+ * the redo list.
+ */
+typedef	struct checkpoint {
+    cell       *map;		/* the map */
+    doorevent  *doorlog;	/* the doors opened so far */
+    int		opencount;	/* number of entries in doorlog */
+    int		stepcount;	/* number of steps made */
+    unsigned long hash;		/* the position's hash */
+} checkpoint;
+
+/* A position along the line of play, as seen in passing.
+ */
+typedef	struct linepos {
+    unsigned long hash;		/* the position's hash */
+    int		stepcount;	/* number of steps made to reach it */
+} linepos;
+
+/* One entry on the saved-state stack. A saved state does not copy
+ * the game: its undo and redo lists begin with moves shared with the
+ * current lists, and only the moves after those are kept in the
+ * entry, in reverse order. The moves of the current lists are moved
+ * into an entry's tails just before they are overwritten, so saving
+ * costs the same no matter how long the game has been, and the map is
+ * recreated when restoring by undoing and redoing moves.
  */
 typedef	struct gamestack gamestack;
 struct gamestack {
     gamestack  *next;		/* pointer to the next entry */
-    gamestate	state;		/* the saved state */
+    int		shared[2];	/* moves shared with the undo and redo lists */
+    actlist	tail[2];	/* the rest of the saved lists, reversed */
+    short	ycurrpos;	/* the saved cursor position */
+    short	xcurrpos;
+    short	currblock;	/* the saved current block */
 };
 
-/* Arrays for translating a direction into deltas.
+/* The indexes of the two lists in a gamestack entry.
+ */
+#define	UNDOLIST	0
+#define	REDOLIST	1
+
+/* Arrays for translating a direction into deltas. The map deltas
+ * depend on the width of the current puzzle, and are set by
+ * selectgame().
  */
-static int const dirdelta[] = { -XSIZE, +1, +XSIZE, -1 };
+static int dirdelta[4];
 static int const dirydelta[] = { -1, 0, +1, 0 };
 static int const dirxdelta[] = { 0, +1, 0, -1 };
 
+/* The letters of the keys that move a block in each direction.
+ */
+static char const dirletters[] = "KLJH";
+
 /* The stack of saved states.
  */
 static gamestack       *stack = NULL;
 
+/* No entry on the stack shares more than this many moves of the
+ * current undo and redo lists.
+ */
+static int		pinned[2] = { 0, 0 };
+
+/* The checkpoints along the current line of play, the number of them
+ * that are valid, and the number that have been allocated.
+ */
+static checkpoint      *checkpoints = NULL;
+static int		checkpointcount = 0;
+static int		checkpointsallocated = 0;
+
+/* The positions along the current line of play, indexed by the
+ * number of moves made, the number of them that are valid, and the
+ * number that have been allocated.
+ */
+static linepos	       *positions = NULL;
+static int		positioncount = 0;
+static int		positionsallocated = 0;
+
+/* A hash table of indexes into positions, its size (always a power of
+ * two), and the number of slots that are not empty (-1). Entries are
+ * never removed: the ones that no longer match their position are
+ * ignored, and dropped when the table is rebuilt.
+ */
+static int	       *postable = NULL;
+static int		postablesize = 0;
+static int		postableused = 0;
+
+/* TRUE if loops are cut out of the undo list as they are made.
+ */
+static int		cutloops = FALSE;
+
 /* The current state of the current game.
  */
 static gamestate	state;
 
-/* Make a copy of from that shares no memory with to.
+/* Give the saved states their own copies of the moves in the current
+ * undo list (which is UNDOLIST) or redo list (REDOLIST) from index n
+ * on. This must be called before the list is changed at index n.
  */
-static void copygamestate(gamestate *to, gamestate const *from)
+static void unsharemoves(int which, int n)
 {
-    *to = *from;
-    copymovelist(&to->undo, &from->undo);
-    copymovelist(&to->redo, &from->redo);
+    actlist const      *list;
+    gamestack	       *s;
+    int			i;
+
+    if (n >= pinned[which])
+	return;
+    list = which == UNDOLIST ? &state.undo : &state.redo;
+    for (s = stack ; s ; s = s->next) {
+	for (i = s->shared[which] - 1 ; i >= n ; --i)
+	    addtomovelist(&s->tail[which], list->list[i]);
+	if (s->shared[which] > n)
+	    s->shared[which] = n;
+    }
+    pinned[which] = n;
 }
 
-/* Free allocated memory associated with s.
+/* Scramble the low 32 bits of n.
  */
-static void freegamestate(gamestate *s)
+static unsigned long mixbits(unsigned long n)
 {
-    destroymovelist(&s->undo);
-    destroymovelist(&s->redo);
+    n &= 0xFFFFFFFFUL;
+    n ^= n >> 16;
+    n = (n * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    n ^= n >> 13;
+    n = (n * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+    return n ^ (n >> 16);
 }
 
-/* Initialize the current state to the starting position of the
- * current puzzle, and reset the macro array and the stack.
+/* Return the hash value of block id at pos, or of an opened door at
+ * pos if id is zero. The hash of a position is the exclusive-or of
+ * the values of everything in it, and so can be updated a move at a
+ * time. All the bits of an unsigned long are used, up to 64.
  */
-void initgamestate(void)
+static unsigned long poskey(int pos, int id)
 {
-    memcpy(state.map, state.game->map, sizeof state.map);
-    state.currblock = state.game->equivs[KEYID] ? KEYID : FIRSTID;
-    state.ycurrpos = state.xcurrpos = 0;
-    initmovelist(&state.undo);
-    copymovelist(&state.redo, &state.game->answer);
-    state.movecount = 0;
-    state.stepcount = 0;
+    unsigned long	n;
+
+    n = (unsigned long)pos * (LASTID + 1) + id;
+    return mixbits(n + 0x9E3779B9UL) | mixbits(n + 0x7F4A7C15UL) << 16 << 16;
 }
 
-/* Set the current puzzle to be game, with the given level number.
+/* Put entry n of positions into the hash table, which must have room
+ * for it. A slot holding an entry that is no longer valid is reused.
  */
-void selectgame(gamesetup *game, int level)
+static void placeposition(int n)
 {
-    state.game = game;
-    state.level = level;
+    int	mask, i, k;
+
+    mask = postablesize - 1;
+    for (i = positions[n].hash & mask ; ; i = (i + 1) & mask) {
+	k = postable[i];
+	if (k < 0) {
+	    ++postableused;
+	    break;
+	}
+	if (k >= positioncount || k == n)
+	    break;
+    }
+    postable[i] = n;
 }
 
-/*
- * Movement support functions
+/* Rebuild the hash table from the valid positions, making it big
+ * enough that it can take as many again before it is half full.
  */
+static void rebuildpostable(void)
+{
+    int	n;
+
+    if (postablesize < 4 * positioncount) {
+	n = postablesize ? postablesize : 256;
+	while (n < 4 * positioncount)
+	    n *= 2;
+	free(postable);
+	if (!(postable = malloc(n * sizeof *postable)))
+	    memerrexit();
+	postablesize = n;
+    }
+    memset(postable, -1, postablesize * sizeof *postable);
+    postableused = 0;
+    for (n = 0 ; n < positioncount ; ++n)
+	placeposition(n);
+}
 
-/* Take a vector from (x0, y0) to (x, y) and return the two orthogonal
- * directions it decomposes into, with the larger one given first.
+/* Record the current position along the line of play, if it has not
+ * been already, and make it the next checkpoint if that is due.
  */
-static void raydirections(int y0, int x0, int y, int x, int *dir1, int *dir2)
+static void markposition(void)
 {
-    int	dy, dx;
-    int	ydir, xdir;
+    checkpoint *cp;
+    int		n;
 
-    dy = y - y0;
-    dx = x - x0;
-    if (dy > 0) {
-	if (dx > 0) {
-	    ydir = SOUTH;
-	    xdir = EAST;
-	} else if (dx < 0) {
-	    ydir = SOUTH;
-	    xdir = WEST;
-	    dx = -dx;
-	} else {
-	    *dir1 = SOUTH;
-	    *dir2 = -1;
-	    return;
-	}
-    } else if (dy < 0) {
-	if (dx > 0) {
-	    ydir = NORTH;
-	    xdir = EAST;
-	} else if (dx < 0) {
-	    ydir = NORTH;
-	    xdir = WEST;
-	    dx = -dx;
-	} else {
-	    *dir1 = NORTH;
-	    *dir2 = -1;
-	    return;
+    if (state.undo.count == positioncount) {
+	if (positioncount == positionsallocated) {
+	    n = positionsallocated ? positionsallocated * 2 : 256;
+	    if (!(positions = realloc(positions, n * sizeof *positions)))
+		memerrexit();
+	    positionsallocated = n;
 	}
-	dy = -dy;
-    } else {
-	if (dx > 0)
-	    *dir1 = EAST;
-	else if (dx < 0)
-	    *dir1 = WEST;
+	positions[positioncount].hash = state.hash;
+	positions[positioncount].stepcount = state.stepcount;
+	++positioncount;
+	if (2 * (postableused + 1) > postablesize)
+	    rebuildpostable();
 	else
-	    *dir1 = -1;
-	*dir2 = -1;
-	return;
+	    placeposition(positioncount - 1);
     }
 
-    if (dy > dx) {
-	*dir1 = ydir;
-	*dir2 = xdir;
-    } else {
-	*dir1 = xdir;
-	*dir2 = ydir;
+    if (state.undo.count != checkpointcount * CHECKPOINTINTERVAL)
+	return;
+    n = state.game->ysize * state.game->xsize;
+    if (checkpointcount == checkpointsallocated) {
+	checkpoints = realloc(checkpoints,
+			      (checkpointsallocated + 1) * sizeof *checkpoints);
+	if (!checkpoints)
+	    memerrexit();
+	cp = checkpoints + checkpointsallocated;
+	if (!(cp->map = malloc(n * sizeof *cp->map)))
+	    memerrexit();
+	cp->doorlog = NULL;
+	if (state.game->doorcount) {
+	    cp->doorlog = malloc(state.game->doorcount * sizeof *cp->doorlog);
+	    if (!cp->doorlog)
+		memerrexit();
+	}
+	++checkpointsallocated;
     }
+    cp = checkpoints + checkpointcount;
+    memcpy(cp->map, state.map, n * sizeof *cp->map);
+    if (state.opencount)
+	memcpy(cp->doorlog, state.doorlog,
+	       state.opencount * sizeof *cp->doorlog);
+    cp->opencount = state.opencount;
+    cp->stepcount = state.stepcount;
+    cp->hash = state.hash;
+    ++checkpointcount;
 }
 
-/* Fill in an action structure, using the current location of block id
- * to fill in the x-y fields.
+/* Forget the checkpoints and positions that lie beyond the first n
+ * moves of the line of play, because those moves are about to change.
  */
-static action makeaction(int id, int dir)
+static void truncateline(int n)
 {
-    cell const *map;
-    action	move;
-    int 	y, x;
+    if (checkpointcount > n / CHECKPOINTINTERVAL + 1)
+	checkpointcount = n / CHECKPOINTINTERVAL + 1;
+    if (positioncount > n + 1)
+	positioncount = n + 1;
+}
 
-    move.id = id;
-    move.dir = dir;
-    move.door = FALSE;
-    map = state.map;
-    for (y = 1, map += XSIZE ; y < state.game->ysize - 1 ; ++y, map += XSIZE) {
-	for (x = 1 ; x < state.game->xsize - 1 ; ++x) {
-	    if (blockid(map[x]) == id) {
-		move.y = y;
-		move.x = x;
-		return move;
-	    }
-	}
+/* Initialize the current state to the starting position of the
+ * current puzzle, and reset the macro array and the stack.
+ */
+void initgamestate(void)
+{
+    int	n, i;
+
+    n = state.game->ysize * state.game->xsize;
+    free(state.map);
+    if (!(state.map = malloc(n * sizeof *state.map)))
+	memerrexit();
+    memcpy(state.map, state.game->map, n * sizeof *state.map);
+    state.hash = 0;
+    for (i = 0 ; i < n ; ++i)
+	if (blockid(state.map[i]))
+	    state.hash ^= poskey(i, blockid(state.map[i]));
+    state.currblock = state.game->equivs[KEYID] ? KEYID : FIRSTID;
+    state.ycurrpos = state.xcurrpos = 0;
+    for (i = 0 ; i < checkpointsallocated ; ++i) {
+	free(checkpoints[i].map);
+	free(checkpoints[i].doorlog);
     }
-    return move;
+    checkpointsallocated = 0;
+    checkpointcount = 0;
+    positioncount = 0;
+    if (postablesize)
+	rebuildpostable();
+    initmovelist(&state.undo);
+    unsharemoves(REDOLIST, 0);
+    copymovelist(&state.redo, &state.game->answer);
+    state.movecount = 0;
+    state.stepcount = 0;
+    free(state.doorlog);
+    state.doorlog = NULL;
+    if (state.game->doorcount) {
+	state.doorlog = malloc(state.game->doorcount * sizeof *state.doorlog);
+	if (!state.doorlog)
+	    memerrexit();
+    }
+    state.opencount = 0;
+    markposition();
+    addtojournal("R");
+}
+
+/* Turn the cutting of loops on or off.
+ */
+void setloopcutting(int flag)
+{
+    cutloops = flag;
 }
 
+/* Set the current puzzle to be game, with the given level number.
+ */
+void selectgame(gamesetup *game, int level)
+{
+    state.game = game;
+    state.level = level;
+    dirdelta[NORTH] = -game->xsize;
+    dirdelta[EAST] = +1;
+    dirdelta[SOUTH] = +game->xsize;
+    dirdelta[WEST] = -1;
+}
+
+/*
+ * Movement support functions
+ */
+
 /* Given block id, return the first block that lies next to it in the
  * direction defined by qmin, qmax, qinc, and qmul. pmin, pmax, pinc,
  * and pmul define the perpendicular direction, which is scanned first
@@ -213,66 +386,190 @@ static int canmove(int id, int dir)
     int		d = dirdelta[dir];
     int		dy = dirydelta[dir];
     int		dx = dirxdelta[dir];
-    int		y, x, n;
+    int		y, x, w, n;
 
     map = state.map;
-    for (y = 1, map += XSIZE ; y < state.game->ysize - 1 ; ++y, map += XSIZE) {
-	for (x = 1 ; x < state.game->xsize - 1 ; ++x) {
+    w = state.game->xsize;
+    for (y = 1, map += w ; y < state.game->ysize - 1 ; ++y, map += w) {
+	for (x = 1 ; x < w - 1 ; ++x) {
 	    if (blockid(map[x]) != id)
 		continue;
 	    if (y + dy < 1 || x + dx < 1 || y + dy >= state.game->ysize - 1
-					 || x + dx >= state.game->xsize - 1)
+					 || x + dx >= w - 1)
 		return FALSE;
 	    n = blockid(map[x + d]);
 	    if (n && n != id)
 		return FALSE;
-	    if (doortime(map[x + d]) > state.movecount && id != KEYID)
+	    if (isdoorclosed(map[x + d]) && id != KEYID)
 		return FALSE;
 	}
     }
     return TRUE;
 }
 
-/* Change the map by moving block id in direction dir.
+/* Find the shortest series of moves of block id that brings the
+ * block's cell currently at grab to (ydest, xdest), or, if grab is
+ * negative, that brings any part of the block onto (ydest, xdest).
+ * The block's possible locations are searched breadth-first with
+ * every other block held in place. If a grabbed cell cannot reach its
+ * destination, the route leads to the location closest to it instead.
+ * The moves are stored in route, and the number of moves is returned.
  */
-static int moveblock(int id, int dir)
+static int findroute(int id, int grab, int ydest, int xdest, char *route)
+{
+    static signed char *from = NULL;
+    static int	       *queue = NULL;
+    static int	       *cells = NULL;
+    static int		size = 0;
+    cell const *map;
+    int		cellcount, start, best, bestdist;
+    int		head, tail, pos, dir, dist;
+    int		y, x, w, n, i, k;
+
+    w = state.game->xsize;
+    n = state.game->ysize * w;
+    if (n > size) {
+	free(from);
+	free(queue);
+	free(cells);
+	if (!(from = malloc(n * sizeof *from))
+			|| !(queue = malloc(n * sizeof *queue))
+			|| !(cells = malloc(n * sizeof *cells)))
+	    memerrexit();
+	size = n;
+    }
+
+    map = state.map;
+    cellcount = 0;
+    start = -1;
+    for (y = 1 ; y < state.game->ysize - 1 ; ++y) {
+	for (x = 1 ; x < w - 1 ; ++x) {
+	    n = y * w + x;
+	    if (blockid(map[n]) != id)
+		continue;
+	    if (start < 0)
+		start = n;
+	    cells[cellcount++] = n - start;
+	}
+    }
+    if (start < 0)
+	return 0;
+
+    memset(from, -1, state.game->ysize * w * sizeof *from);
+    from[start] = NORTH;
+    queue[0] = start;
+    best = -1;
+    bestdist = MAXHEIGHT + MAXWIDTH;
+    for (head = 0, tail = 1 ; head < tail ; ++head) {
+	pos = queue[head];
+	if (grab < 0) {
+	    n = ydest * w + xdest;
+	    for (i = 0 ; i < cellcount && pos + cells[i] != n ; ++i) ;
+	    dist = i < cellcount ? 0 : 1;
+	} else {
+	    n = pos + grab - start;
+	    dist = abs(n / w - ydest) + abs(n % w - xdest);
+	}
+	if (dist < bestdist) {
+	    best = pos;
+	    bestdist = dist;
+	    if (!dist)
+		break;
+	}
+	for (dir = NORTH ; dir <= WEST ; ++dir) {
+	    n = pos + dirdelta[dir];
+	    if (from[n] >= 0)
+		continue;
+	    for (i = 0 ; i < cellcount ; ++i) {
+		y = (n + cells[i]) / w;
+		x = (n + cells[i]) % w;
+		if (y < 1 || x < 1 || y >= state.game->ysize - 1
+				   || x >= w - 1)
+		    break;
+		k = blockid(map[n + cells[i]]);
+		if (k && k != id)
+		    break;
+		if (isdoorclosed(map[n + cells[i]]) && id != KEYID)
+		    break;
+	    }
+	    if (i < cellcount)
+		continue;
+	    from[n] = dir;
+	    queue[tail++] = n;
+	}
+    }
+
+    if (grab < 0 && bestdist)
+	return 0;
+    for (n = 0, pos = best ; pos != start ; pos -= dirdelta[(int)from[pos]])
+	++n;
+    for (i = n, pos = best ; pos != start ; pos -= dirdelta[(int)from[pos]])
+	route[--i] = from[pos];
+    return n;
+}
+
+/* Open the door at pos, recording in the door log that it was opened
+ * by the move about to be made.
+ */
+static void opendoor(int pos)
+{
+    state.map[pos] &= ~DOORCLOSED;
+    state.hash ^= poskey(pos, 0);
+    state.doorlog[state.opencount].move = state.movecount + 1;
+    state.doorlog[state.opencount].pos = pos;
+    ++state.opencount;
+}
+
+/* Change cells, a map of the current puzzle, by moving block id in
+ * direction dir. The hash and the door log are only kept up to date
+ * when cells is the current state's map; on any other map, a door
+ * that the key moves onto is simply opened.
+ */
+static int moveblock(cell *cells, int id, int dir)
 {
     cell       *map;
     int		d = dirdelta[dir];
-    int 	y, x, r;
+    int 	y, x, w, n, r;
 
     r = FALSE;
+    w = state.game->xsize;
     if (d < 0) {
-	map = state.map + XSIZE;
-	for (y = 1 ; y < state.game->ysize ; ++y, map += XSIZE) {
-	    for (x = 1 ; x < state.game->xsize ; ++x) {
+	map = cells + w;
+	for (y = 1 ; y < state.game->ysize ; ++y, map += w) {
+	    for (x = 1 ; x < w ; ++x) {
 		if (blockid(map[x]) != id)
 		    continue;
 		map[x + d] |= map[x] & BLOCK_MASK;
 		map[x] &= ~BLOCK_MASK;
-		if (id == KEYID) {
-		    if (doortime(map[x + d]) > state.movecount + 1) {
-			map[x + d] = stampdoor(map[x + d],
-					       state.movecount + 1);
-			r = TRUE;
-		    }
+		n = map + x - cells;
+		if (cells == state.map)
+		    state.hash ^= poskey(n, id) ^ poskey(n + d, id);
+		if (id == KEYID && isdoorclosed(map[x + d])) {
+		    if (cells == state.map)
+			opendoor(n + d);
+		    else
+			map[x + d] &= ~DOORCLOSED;
+		    r = TRUE;
 		}
 	    }
 	}
     } else {
-	map = state.map + (state.game->ysize - 1) * XSIZE;
-	for (y = state.game->ysize - 1 ; y > 0 ; --y, map -= XSIZE) {
-	    for (x = state.game->xsize - 1 ; x > 0 ; --x) {
+	map = cells + (state.game->ysize - 1) * w;
+	for (y = state.game->ysize - 1 ; y > 0 ; --y, map -= w) {
+	    for (x = w - 1 ; x > 0 ; --x) {
 		if (blockid(map[x]) != id)
 		    continue;
 		map[x + d] |= map[x] & BLOCK_MASK;
 		map[x] &= ~BLOCK_MASK;
-		if (id == KEYID) {
-		    if (doortime(map[x + d]) > state.movecount + 1) {
-			map[x + d] = stampdoor(map[x + d],
-					       state.movecount + 1);
-			r = TRUE;
-		    }
+		n = map + x - cells;
+		if (cells == state.map)
+		    state.hash ^= poskey(n, id) ^ poskey(n + d, id);
+		if (id == KEYID && isdoorclosed(map[x + d])) {
+		    if (cells == state.map)
+			opendoor(n + d);
+		    else
+			map[x + d] &= ~DOORCLOSED;
+		    r = TRUE;
 		}
 	    }
 	}
@@ -280,32 +577,211 @@ static int moveblock(int id, int dir)
     return r;
 }
 
+/* Return TRUE if the position after the first n moves of the undo
+ * list, whose hash is the same as the current position's, is in fact
+ * the same position. It is rebuilt from the checkpoint before it, so
+ * that a collision of the hashes cannot pass for a loop.
+ */
+static int isrepeat(int n)
+{
+    cell       *map;
+    int		size, same, i;
+
+    size = state.game->ysize * state.game->xsize;
+    if (!(map = malloc(size * sizeof *map)))
+	memerrexit();
+    memcpy(map, checkpoints[n / CHECKPOINTINTERVAL].map, size * sizeof *map);
+    for (i = n - n % CHECKPOINTINTERVAL ; i < n ; ++i)
+	moveblock(map, actionid(state.undo.list[i]),
+		       actiondir(state.undo.list[i]));
+    same = TRUE;
+    for (i = 0 ; same && i < size ; ++i)
+	if ((map[i] ^ state.map[i]) & (BLOCK_MASK | DOORCLOSED))
+	    same = FALSE;
+    free(map);
+    return same;
+}
+
+/* Return the index of the earliest position in the undo list that is
+ * the same as the current one, or -1 if there is none.
+ */
+static int findrepeat(void)
+{
+    int	mask, found, i, k;
+
+    found = -1;
+    if (!postablesize)
+	return found;
+    mask = postablesize - 1;
+    for (i = state.hash & mask ; (k = postable[i]) >= 0 ; i = (i + 1) & mask)
+	if (k < state.undo.count && k < positioncount
+				 && positions[k].hash == state.hash
+				 && (found < 0 || k < found) && isrepeat(k))
+	    found = k;
+    return found;
+}
+
+/* Move the block named by move, counting it as the move following
+ * those on the undo list. The move is returned with its door bit set
+ * if it opened a door.
+ */
+static action applymove(action move)
+{
+    int	id, dir;
+
+    id = actionid(move);
+    dir = actiondir(move);
+    move = mkaction(id, dir, moveblock(state.map, id, dir));
+    ++state.movecount;
+    if (!state.undo.count ||
+		id != actionid(state.undo.list[state.undo.count - 1]))
+	++state.stepcount;
+    return move;
+}
+
 /* Apply a legal move to the current state, adding it to the undo list.
  */
 static void domove(action move)
 {
-    move.door = moveblock(move.id, move.dir);
-    state.currblock = move.id;
+    char	event[16];
+
+    move = applymove(move);
+    state.currblock = actionid(move);
     state.ycurrpos = state.xcurrpos = 0;
-    ++state.movecount;
+    unsharemoves(UNDOLIST, state.undo.count);
+    addtomovelist(&state.undo, move);
+    markposition();
+    sprintf(event, "%d%c", actionid(move), dirletters[actiondir(move)]);
+    addtojournal(event);
+}
+
+/* Cut the moves after the first n off the undo list, the position
+ * after n moves being the same as the current one. (No door can have
+ * been opened by the moves cut, as it would still be open.)
+ */
+static void cutloop(int n)
+{
+    state.undo.count = n;
+    state.movecount = n;
+    state.stepcount = positions[n].stepcount;
+    truncateline(n);
+    addtojournal("c");
+}
+
+/* Close the doors that were opened after the current move, taking
+ * them back off the end of the door log.
+ */
+static void closedoors(void)
+{
+    while (state.opencount
+		&& state.doorlog[state.opencount - 1].move > state.movecount) {
+	--state.opencount;
+	state.map[state.doorlog[state.opencount].pos] |= DOORCLOSED;
+	state.hash ^= poskey(state.doorlog[state.opencount].pos, 0);
+    }
+}
+
+/* Reverse what applymove() did for the same move, which has just been
+ * taken off the undo list.
+ */
+static void unapplymove(action move)
+{
+    int	id;
+
+    id = actionid(move);
+    moveblock(state.map, id, backwards(actiondir(move)));
+    --state.movecount;
     if (!state.undo.count ||
-		move.id != state.undo.list[state.undo.count - 1].id)
-	++state.stepcount;
+		id != actionid(state.undo.list[state.undo.count - 1]))
+	--state.stepcount;
+    if (actiondoor(move))
+	closedoors();
+}
+
+/* Redo the next move of the line of play without any of domove()'s
+ * bookkeeping.
+ */
+static void stepforward(void)
+{
+    action	move;
+
+    move = applymove(state.redo.list[--state.redo.count]);
+    unsharemoves(UNDOLIST, state.undo.count);
     addtomovelist(&state.undo, move);
+    markposition();
 }
 
-/* Reset the timestamps on all door cells not currently open.
+/* Undo the last move without any of undomove()'s bookkeeping.
  */
-static void resetdoors(void)
+static void stepback(void)
 {
-    cell       *map;
-    int		y, x;
+    action	move;
 
-    map = state.map;
-    for (y = 1, map += XSIZE ; y < state.game->ysize - 1 ; ++y, map += XSIZE)
-	for (x = 1 ; x < state.game->xsize - 1 ; ++x)
-	    if (doortime(map[x]) > state.movecount)
-		map[x] |= DOORSTAMP_MASK;
+    move = state.undo.list[--state.undo.count];
+    unsharemoves(REDOLIST, state.redo.count);
+    addtomovelist(&state.redo, move);
+    unapplymove(move);
+}
+
+/* Go to the position after the first n moves of the line of play. If
+ * the nearest checkpoint before it is closer than the current
+ * position, the checkpoint is copied in and the moves in between are
+ * moved across the lists unapplied, so that no more than
+ * CHECKPOINTINTERVAL moves are ever applied. The block of the last
+ * move undone or redone becomes the current block. FALSE is returned
+ * if the position is the current one.
+ */
+static int seekmove(int n)
+{
+    char	event[16];
+    checkpoint *cp;
+    int		c, pos, from;
+
+    if (n < 0)
+	n = 0;
+    else if (n > state.undo.count + state.redo.count)
+	n = state.undo.count + state.redo.count;
+    if (n == state.undo.count)
+	return FALSE;
+
+    from = state.undo.count;
+    c = n / CHECKPOINTINTERVAL;
+    if (c >= checkpointcount)
+	c = checkpointcount - 1;
+    pos = c * CHECKPOINTINTERVAL;
+    if (n - pos < abs(n - state.undo.count)) {
+	while (state.undo.count > pos) {
+	    unsharemoves(REDOLIST, state.redo.count);
+	    addtomovelist(&state.redo, state.undo.list[--state.undo.count]);
+	}
+	while (state.undo.count < pos) {
+	    unsharemoves(UNDOLIST, state.undo.count);
+	    addtomovelist(&state.undo, state.redo.list[--state.redo.count]);
+	}
+	cp = checkpoints + c;
+	memcpy(state.map, cp->map,
+	       state.game->ysize * state.game->xsize * sizeof *state.map);
+	if (cp->opencount)
+	    memcpy(state.doorlog, cp->doorlog,
+		   cp->opencount * sizeof *state.doorlog);
+	state.opencount = cp->opencount;
+	state.stepcount = cp->stepcount;
+	state.hash = cp->hash;
+	state.movecount = pos;
+    }
+    while (state.undo.count < n)
+	stepforward();
+    while (state.undo.count > n)
+	stepback();
+    if (n > from)
+	state.currblock = actionid(state.undo.list[n - 1]);
+    else
+	state.currblock = actionid(state.redo.list[state.redo.count - 1]);
+    state.ycurrpos = state.xcurrpos = 0;
+
+    sprintf(event, "g%d;", n);
+    addtojournal(event);
+    return TRUE;
 }
 
 /*
@@ -315,15 +791,16 @@ static void resetdoors(void)
 int movecursor(int dir)
 {
     cell const *map;
-    int		ypos = 0, xpos = 0, y, x;
+    int		ypos = 0, xpos = 0, y, x, w;
 
     if (state.ycurrpos) {
 	ypos = state.ycurrpos;
 	xpos = state.xcurrpos;
     } else if (state.currblock) {
-	map = state.map + XSIZE;
-	for (y = 1 ; !ypos && y < state.game->ysize - 1 ; ++y, map += XSIZE) {
-	    for (x = 1 ; !xpos && x < state.game->xsize - 1 ; ++x) {
+	w = state.game->xsize;
+	map = state.map + w;
+	for (y = 1 ; !ypos && y < state.game->ysize - 1 ; ++y, map += w) {
+	    for (x = 1 ; !xpos && x < w - 1 ; ++x) {
 		if (blockid(map[x]) == state.currblock) {
 		    ypos = y;
 		    xpos = x;
@@ -340,7 +817,7 @@ int movecursor(int dir)
 			     || xpos >= state.game->xsize - 1)
 	return FALSE;
 
-    state.currblock = blockid(state.map[ypos * XSIZE + xpos]);
+    state.currblock = blockid(state.map[ypos * state.game->xsize + xpos]);
     state.ycurrpos = ypos;
     state.xcurrpos = xpos;
     return TRUE;
@@ -357,16 +834,12 @@ int undomove(void)
 	return FALSE;
 
     move = state.undo.list[--state.undo.count];
+    unsharemoves(REDOLIST, state.redo.count);
     addtomovelist(&state.redo, move);
-    moveblock(move.id, backwards(move.dir));
-    state.currblock = move.id;
+    unapplymove(move);
+    state.currblock = actionid(move);
     state.ycurrpos = state.xcurrpos = 0;
-    --state.movecount;
-    if (!state.undo.count ||
-		move.id != state.undo.list[state.undo.count - 1].id)
-	--state.stepcount;
-    if (move.door)
-	resetdoors();
+    addtojournal("x");
 
     return TRUE;
 }
@@ -390,8 +863,8 @@ int undostep(void)
     if (!state.undo.count)
 	return FALSE;
     n = state.undo.count;
-    id = state.undo.list[n - 1].id;
-    for ( ; n > 0 && state.undo.list[n - 1].id == id ; --n) ;
+    id = actionid(state.undo.list[n - 1]);
+    for ( ; n > 0 && actionid(state.undo.list[n - 1]) == id ; --n) ;
     return undomoves(state.undo.count - n);
 }
 
@@ -424,35 +897,49 @@ int redostep(void)
     if (!state.redo.count)
 	return FALSE;
     n = state.redo.count;
-    id = state.redo.list[n - 1].id;
-    for ( ; n > 0 && state.redo.list[n - 1].id == id ; --n) ;
+    id = actionid(state.redo.list[n - 1]);
+    for ( ; n > 0 && actionid(state.redo.list[n - 1]) == id ; --n) ;
     return redomoves(state.redo.count - n);
 }
 
+/* Move n tenths of the way along the line of play.
+ */
+int seektenths(int n)
+{
+    int	len;
+
+    len = state.undo.count + state.redo.count;
+    return seekmove(state.undo.count + n * ((len + 9) / 10));
+}
+
 /* Check a move for validity in the current state. If it is valid, it
  * is applied via domove(), otherwise return FALSE. If the move is
  * equivalent to an undo or a redo, then use that instead; otherwise,
- * the redo list is reset.
+ * the redo list is reset, and if the move returns to a position
+ * already in the undo list, the loop may be cut out.
  */
 int newmove(int dir)
 {
     action	move;
+    int		n;
 
     if (!state.currblock || !canmove(state.currblock, dir))
 	return FALSE;
     if (state.undo.count) {
 	move = state.undo.list[state.undo.count - 1];
-	if (move.id == state.currblock && move.dir == backwards(dir)
-				       && !move.door)
+	if (move == mkaction(state.currblock, backwards(dir), FALSE))
 	    return undomove();
     }
     if (state.redo.count) {
 	move = state.redo.list[state.redo.count - 1];
-	if (move.id == state.currblock && move.dir == dir)
+	if (actionid(move) == state.currblock && actiondir(move) == dir)
 	    return redomove();
     }
-    domove(makeaction(state.currblock, dir));
+    truncateline(state.undo.count);
+    domove(mkaction(state.currblock, dir, FALSE));
     state.redo.count = 0;
+    if (cutloops && (n = findrepeat()) >= 0)
+	cutloop(n);
     return TRUE;
 }
 
@@ -461,25 +948,26 @@ int newmove(int dir)
 void rotatefromcurrblock(void)
 {
     cell const *map;
-    int		y, x;
+    int		y, x, w;
     int		id, n;
 
     if (!state.currblock)
 	return;
-    id = state.currblock + 256;
+    id = state.currblock + LASTID + 1;
     map = state.map;
-    for (y = 1, map += XSIZE ; y < state.game->ysize - 1 ; ++y, map += XSIZE) {
-	for (x = 1 ; x < state.game->xsize - 1 ; ++x) {
+    w = state.game->xsize;
+    for (y = 1, map += w ; y < state.game->ysize - 1 ; ++y, map += w) {
+	for (x = 1 ; x < w - 1 ; ++x) {
 	    n = blockid(map[x]);
 	    if (n && n != WALLID && n != state.currblock) {
 		if (n < state.currblock)
-		    n += 256;
+		    n += LASTID + 1;
 		if (n < id)
 		    id = n;
 	    }
 	}
     }
-    state.currblock = id % 256;
+    state.currblock = id % (LASTID + 1);
     state.ycurrpos = state.xcurrpos = 0;
 }
 
@@ -488,26 +976,24 @@ void rotatefromcurrblock(void)
  */
 int shiftfromcurrblock(int dir)
 {
-    int	id;
+    int	id, w, h;
 
     if (!state.currblock)
 	return FALSE;
 
+    w = state.game->xsize;
+    h = state.game->ysize;
     if (dir == NORTH)
-	id = shiftfromblock(state.game->xsize - 1, -1, -1, 1,
-			    state.game->ysize - 1, -1, -1, XSIZE,
+	id = shiftfromblock(w - 1, -1, -1, 1, h - 1, -1, -1, w,
 			    state.currblock);
     else if (dir == EAST)
-	id = shiftfromblock(0, state.game->ysize, +1, XSIZE,
-			    0, state.game->xsize, +1, 1,
+	id = shiftfromblock(0, h, +1, w, 0, w, +1, 1,
 			    state.currblock);
     else if (dir == SOUTH)
-	id = shiftfromblock(0, state.game->xsize, +1, 1,
-			    0, state.game->ysize, +1, XSIZE,
+	id = shiftfromblock(0, w, +1, 1, 0, h, +1, w,
 			    state.currblock);
     else if (dir == WEST)
-	id = shiftfromblock(state.game->ysize - 1, -1, -1, XSIZE,
-			    state.game->xsize - 1, -1, -1, 1,
+	id = shiftfromblock(h - 1, -1, -1, w, w - 1, -1, -1, 1,
 			    state.currblock);
     else
 	id = -1;
@@ -519,11 +1005,38 @@ int shiftfromcurrblock(int dir)
     return TRUE;
 }
 
+/* Ask for the best next step from the current position to be found
+ * in the background.
+ */
+void searchforhint(void)
+{
+    requesthint(state.map);
+}
+
+/* Select the block that begins a shortest solution from the current
+ * position, and place the cursor on the cell it moves into first.
+ */
+int showhint(void)
+{
+    int	pos, dir, id;
+
+    if (!gethint(state.map, &pos, &dir))
+	return FALSE;
+    id = blockid(state.map[pos]);
+    while (blockid(state.map[pos]) == id)
+	pos += dirdelta[dir];
+    state.currblock = id;
+    state.ycurrpos = pos / state.game->xsize;
+    state.xcurrpos = pos % state.game->xsize;
+    return TRUE;
+}
+
 /*
  * State-saving functions
  */
 
-/* Save the current state of the game on a stack.
+/* Save the current state of the game on a stack. Nothing is copied
+ * until the current lists are changed.
  */
 void savestate(void)
 {
@@ -531,24 +1044,68 @@ void savestate(void)
 
     if (!(save = malloc(sizeof *save)))
 	memerrexit();
-    copygamestate(&save->state, &state);
+    memset(save, 0, sizeof *save);
+    initmovelist(&save->tail[UNDOLIST]);
+    initmovelist(&save->tail[REDOLIST]);
+    save->shared[UNDOLIST] = state.undo.count;
+    save->shared[REDOLIST] = state.redo.count;
+    if (pinned[UNDOLIST] < state.undo.count)
+	pinned[UNDOLIST] = state.undo.count;
+    if (pinned[REDOLIST] < state.redo.count)
+	pinned[REDOLIST] = state.redo.count;
+    save->ycurrpos = state.ycurrpos;
+    save->xcurrpos = state.xcurrpos;
+    save->currblock = state.currblock;
     save->next = stack;
     stack = save;
+    addtojournal("s");
 }
 
-/* Replace the current state with the last saved state.
+/* Replace the current state with the last saved state. The moves of
+ * the current undo list beyond those the saved one shares are undone,
+ * and then the rest of the saved moves are applied.
  */
 int restorestate(void)
 {
     gamestack  *next;
+    actlist    *tail;
+    action	move;
 
     if (!stack)
 	return FALSE;
-    freegamestate(&state);
-    state = stack->state;
+
+    truncateline(state.undo.count < stack->shared[UNDOLIST]
+			? state.undo.count : stack->shared[UNDOLIST]);
+    while (state.undo.count > stack->shared[UNDOLIST])
+	unapplymove(state.undo.list[--state.undo.count]);
+    while (state.undo.count < stack->shared[UNDOLIST]) {
+	applymove(state.undo.list[state.undo.count]);
+	++state.undo.count;
+	markposition();
+    }
+    tail = &stack->tail[UNDOLIST];
+    while (tail->count) {
+	move = applymove(tail->list[--tail->count]);
+	unsharemoves(UNDOLIST, state.undo.count);
+	addtomovelist(&state.undo, move);
+	markposition();
+    }
+
+    unsharemoves(REDOLIST, stack->shared[REDOLIST]);
+    state.redo.count = stack->shared[REDOLIST];
+    tail = &stack->tail[REDOLIST];
+    while (tail->count)
+	addtomovelist(&state.redo, tail->list[--tail->count]);
+
+    state.ycurrpos = stack->ycurrpos;
+    state.xcurrpos = stack->xcurrpos;
+    state.currblock = stack->currblock;
+    destroymovelist(&stack->tail[UNDOLIST]);
+    destroymovelist(&stack->tail[REDOLIST]);
     next = stack->next;
     free(stack);
     stack = next;
+    addtojournal("r");
     return TRUE;
 }
 
@@ -559,11 +1116,90 @@ void freesavedstates(void)
     gamestack  *next;
 
     while (stack) {
-	freegamestate(&stack->state);
+	destroymovelist(&stack->tail[UNDOLIST]);
+	destroymovelist(&stack->tail[REDOLIST]);
 	next = stack->next;
 	free(stack);
 	stack = next;
     }
+    pinned[UNDOLIST] = 0;
+    pinned[REDOLIST] = 0;
+}
+
+/*
+ * Journal functions
+ */
+
+/* Reapply a move of block id in the direction given by letter, as
+ * read from the journal. The move must fit the current position, and
+ * it is treated as a redo if it matches the top of the redo list,
+ * exactly as newmove() would have.
+ */
+static int replaymove(int id, int letter)
+{
+    action	move;
+    char const *p;
+    int		dir;
+
+    if (!letter || !(p = strchr(dirletters, letter)))
+	return FALSE;
+    dir = p - dirletters;
+    if (id < KEYID || id > LASTID || !canmove(id, dir))
+	return FALSE;
+    if (state.redo.count) {
+	move = state.redo.list[state.redo.count - 1];
+	if (actionid(move) == id && actiondir(move) == dir)
+	    return redomove();
+    }
+    truncateline(state.undo.count);
+    domove(mkaction(id, dir, FALSE));
+    state.redo.count = 0;
+    return TRUE;
+}
+
+/* Bring the current puzzle to the position recorded in a journal. The
+ * events are the moves, each one a block's ID followed by the letter
+ * of the key that moves it, x for an undo, c for a loop cut out of
+ * the undo list, s and r for saving and restoring a position, g
+ * followed by a move number and a semicolon for a jump along the line
+ * of play, and R for a return to the starting position. The replayed
+ * events are added to the current journal in turn.
+ */
+int replayjournal(char const *events)
+{
+    int	id, n;
+
+    if (*events != 'R')
+	return FALSE;
+    while (*events) {
+	switch (*events) {
+	  case 'R':	initgamestate();			break;
+	  case 'x':	if (!undomove())	return TRUE;	break;
+	  case 'c':
+	    if ((n = findrepeat()) < 0)
+		return TRUE;
+	    cutloop(n);
+	    break;
+	  case 's':	savestate();				break;
+	  case 'r':	if (!restorestate())	return TRUE;	break;
+	  case 'g':
+	    n = 0;
+	    while (n < 10000000 && events[1] >= '0' && events[1] <= '9')
+		n = n * 10 + *++events - '0';
+	    if (*++events != ';' || !seekmove(n))
+		return TRUE;
+	    break;
+	  default:
+	    id = 0;
+	    for ( ; id <= LASTID && *events >= '0' && *events <= '9' ; ++events)
+		id = id * 10 + *events - '0';
+	    if (!replaymove(id, *events))
+		return TRUE;
+	    break;
+	}
+	++events;
+    }
+    return TRUE;
 }
 
 /*
@@ -577,21 +1213,21 @@ static void outputmapstate(void)
     static char	charids[32] = "ONBHUEZXDQ8MWKRGAVS523694PFTYCL7";
     cell const *map;
     int		spaces, id;
-    int		y, x;
+    int		y, x, w;
     char	obj;
 
     if (state.stepcount)
 	printf("== step %d\n", state.stepcount);
+    w = state.game->xsize;
     map = state.map;
-    for (y = 0 ; y < state.game->ysize ; ++y, map += XSIZE) {
+    for (y = 0 ; y < state.game->ysize ; ++y, map += w) {
 	spaces = 0;
-	for (x = 0 ; x < state.game->xsize ; ++x) {
+	for (x = 0 ; x < w ; ++x) {
 	    id = blockid(map[x]);
 	    if (id) {
 		obj = id == WALLID ? '#' : id == KEYID
 				   ? '0' : charids[(id - FIRSTID) % 32];
-	    } else if ((map[x] & DOORSTAMP_MASK) &&
-				doortime(map[x]) > state.movecount + 1) {
+	    } else if (isdoorclosed(map[x])) {
 		obj = '%';
 	    } else {
 		++spaces;
@@ -618,8 +1254,8 @@ int displaygamesolution(void)
     move = state.redo.list + state.redo.count;
     for (i = 0 ; i < state.redo.count ; ++i) {
 	--move;
-	if (move->id != lastid) {
-	    lastid = move->id;
+	if (actionid(*move) != lastid) {
+	    lastid = actionid(*move);
 	    outputmapstate();
 	}
 	domove(*move);
@@ -633,10 +1269,11 @@ int displaygamesolution(void)
 int checkfinished(void)
 {
     int	i, j, k;
-    int	y, x, n;
+    int	y, x, w, n;
 
-    for (y = 1, n = XSIZE ; y < state.game->ysize - 1 ; ++y, n += XSIZE) {
-	for (x = 1 ; x < state.game->xsize - 1 ; ++x) {
+    w = state.game->xsize;
+    for (y = 1, n = w ; y < state.game->ysize - 1 ; ++y, n += w) {
+	for (x = 1 ; x < w - 1 ; ++x) {
 	    if (!state.game->goal[n + x])
 		continue;
 	    i = blockid(state.game->goal[n + x]);
@@ -675,11 +1312,11 @@ int drawscreen(int index)
  */
 void displaygoal(void)
 {
-    static cell	savedmap[MAXHEIGHT * MAXWIDTH];
+    cell       *savedmap;
     int		currblock, ycurrpos, xcurrpos;
 
-    memcpy(savedmap, state.map, sizeof savedmap);
-    memcpy(state.map, state.game->goal, sizeof state.map);
+    savedmap = state.map;
+    state.map = state.game->goal;
     currblock = state.currblock;
     ycurrpos = state.ycurrpos;
     xcurrpos = state.xcurrpos;
@@ -688,32 +1325,49 @@ void displaygoal(void)
     state.currblock = currblock;
     state.ycurrpos = ycurrpos;
     state.xcurrpos = xcurrpos;
-    memcpy(state.map, savedmap, sizeof savedmap);
+    state.map = savedmap;
 }
 
 /* Handle commands from the mouse. While the mouse is being dragged,
- * the function attempts to move the current block towards the cursor.
+ * the function moves the current block along the shortest route that
+ * brings the grabbed cell to the cursor. Clicking on an empty cell
+ * moves the current block onto it by the shortest route available.
  */
 int mousecallback(int y, int x, int mstate)
 {
     static int	startpos, lastpos;
     static int	startmovecount = -1;
-    int		pos, dir, altdir;
-    int		retval, n;
+    static char	       *route = NULL;
+    static int		routesize = 0;
+    int		pos, count, i, n;
 
     if (mstate == -2)
 	return startmovecount < 0 ? 'X' : 0;
     else if (mstate == +2)
 	return 0;
 
-    pos = y * XSIZE + x;
+    n = state.game->ysize * state.game->xsize;
+    if (n > routesize) {
+	if (!(route = realloc(route, n)))
+	    memerrexit();
+	routesize = n;
+    }
+
+    pos = y * state.game->xsize + x;
     if (mstate == -1) {
 	if (y < 1 || x < 1 || y >= state.game->ysize - 1
 			   || x >= state.game->xsize - 1)
 	    return 0;
 	n = blockid(state.map[pos]);
-	if (!n || n == WALLID)
+	if (n == WALLID)
 	    return 0;
+	if (!n) {
+	    if (!state.currblock || state.currblock == WALLID)
+		return 0;
+	    count = findroute(state.currblock, -1, y, x, route);
+	    for (i = 0 ; i < count && newmove(route[i]) ; ++i) ;
+	    return i ? '\f' : 0;
+	}
 	state.currblock = n;
 	state.ycurrpos = state.xcurrpos = 0;
 	startpos = lastpos = pos;
@@ -734,24 +1388,14 @@ int mousecallback(int y, int x, int mstate)
 	return '\f';
     }
 
-    retval = 0;
-    while (pos != lastpos) {
-	raydirections(lastpos / XSIZE, lastpos % XSIZE, y, x, &dir, &altdir);
-	if (dir < 0 || !canmove(state.currblock, dir)) {
-	    if (altdir < 0 || !canmove(state.currblock, altdir))
-		dir = -1;
-	    else
-		dir = altdir;
-	}
-	if (dir < 0 || !newmove(dir))
-	    break;
-	lastpos += dirdelta[dir];
-	retval = '\f';
-    }
+    count = pos == lastpos ? 0 : findroute(state.currblock, lastpos, y, x,
+					     route);
+    for (i = 0 ; i < count && newmove(route[i]) ; ++i)
+	lastpos += dirdelta[(int)route[i]];
 
     if (mstate == +1)
 	startmovecount = -1;
-    return retval;
+    return i ? '\f' : 0;
 }
 
 /* Compare the solution currently sitting in the undo list with the
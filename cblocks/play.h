@@ -11,6 +11,13 @@
 #include	"movelist.h"
 #include	"fileread.h"
 
+/* An entry in the door log, recording the opening of a door.
+ */
+typedef	struct doorevent {
+    int		move;			/* the move that opened the door */
+    int		pos;			/* the door's location on the map */
+} doorevent;
+
 /* The collection of data corresponding to the game's state.
  */
 typedef	struct gamestate {
@@ -23,7 +30,10 @@ typedef	struct gamestate {
     int		stepcount;		/* number of pushes made so far */
     actlist	undo;			/* the list of moves */
     actlist	redo;			/* the list of recently undone moves */
-    cell	map[MAXHEIGHT * MAXWIDTH]; /* the game's map */
+    int		opencount;		/* number of entries in doorlog */
+    doorevent  *doorlog;		/* the doors opened, in order */
+    cell       *map;			/* the game's map */
+    unsigned long hash;			/* hash of the blocks and doors */
 } gamestate;
 
 /* Set the current puzzle to be game, with the given level number.
@@ -39,6 +49,12 @@ extern void selectgame(gamesetup *game, int level);
  */
 extern void initgamestate(void);
 
+/* Set whether a new move that brings back a position from earlier in
+ * the undo list cuts out the moves in between, so that the solutions
+ * saved have no loops in them.
+ */
+extern void setloopcutting(int flag);
+
 /* Execute a new move in the current game. If the move is illegal,
  * FALSE will be returned and the state is unchanged.
  */
@@ -67,6 +83,14 @@ extern int redomove(void);
  */
 extern int redomoves(int n);
 
+/* Undo or redo moves to go n tenths of the way along the line of play
+ * (the moves on the undo list followed by those on the redo list),
+ * forwards if n is positive and backwards if it is negative. Only a
+ * bounded number of moves are actually applied, however far the jump.
+ * FALSE is returned if no moves were undone or redone.
+ */
+extern int seektenths(int n);
+
 /* Redo the last undone step. FALSE is return if there is no step to
  * redo.
  */
@@ -87,6 +111,18 @@ extern int shiftfromcurrblock(int dir);
 
 extern int movecursor(int dir);
 
+/* Begin searching in the background for the best next step from the
+ * current position. The search continues while the user is idle.
+ */
+extern void searchforhint(void);
+
+/* Select the block that should be moved next in order to solve the
+ * puzzle in the fewest steps, and place the cursor next to it in the
+ * direction it should move. FALSE is returned if the background
+ * search has not found the answer yet.
+ */
+extern int showhint(void);
+
 /* Save the current state of the game on a stack.
  */
 extern void savestate(void);
@@ -100,6 +136,14 @@ extern int restorestate(void);
  */
 extern void freesavedstates(void);
 
+/* Bring the current puzzle to the position recorded in the journal
+ * by replaying events, which is the text returned by readjournal().
+ * Replay stops at the first event that does not fit. FALSE is
+ * returned if the events do not begin at the starting position, in
+ * which case initgamestate() must still be called.
+ */
+extern int replayjournal(char const *events);
+
 /* Display the current game state to the user.
  */
 extern int drawscreen(int index);
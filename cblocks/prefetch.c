@@ -0,0 +1,104 @@
+/* prefetch.c: Functions for reading the next puzzle in the
+ * background.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<pthread.h>
+#include	"gen.h"
+#include	"fileread.h"
+#include	"prefetch.h"
+
+/* The series and the puzzle whose successor was last requested.
+ */
+static gameseries      *requestseries = NULL;
+static int		requestlevel = 0;
+
+/* TRUE if a new request has not yet been taken up.
+ */
+static int		pending = FALSE;
+
+/* TRUE while the background thread is reading.
+ */
+static int		busy = FALSE;
+
+/* TRUE once the background thread is running, and FALSE for good if
+ * it could not be started.
+ */
+static int		started = FALSE;
+static int		enabled = TRUE;
+
+/* The lock shared by both threads, and the conditions they wait on.
+ */
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	idle = PTHREAD_COND_INITIALIZER;
+
+/* The background thread. It sleeps until a request comes in,
+ * and then reads the following puzzle, if it is not in
+ * memory already. (The puzzles before the current one have always
+ * been read.) The series is marked as being read in the background,
+ * so that errors are not displayed from this thread; a puzzle that
+ * fails to be read here is read again by the main thread when it is
+ * needed.
+ */
+static void *prefetchthread(void *data)
+{
+    gameseries *series;
+    int		level;
+
+    (void)data;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+	while (!pending)
+	    pthread_cond_wait(&wakeup, &lock);
+	series = requestseries;
+	level = requestlevel;
+	pending = FALSE;
+	busy = TRUE;
+	pthread_mutex_unlock(&lock);
+	series->background = TRUE;
+	readlevelinseries(series, level + 1);
+	series->background = FALSE;
+	pthread_mutex_lock(&lock);
+	busy = FALSE;
+	pthread_cond_broadcast(&idle);
+    }
+    return NULL;
+}
+
+/* Ask for the puzzle after level to be read.
+ */
+void prefetchlevels(gameseries *series, int level)
+{
+    pthread_t	thread;
+
+    pthread_mutex_lock(&lock);
+    if (!started && enabled) {
+	if (pthread_create(&thread, NULL, prefetchthread, NULL))
+	    enabled = FALSE;
+	else
+	    started = TRUE;
+    }
+    if (started) {
+	requestseries = series;
+	requestlevel = level;
+	pending = TRUE;
+	pthread_cond_signal(&wakeup);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Cancel any outstanding request, and wait until the background
+ * thread is idle.
+ */
+void stopprefetch(void)
+{
+    pthread_mutex_lock(&lock);
+    pending = FALSE;
+    requestseries = NULL;
+    while (busy)
+	pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,1056 @@
+/* search.c: Functions for exhaustively exploring a puzzle's positions.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<limits.h>
+#include	<errno.h>
+#include	"gen.h"
+#include	"cblocks.h"
+#include	"dirio.h"
+#include	"fileread.h"
+#include	"search.h"
+
+/* The number of locations first allocated for the key block's step.
+ */
+#define	INITSTEPNODES	256
+
+/* The number of bits in a bitboard row.
+ */
+#define	ROWBITS		((int)(sizeof(bitrow) * CHAR_BIT))
+
+/* Macros for accessing a set of door bits.
+ */
+#define	isdooropen(d, n)	((d)[(n) >> 3] & (1 << ((n) & 7)))
+#define	setdooropen(d, n)	((d)[(n) >> 3] |= 1 << ((n) & 7))
+
+/* A position in unpacked form.
+ */
+typedef	struct position {
+    short		anchors[SEARCHMAXBLOCKS];	/* block locations */
+    unsigned char	doors[MAXSEARCHDOORS / 8];	/* opened doors */
+} position;
+
+/* The cells of a position that are filled, by walls or blocks, and
+ * the cells that are closed doors, as bitboards.
+ */
+typedef	struct bitboard {
+    bitrow		occupied[SEARCHMAXHEIGHT];	/* walls and blocks */
+    bitrow		closed[SEARCHMAXHEIGHT];	/* closed doors */
+} bitboard;
+
+/* One location visited by the key block during a single step.
+ */
+typedef	struct stepnode {
+    short		anchor;				/* block location */
+    short		dir;				/* first move made */
+    unsigned char	doors[MAXSEARCHDOORS / 8];	/* opened doors */
+} stepnode;
+
+/* A sorted file of packed positions being read sequentially.
+ */
+typedef	struct statefile {
+    FILE	       *fp;			/* the file */
+    int			more;			/* FALSE at the end */
+    unsigned char	head[MAXSTATESIZE];	/* the current position */
+} statefile;
+
+/* The data used while generating the next layer of a disk-based
+ * search.
+ */
+typedef	struct layerbuild {
+    searchinfo const   *info;		/* the puzzle being searched */
+    char const	       *tmpdir;		/* where to put temporary files */
+    unsigned char      *buf;		/* positions waiting to be sorted */
+    long		bufcount;	/* number of positions in buf */
+    long		bufmax;		/* number of positions buf can hold */
+    FILE	      **runs;		/* sorted files of new positions */
+    int			runcount;	/* number of files in runs */
+    int			runsallocated;	/* number of elements allocated */
+    int			error;		/* errno of a file error, or zero */
+} layerbuild;
+
+/* Buckets smaller than this are sorted by insertion.
+ */
+#define	SMALLSORT	16
+
+/*
+ * Position encoding functions
+ */
+
+/* Translate a location in the search's map coordinates into an index
+ * into the puzzle's own map.
+ */
+static int mapindex(searchinfo const *info, int pos)
+{
+    return (pos / SEARCHXSIZE) * info->xsize + pos % SEARCHXSIZE;
+}
+
+/* Return the lowest block ID in the set of IDs equivalent to id.
+ */
+static int equivclass(gamesetup const *game, int id)
+{
+    int	n, k, i;
+
+    n = id;
+    k = game->equivs[id];
+    for (i = 0 ; k && k != id && i <= LASTID ; ++i) {
+	if (k < n)
+	    n = k;
+	k = game->equivs[k];
+    }
+    return k == id ? n : id;
+}
+
+/* Store pos into state in packed form. Interchangeable blocks are
+ * stored in increasing order of location.
+ */
+static void writestate(searchinfo const *info, position const *pos,
+		       unsigned char *state)
+{
+    short	anchors[SEARCHMAXBLOCKS];
+    int		b, i, j, n;
+
+    memcpy(anchors, pos->anchors, info->blockcount * sizeof *anchors);
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	if (info->blocks[b].group == b)
+	    continue;
+	n = anchors[b];
+	for (i = b ; i > info->blocks[b].group && anchors[i - 1] > n ; --i)
+	    anchors[i] = anchors[i - 1];
+	anchors[i] = n;
+    }
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	n = anchors[b] / SEARCHXSIZE - 1;
+	n = n * info->innerwidth + anchors[b] % SEARCHXSIZE - 1;
+	if (info->possize > 1)
+	    *state++ = n >> 8;
+	*state++ = n & 0xFF;
+    }
+    for (j = 0 ; j < (info->doorcount + 7) / 8 ; ++j)
+	*state++ = pos->doors[j];
+}
+
+/* Unpack state into pos.
+ */
+static void readstate(searchinfo const *info, unsigned char const *state,
+		      position *pos)
+{
+    int	b, j, n;
+
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	n = *state++;
+	if (info->possize > 1)
+	    n = (n << 8) | *state++;
+	pos->anchors[b] = (n / info->innerwidth + 1) * SEARCHXSIZE
+			+ n % info->innerwidth + 1;
+    }
+    for (j = 0 ; j < (info->doorcount + 7) / 8 ; ++j)
+	pos->doors[j] = *state++;
+}
+
+/* Pack the position shown in map into state.
+ */
+void packstate(searchinfo const *info, cell const *map, unsigned char *state)
+{
+    position	pos;
+    short	top[LASTID + 1], left[LASTID + 1];
+    int		y, x, b, n;
+
+    for (n = 0 ; n <= LASTID ; ++n)
+	top[n] = left[n] = MAXWIDTH + MAXHEIGHT;
+    for (y = 1 ; y < info->ysize - 1 ; ++y) {
+	for (x = 1 ; x < info->xsize - 1 ; ++x) {
+	    n = blockid(map[y * info->xsize + x]);
+	    if (top[n] > y)
+		top[n] = y;
+	    if (left[n] > x)
+		left[n] = x;
+	}
+    }
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	n = info->blocks[b].id;
+	pos.anchors[b] = top[n] * SEARCHXSIZE + left[n];
+    }
+    memset(pos.doors, 0, sizeof pos.doors);
+    for (n = 0 ; n < info->doorcount ; ++n)
+	if (!isdoorclosed(map[mapindex(info, info->doors[n])]))
+	    setdooropen(pos.doors, n);
+    writestate(info, &pos, state);
+}
+
+/* Draw the packed position into map as a map of block IDs.
+ */
+void unpackstate(searchinfo const *info, unsigned char const *state,
+		 cell *map)
+{
+    position	pos;
+    short const	       *cells;
+    int			b, i, n;
+
+    readstate(info, state, &pos);
+    for (n = 0 ; n < info->ysize * info->xsize ; ++n) {
+	i = blockid(info->map[n]);
+	map[n] = i == WALLID ? WALLID : i ? 0
+				      : info->map[n] & DOOR_MASK;
+    }
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	cells = info->cells + info->blocks[b].cellindex;
+	for (i = 0 ; i < info->blocks[b].cellcount ; ++i)
+	    map[mapindex(info, pos.anchors[b] + cells[i])] = info->blocks[b].id;
+    }
+    for (n = 0 ; n < info->doorcount ; ++n)
+	if (isdooropen(pos.doors, n))
+	    map[mapindex(info, info->doors[n])] &= ~DOORCLOSED;
+}
+
+/* Return TRUE if two blocks are identical in shape and requirements.
+ */
+static int interchangeable(searchinfo const *info,
+			   searchblock const *a, searchblock const *b)
+{
+    if (a->id == KEYID || b->id == KEYID)
+	return FALSE;
+    if (a->goalclass != b->goalclass || a->cellcount != b->cellcount)
+	return FALSE;
+    return !memcmp(info->cells + a->cellindex, info->cells + b->cellindex,
+		   a->cellcount * sizeof *info->cells);
+}
+
+/* Add the cell at (y, x) to the part of the goal requiring goalclass.
+ */
+static void addgoalcell(searchinfo *info, int goalclass, int y, int x)
+{
+    int	i;
+
+    for (i = 0 ; i < info->goalcount ; ++i)
+	if (info->goals[i].goalclass == goalclass && info->goals[i].y == y)
+	    break;
+    if (i == info->goalcount) {
+	info->goals[i].goalclass = goalclass;
+	info->goals[i].y = y;
+	info->goals[i].bits = 0;
+	++info->goalcount;
+    }
+    info->goals[i].bits |= (bitrow)1 << x;
+}
+
+/* Initialize info for searching game. The blocks are collected from
+ * the starting map, and then arranged so that interchangeable blocks
+ * are adjacent to each other. Everything beyond the edges of the map
+ * is treated as wall. The map is copied into info, so that a search
+ * never refers back to game, which may be moved while it runs.
+ */
+int initsearch(searchinfo *info, gamesetup const *game)
+{
+    searchblock	blocks[SEARCHMAXBLOCKS];
+    short	cells[SEARCHMAXHEIGHT * SEARCHXSIZE];
+    short	top[LASTID + 1], left[LASTID + 1], count[LASTID + 1];
+    short	bottom[LASTID + 1], right[LASTID + 1];
+    char	used[SEARCHMAXBLOCKS];
+    int		y, x, b, i, j, n, id;
+
+    memset(info, 0, sizeof *info);
+    info->keyblock = -1;
+    info->innerwidth = game->xsize - 2;
+    if (game->ysize > SEARCHMAXHEIGHT || game->xsize > SEARCHXSIZE)
+	return FALSE;
+    info->ysize = game->ysize;
+    info->xsize = game->xsize;
+    memcpy(info->map, game->map,
+	   game->ysize * game->xsize * sizeof *info->map);
+
+    for (n = 0 ; n <= LASTID ; ++n) {
+	top[n] = left[n] = MAXWIDTH + MAXHEIGHT;
+	bottom[n] = right[n] = count[n] = 0;
+    }
+    for (y = 0 ; y < SEARCHMAXHEIGHT ; ++y)
+	info->walls[y] = ~(bitrow)0;
+    for (y = 0 ; y < game->ysize ; ++y) {
+	for (x = 0 ; x < game->xsize ; ++x) {
+	    n = y * game->xsize + x;
+	    id = blockid(game->map[n]);
+	    if (id == WALLID)
+		continue;
+	    info->walls[y] &= ~((bitrow)1 << x);
+	    if (id) {
+		if (top[id] > y)
+		    top[id] = y;
+		if (left[id] > x)
+		    left[id] = x;
+		if (bottom[id] < y)
+		    bottom[id] = y;
+		if (right[id] < x)
+		    right[id] = x;
+		++count[id];
+	    } else if (game->map[n] & DOOR) {
+		if (info->doorcount >= MAXSEARCHDOORS)
+		    return FALSE;
+		info->doorrows[y] |= (bitrow)1 << x;
+		info->doors[info->doorcount++] = y * SEARCHXSIZE + x;
+	    }
+	    if (game->goal[n] && blockid(game->goal[n]) != WALLID) {
+		id = blockid(game->goal[n]);
+		addgoalcell(info, id ? equivclass(game, id) : -1, y, x);
+	    }
+	}
+    }
+
+    n = 0;
+    for (id = KEYID ; id <= LASTID ; ++id) {
+	if (!count[id])
+	    continue;
+	if (info->blockcount >= SEARCHMAXBLOCKS)
+	    return FALSE;
+	b = info->blockcount++;
+	blocks[b].id = id;
+	blocks[b].cellcount = 0;
+	blocks[b].cellindex = n;
+	blocks[b].height = bottom[id] - top[id] + 1;
+	blocks[b].width = right[id] - left[id] + 1;
+	blocks[b].goalclass = 0;
+	i = equivclass(game, id);
+	for (j = 0 ; j < info->goalcount ; ++j)
+	    if (info->goals[j].goalclass == i)
+		blocks[b].goalclass = i;
+	for (y = top[id] ; y <= bottom[id] ; ++y) {
+	    for (x = left[id] ; x <= right[id] ; ++x) {
+		if (blockid(game->map[y * game->xsize + x]) == id) {
+		    cells[n++] = (y - top[id]) * SEARCHXSIZE + x - left[id];
+		    ++blocks[b].cellcount;
+		}
+	    }
+	}
+    }
+    memcpy(info->cells, cells, n * sizeof *cells);
+
+    memset(used, 0, sizeof used);
+    for (i = 0, b = 0 ; b < info->blockcount ; ++b) {
+	if (used[b])
+	    continue;
+	n = i;
+	for (j = b ; j < info->blockcount ; ++j) {
+	    if (used[j] || (j != b && !interchangeable(info, blocks + b,
+							     blocks + j)))
+		continue;
+	    used[j] = TRUE;
+	    info->blocks[i] = blocks[j];
+	    info->blocks[i].group = n;
+	    ++i;
+	}
+	for (j = n ; j < i ; ++j)
+	    info->blocks[j].groupsize = i - n;
+	if (blocks[b].id == KEYID)
+	    info->keyblock = n;
+    }
+
+    for (b = 0, n = 0 ; b < info->blockcount ; ++b) {
+	info->blocks[b].shapeindex = n;
+	for (i = 0 ; i < info->blocks[b].cellcount ; ++i) {
+	    j = info->cells[info->blocks[b].cellindex + i];
+	    info->shapes[n + j / SEARCHXSIZE] |= (bitrow)1 << (j % SEARCHXSIZE);
+	}
+	n += info->blocks[b].height;
+    }
+
+    n = (game->ysize - 2) * info->innerwidth;
+    info->possize = n > 256 ? 2 : 1;
+    info->statesize = info->blockcount * info->possize
+		    + (info->doorcount + 7) / 8;
+    if (!info->statesize)
+	info->statesize = 1;
+    packstate(info, game->map, info->start);
+    return TRUE;
+}
+
+/*
+ * Bitboard functions
+ */
+
+/* Return the index of the lowest bit set in row, which must not be
+ * zero.
+ */
+static int lowbit(bitrow row)
+{
+#ifdef __GNUC__
+    return __builtin_ctzl(row);
+#else
+    int	n;
+
+    for (n = 0 ; !(row & 1) ; ++n)
+	row >>= 1;
+    return n;
+#endif
+}
+
+/* Toggle the cells of block b, with its anchor at the given location,
+ * in rows.
+ */
+static void placeblock(searchinfo const *info, int b, int anchor,
+		       bitrow *rows)
+{
+    bitrow const       *shape;
+    int			y, x, i;
+
+    shape = info->shapes + info->blocks[b].shapeindex;
+    y = anchor / SEARCHXSIZE;
+    x = anchor % SEARCHXSIZE;
+    for (i = 0 ; i < info->blocks[b].height ; ++i)
+	rows[y + i] ^= shape[i] << x;
+}
+
+/* Fill in board with the position in pos.
+ */
+static void fillbitboard(searchinfo const *info, position const *pos,
+			 bitboard *board)
+{
+    int	b, n;
+
+    memcpy(board->occupied, info->walls, sizeof board->occupied);
+    for (b = 0 ; b < info->blockcount ; ++b)
+	placeblock(info, b, pos->anchors[b], board->occupied);
+    memcpy(board->closed, info->doorrows, sizeof board->closed);
+    for (n = 0 ; n < info->doorcount ; ++n)
+	if (isdooropen(pos->doors, n))
+	    board->closed[info->doors[n] / SEARCHXSIZE]
+			&= ~((bitrow)1 << (info->doors[n] % SEARCHXSIZE));
+}
+
+/* Set fits to the anchor locations where block b would not overlap
+ * any of the cells in blocked. Each cell of the block rules out, in a
+ * single shift, every anchor in a row that would place that cell on a
+ * blocked one. The return value is the last row that fits can use.
+ */
+static int getfits(searchinfo const *info, int b, bitrow const *blocked,
+		   bitrow *fits)
+{
+    searchblock const  *block = info->blocks + b;
+    short const	       *cells;
+    bitrow		valid, bad;
+    int			lasty, y, i, n;
+
+    cells = info->cells + block->cellindex;
+    lasty = info->ysize - 1 - block->height;
+    n = info->xsize - block->width + 1;
+    valid = n >= ROWBITS ? ~(bitrow)0 : ((bitrow)1 << n) - 1;
+    for (y = 1 ; y <= lasty ; ++y) {
+	bad = 0;
+	for (i = 0 ; i < block->cellcount ; ++i)
+	    bad |= blocked[y + cells[i] / SEARCHXSIZE] >> (cells[i] % SEARCHXSIZE);
+	fits[y] = valid & ~bad;
+    }
+    return lasty;
+}
+
+/* Return TRUE if the packed position solves the puzzle, i.e. if every
+ * row of the goal is covered by blocks of the required class.
+ */
+int isgoalstate(searchinfo const *info, unsigned char const *state)
+{
+    position		pos;
+    bitrow		bits;
+    int			b, i, y;
+
+    readstate(info, state, &pos);
+    for (i = 0 ; i < info->goalcount ; ++i) {
+	bits = info->goals[i].bits;
+	for (b = 0 ; bits && b < info->blockcount ; ++b) {
+	    if (info->blocks[b].goalclass != info->goals[i].goalclass)
+		continue;
+	    y = info->goals[i].y - pos.anchors[b] / SEARCHXSIZE;
+	    if (y < 0 || y >= info->blocks[b].height)
+		continue;
+	    bits &= ~(info->shapes[info->blocks[b].shapeindex + y]
+				<< (pos.anchors[b] % SEARCHXSIZE));
+	}
+	if (bits)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/* Return the map index of the first cell of the given block in the
+ * packed position.
+ */
+int getblockcell(searchinfo const *info, unsigned char const *state,
+		 int block)
+{
+    position	pos;
+
+    readstate(info, state, &pos);
+    return mapindex(info, pos.anchors[block]
+			    + info->cells[info->blocks[block].cellindex]);
+}
+
+/*
+ * Move generation functions
+ */
+
+/* Pass func the position created by moving block b in pos to anchor.
+ */
+static void emitsuccessor(searchinfo const *info, position *pos, int b,
+			  int anchor, int dir, successorfunc func, void *data)
+{
+    unsigned char	state[MAXSTATESIZE];
+    int			from;
+
+    from = pos->anchors[b];
+    pos->anchors[b] = anchor;
+    writestate(info, pos, state);
+    (*func)(state, b, dir, data);
+    pos->anchors[b] = from;
+}
+
+/* Find every location block b can reach in one step, for a block that
+ * does not interact with doors. The flood fill is done on all four
+ * first moves at once, so that frontier[d] holds the locations whose
+ * shortest route begins with a move in direction d. When routes of
+ * equal length exist, the lowest direction claims the location.
+ */
+static void floodblock(searchinfo const *info, position *pos, int b,
+		       bitrow const *fits, int lasty,
+		       successorfunc func, void *data)
+{
+    bitrow	frontier[4][SEARCHMAXHEIGHT];
+    bitrow	next[SEARCHMAXHEIGHT];
+    bitrow	seen[SEARCHMAXHEIGHT];
+    bitrow	row;
+    int		y0, x0, y, d, more;
+
+    memset(frontier, 0, sizeof frontier);
+    memset(seen, 0, sizeof seen);
+    y0 = pos->anchors[b] / SEARCHXSIZE;
+    x0 = pos->anchors[b] % SEARCHXSIZE;
+    frontier[NORTH][y0 - 1] = fits[y0 - 1] & ((bitrow)1 << x0);
+    frontier[EAST][y0] = fits[y0] & ((bitrow)1 << (x0 + 1));
+    frontier[SOUTH][y0 + 1] = fits[y0 + 1] & ((bitrow)1 << x0);
+    frontier[WEST][y0] = fits[y0] & ((bitrow)1 << (x0 - 1));
+    for (d = NORTH ; d <= WEST ; ++d)
+	for (y = y0 - 1 ; y <= y0 + 1 ; ++y)
+	    seen[y] |= frontier[d][y];
+    seen[y0] |= (bitrow)1 << x0;
+
+    do {
+	more = FALSE;
+	for (d = NORTH ; d <= WEST ; ++d) {
+	    for (y = 1 ; y <= lasty ; ++y) {
+		row = frontier[d][y];
+		for ( ; row ; row &= row - 1)
+		    emitsuccessor(info, pos, b, y * SEARCHXSIZE + lowbit(row),
+				  d, func, data);
+		row = frontier[d][y];
+		next[y] = (row << 1) | (row >> 1)
+			| frontier[d][y - 1] | frontier[d][y + 1];
+		next[y] &= fits[y] & ~seen[y];
+	    }
+	    for (y = 1 ; y <= lasty ; ++y) {
+		frontier[d][y] = next[y];
+		seen[y] |= next[y];
+		if (next[y])
+		    more = TRUE;
+	    }
+	}
+    } while (more);
+}
+
+/* Return the slot in the hash table of visited locations that holds
+ * the given location and set of open doors, or the empty slot where
+ * it belongs. Each slot holds one plus the location's index in nodes,
+ * or zero if it is empty.
+ */
+static int *findstepnode(int *table, int tablesize, stepnode const *nodes,
+			 int anchor, unsigned char const *doors, int doorbytes)
+{
+    unsigned long	h;
+    int			i, n;
+
+    h = anchor;
+    for (i = 0 ; i < doorbytes ; ++i)
+	h = h * 31 + doors[i];
+    h = (h * 2654435761UL) >> 8;
+    for (i = h & (tablesize - 1) ; (n = table[i]) ;
+				   i = (i + 1) & (tablesize - 1))
+	if (nodes[n - 1].anchor == anchor
+			&& !memcmp(nodes[n - 1].doors, doors, doorbytes))
+	    break;
+    return table + i;
+}
+
+/* Find every location the key block can reach in one step, when the
+ * puzzle has doors. Since the key opens doors as it passes over them,
+ * one location can be reached with different sets of open doors, and
+ * so the locations are visited one at a time. The visited locations
+ * are kept in an array that grows as needed, together with a hash
+ * table that is twice its size.
+ */
+static void floodkey(searchinfo const *info, position *pos, int b,
+		     bitrow const *fits, int lasty,
+		     successorfunc func, void *data)
+{
+    static int const	dirdy[] = { -1, 0, +1, 0 };
+    static int const	dirdx[] = { 0, +1, 0, -1 };
+    stepnode	       *nodes;
+    int		       *table;
+    int		       *slot;
+    bitrow const       *shape;
+    unsigned char	doors[MAXSEARCHDOORS / 8];
+    int			doorbytes, allocated;
+    int			count, y, x, dir;
+    int			i, j, n;
+
+    doorbytes = (info->doorcount + 7) / 8;
+    shape = info->shapes + info->blocks[b].shapeindex;
+    allocated = INITSTEPNODES;
+    if (!(nodes = malloc(allocated * sizeof *nodes)))
+	memerrexit();
+    if (!(table = calloc(2 * allocated, sizeof *table)))
+	memerrexit();
+    nodes[0].anchor = pos->anchors[b];
+    nodes[0].dir = -1;
+    memcpy(nodes[0].doors, pos->doors, doorbytes);
+    *findstepnode(table, 2 * allocated, nodes,
+		  nodes[0].anchor, nodes[0].doors, doorbytes) = 1;
+    count = 1;
+    for (i = 0 ; i < count ; ++i) {
+	for (dir = NORTH ; dir <= WEST ; ++dir) {
+	    y = nodes[i].anchor / SEARCHXSIZE + dirdy[dir];
+	    x = nodes[i].anchor % SEARCHXSIZE + dirdx[dir];
+	    if (y < 1 || y > lasty || x < 0 || !((fits[y] >> x) & 1))
+		continue;
+	    memcpy(doors, nodes[i].doors, doorbytes);
+	    for (j = 0 ; j < info->doorcount ; ++j) {
+		n = info->doors[j] / SEARCHXSIZE - y;
+		if (n >= 0 && n < info->blocks[b].height
+			   && ((shape[n] << x) >> (info->doors[j] % SEARCHXSIZE)) & 1)
+		    setdooropen(doors, j);
+	    }
+	    slot = findstepnode(table, 2 * allocated, nodes,
+				y * SEARCHXSIZE + x, doors, doorbytes);
+	    if (*slot)
+		continue;
+	    if (count == allocated) {
+		allocated *= 2;
+		if (!(nodes = realloc(nodes, allocated * sizeof *nodes)))
+		    memerrexit();
+		free(table);
+		if (!(table = calloc(2 * allocated, sizeof *table)))
+		    memerrexit();
+		for (j = 0 ; j < count ; ++j)
+		    *findstepnode(table, 2 * allocated, nodes, nodes[j].anchor,
+				  nodes[j].doors, doorbytes) = j + 1;
+		slot = findstepnode(table, 2 * allocated, nodes,
+				    y * SEARCHXSIZE + x, doors, doorbytes);
+	    }
+	    *slot = count + 1;
+	    nodes[count].anchor = y * SEARCHXSIZE + x;
+	    nodes[count].dir = i ? nodes[i].dir : dir;
+	    memcpy(nodes[count].doors, doors, doorbytes);
+	    memcpy(pos->doors, doors, doorbytes);
+	    emitsuccessor(info, pos, b, nodes[count].anchor,
+			  nodes[count].dir, func, data);
+	    ++count;
+	}
+    }
+    memcpy(pos->doors, nodes[0].doors, doorbytes);
+    free(nodes);
+    free(table);
+}
+
+/* Call func once for every position that can be reached from state
+ * in a single step. A block is stopped by walls and by every other
+ * block, and also by closed doors unless it is the key.
+ */
+void getsuccessors(searchinfo const *info, unsigned char const *state,
+		   successorfunc func, void *data)
+{
+    position	pos;
+    bitboard	board;
+    bitrow	blocked[SEARCHMAXHEIGHT];
+    bitrow	fits[SEARCHMAXHEIGHT];
+    int		b, y, lasty;
+
+    readstate(info, state, &pos);
+    fillbitboard(info, &pos, &board);
+    for (b = 0 ; b < info->blockcount ; ++b) {
+	memcpy(blocked, board.occupied, sizeof blocked);
+	placeblock(info, b, pos.anchors[b], blocked);
+	if (b != info->keyblock)
+	    for (y = 0 ; y < info->ysize ; ++y)
+		blocked[y] |= board.closed[y];
+	lasty = getfits(info, b, blocked, fits);
+	fits[0] = fits[lasty + 1] = 0;
+	if (b == info->keyblock && info->doorcount)
+	    floodkey(info, &pos, b, fits, lasty, func, data);
+	else
+	    floodblock(info, &pos, b, fits, lasty, func, data);
+    }
+}
+
+/*
+ * Disk-based search functions
+ */
+
+/* Sort count positions of the given size, comparing only the bytes
+ * from offset onwards, by inserting each one in turn.
+ */
+static void insertionsort(unsigned char *buf, long count, int size,
+			  int offset)
+{
+    unsigned char	temp[MAXSTATESIZE];
+    unsigned char      *p;
+    long		i;
+
+    for (i = 1 ; i < count ; ++i) {
+	p = buf + i * size;
+	if (memcmp(p - size + offset, p + offset, size - offset) <= 0)
+	    continue;
+	memcpy(temp, p, size);
+	do {
+	    memcpy(p, p - size, size);
+	    p -= size;
+	} while (p > buf && memcmp(p - size + offset, temp + offset,
+				  size - offset) > 0);
+	memcpy(p, temp, size);
+    }
+}
+
+/* Sort count positions of the given size in place. The positions are
+ * distributed into buckets by the byte at offset, and then each
+ * bucket is sorted on the remaining bytes. Since this needs no
+ * comparison callback, searches can run in several threads at once.
+ */
+static void sortstates(unsigned char *buf, long count, int size, int offset)
+{
+    unsigned char	temp[MAXSTATESIZE];
+    long		start[257], next[256];
+    unsigned char      *p;
+    long		i;
+    int			b, c;
+
+    if (offset >= size)
+	return;
+    if (count < SMALLSORT) {
+	insertionsort(buf, count, size, offset);
+	return;
+    }
+
+    memset(start, 0, sizeof start);
+    for (i = 0 ; i < count ; ++i)
+	++start[buf[i * size + offset] + 1];
+    for (b = 0 ; b < 256 ; ++b) {
+	start[b + 1] += start[b];
+	next[b] = start[b];
+    }
+    for (b = 0 ; b < 256 ; ++b) {
+	while (next[b] < start[b + 1]) {
+	    p = buf + next[b] * size;
+	    c = p[offset];
+	    if (c == b) {
+		++next[b];
+		continue;
+	    }
+	    memcpy(temp, p, size);
+	    memcpy(p, buf + next[c] * size, size);
+	    memcpy(buf + next[c] * size, temp, size);
+	    ++next[c];
+	}
+    }
+    for (b = 0 ; b < 256 ; ++b)
+	if (start[b + 1] - start[b] > 1)
+	    sortstates(buf + start[b] * size, start[b + 1] - start[b],
+		       size, offset + 1);
+}
+
+/* Begin reading a file of positions from the start.
+ */
+static void openstatefile(statefile *sf, FILE *fp, int size)
+{
+    sf->fp = fp;
+    rewind(fp);
+    sf->more = fread(sf->head, size, 1, fp) == 1;
+}
+
+/* Advance to the next position in a file.
+ */
+static void nextstate(statefile *sf, int size)
+{
+    sf->more = fread(sf->head, size, 1, sf->fp) == 1;
+}
+
+/* Return the current value of errno, or EIO if it was not set.
+ */
+static int geterrno(void)
+{
+    return errno ? errno : EIO;
+}
+
+/* Sort the positions in the buffer, remove duplicates, and write them
+ * out to a new temporary file.
+ */
+static void flushlayerbuild(layerbuild *lb)
+{
+    FILE       *fp;
+    int		size = lb->info->statesize;
+    long	i, n;
+
+    if (!lb->bufcount)
+	return;
+    sortstates(lb->buf, lb->bufcount, size, 0);
+    for (i = 1, n = 1 ; i < lb->bufcount ; ++i) {
+	if (memcmp(lb->buf + (n - 1) * size, lb->buf + i * size, size)) {
+	    if (n != i)
+		memcpy(lb->buf + n * size, lb->buf + i * size, size);
+	    ++n;
+	}
+    }
+    lb->bufcount = 0;
+
+    if (!(fp = opentempfile(lb->tmpdir))) {
+	lb->error = geterrno();
+	return;
+    }
+    if (fwrite(lb->buf, size, n, fp) != (size_t)n) {
+	lb->error = geterrno();
+	fclose(fp);
+	return;
+    }
+    if (lb->runcount >= lb->runsallocated) {
+	lb->runsallocated = lb->runsallocated ? lb->runsallocated * 2 : 16;
+	if (!(lb->runs = realloc(lb->runs,
+				 lb->runsallocated * sizeof *lb->runs)))
+	    memerrexit();
+    }
+    lb->runs[lb->runcount++] = fp;
+}
+
+/* A successorfunc callback that adds a position to the buffer.
+ */
+static void addtolayerbuild(unsigned char const *state, int block, int dir,
+			    void *data)
+{
+    layerbuild *lb = data;
+
+    (void)block;
+    (void)dir;
+    memcpy(lb->buf + lb->bufcount * lb->info->statesize, state,
+	   lb->info->statesize);
+    if (++lb->bufcount >= lb->bufmax)
+	flushlayerbuild(lb);
+}
+
+/* Merge the sorted runs into a single sorted file of new positions,
+ * leaving out duplicates and anything that appears in the files
+ * listed in seen. The number of positions written is returned, or -1
+ * if a file error occurs, with the error stored in lb.
+ */
+static long mergelayerbuild(layerbuild *lb, FILE **seen, int seencount,
+			    FILE *out)
+{
+    statefile  *runs, *old;
+    int		size = lb->info->statesize;
+    long	count;
+    int		i, n, cmp;
+
+    if (!(runs = malloc((lb->runcount + seencount) * sizeof *runs)))
+	memerrexit();
+    old = runs + lb->runcount;
+    for (i = 0 ; i < lb->runcount ; ++i)
+	openstatefile(runs + i, lb->runs[i], size);
+    for (i = 0 ; i < seencount ; ++i)
+	openstatefile(old + i, seen[i], size);
+
+    count = 0;
+    for (;;) {
+	n = -1;
+	for (i = 0 ; i < lb->runcount ; ++i)
+	    if (runs[i].more && (n < 0 || memcmp(runs[i].head, runs[n].head,
+						 size) < 0))
+		n = i;
+	if (n < 0)
+	    break;
+	for (i = 0 ; i < seencount ; ++i) {
+	    while (old[i].more
+		   && (cmp = memcmp(old[i].head, runs[n].head, size)) < 0)
+		nextstate(old + i, size);
+	    if (old[i].more && !cmp)
+		break;
+	}
+	if (i == seencount) {
+	    if (fwrite(runs[n].head, size, 1, out) != 1) {
+		lb->error = geterrno();
+		count = -1;
+		break;
+	    }
+	    ++count;
+	}
+	for (i = 0 ; i < lb->runcount ; ++i)
+	    while (runs[i].more && i != n
+				&& !memcmp(runs[i].head, runs[n].head, size))
+		nextstate(runs + i, size);
+	nextstate(runs + n, size);
+    }
+
+    for (i = 0 ; i < lb->runcount ; ++i)
+	fclose(lb->runs[i]);
+    lb->runcount = 0;
+    free(runs);
+    return count;
+}
+
+/* Combine two sorted files of positions, which have none in common,
+ * into a new sorted temporary file. NULL is returned if a file error
+ * occurs, with the error stored in lb.
+ */
+static FILE *combinelayers(layerbuild *lb, FILE *a, FILE *b)
+{
+    statefile	sa, sb;
+    statefile  *sf;
+    FILE       *fp;
+    int		size = lb->info->statesize;
+
+    if (!(fp = opentempfile(lb->tmpdir))) {
+	lb->error = geterrno();
+	return NULL;
+    }
+    openstatefile(&sa, a, size);
+    openstatefile(&sb, b, size);
+    while (sa.more || sb.more) {
+	sf = !sb.more || (sa.more && memcmp(sa.head, sb.head, size) < 0)
+			? &sa : &sb;
+	if (fwrite(sf->head, size, 1, fp) != 1) {
+	    lb->error = geterrno();
+	    fclose(fp);
+	    return NULL;
+	}
+	nextstate(sf, size);
+    }
+    return fp;
+}
+
+/* Add a layer's size to the search results.
+ */
+static void addlayer(searchstats *stats, long count)
+{
+    if (!(stats->depth & 63))
+	if (!(stats->layers = realloc(stats->layers,
+				      (stats->depth + 64)
+					* sizeof *stats->layers)))
+	    memerrexit();
+    stats->layers[stats->depth++] = count;
+    stats->statecount += count;
+}
+
+/* Explore every position reachable from the starting position. Each
+ * new layer of positions is generated from the previous one and
+ * written out in sorted runs, which are then merged together. While
+ * merging, positions that were already found in earlier layers are
+ * removed. Without doors, every step can be reversed, and so only the
+ * two previous layers need to be checked. With doors, all earlier
+ * layers must be checked; the older ones are combined into a single
+ * file as the search goes on, so that no more than three layers are
+ * ever open at once. If a file error occurs, it is stored in stats
+ * and FALSE is returned.
+ */
+int exploreondisk(searchinfo const *info, char const *tmpdir, long bufsize,
+		  searchstats *stats)
+{
+    layerbuild	lb;
+    statefile	curr;
+    FILE      **layers;
+    FILE       *fp;
+    long	count;
+    int		size = info->statesize;
+    int		layercount, first, i;
+
+    memset(stats, 0, sizeof *stats);
+    stats->firstgoal = -1;
+
+    if (!(fp = opentempfile(tmpdir))) {
+	stats->error = geterrno();
+	return FALSE;
+    }
+    if (fwrite(info->start, size, 1, fp) != 1) {
+	stats->error = geterrno();
+	fclose(fp);
+	return FALSE;
+    }
+    if (!(layers = malloc(sizeof *layers)))
+	memerrexit();
+    layers[0] = fp;
+    layercount = 1;
+    first = 0;
+
+    memset(&lb, 0, sizeof lb);
+    lb.info = info;
+    lb.tmpdir = tmpdir;
+    lb.bufmax = bufsize / size;
+    if (lb.bufmax < 1)
+	lb.bufmax = 1;
+    if (!(lb.buf = malloc(lb.bufmax * size)))
+	memerrexit();
+
+    for (count = 1 ; count > 0 ; ) {
+	addlayer(stats, count);
+	for (openstatefile(&curr, layers[layercount - 1], size) ;
+	     curr.more && !lb.error ; nextstate(&curr, size)) {
+	    if (isgoalstate(info, curr.head)) {
+		if (!stats->goalcount)
+		    stats->firstgoal = stats->depth - 1;
+		++stats->goalcount;
+	    }
+	    getsuccessors(info, curr.head, addtolayerbuild, &lb);
+	}
+	flushlayerbuild(&lb);
+	if (!info->doorcount) {
+	    while (first < layercount - 2)
+		fclose(layers[first++]);
+	} else {
+	    while (first < layercount - 3 && !lb.error) {
+		if (!(fp = combinelayers(&lb, layers[first],
+					 layers[first + 1])))
+		    break;
+		fclose(layers[first]);
+		fclose(layers[first + 1]);
+		layers[++first] = fp;
+	    }
+	}
+	if (!lb.error && !(fp = opentempfile(tmpdir)))
+	    lb.error = geterrno();
+	if (lb.error) {
+	    count = -1;
+	    break;
+	}
+	count = mergelayerbuild(&lb, layers + first, layercount - first, fp);
+	if (!(layers = realloc(layers, (layercount + 1) * sizeof *layers)))
+	    memerrexit();
+	layers[layercount++] = fp;
+    }
+
+    for (i = first ; i < layercount ; ++i)
+	fclose(layers[i]);
+    for (i = 0 ; i < lb.runcount ; ++i)
+	fclose(lb.runs[i]);
+    free(layers);
+    free(lb.buf);
+    if (lb.runs)
+	free(lb.runs);
+    if (count < 0) {
+	stats->error = lb.error;
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/* Free the memory allocated in stats.
+ */
+void freesearchstats(searchstats *stats)
+{
+    if (stats->layers)
+	free(stats->layers);
+    stats->layers = NULL;
+    stats->depth = 0;
+}
@@ -0,0 +1,170 @@
+/* search.h: Functions for exhaustively exploring a puzzle's positions.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_search_h_
+#define	_search_h_
+
+#include	"cblocks.h"
+#include	"fileread.h"
+
+/* The largest number of door cells a puzzle can have and still be
+ * searched.
+ */
+#define	MAXSEARCHDOORS	64
+
+/* The largest puzzle that can be searched, and the most blocks it can
+ * have. The search functions use their own map coordinates, with rows
+ * SEARCHXSIZE cells apart, so that a row always fits in a bitboard.
+ */
+#define	SEARCHXSIZE	32
+#define	SEARCHMAXHEIGHT	32
+#define	SEARCHMAXBLOCKS	255
+
+/* The default number of bytes of memory used to collect and sort new
+ * positions during a disk-based search. Anything beyond this amount
+ * is sorted in pieces and merged from disk.
+ */
+#ifndef	SEARCHBUFSIZE
+#define	SEARCHBUFSIZE	(64 * 1024 * 1024)
+#endif
+
+/* The largest number of bytes a packed position can occupy.
+ */
+#define	MAXSTATESIZE	(2 * SEARCHMAXBLOCKS + MAXSEARCHDOORS / 8)
+
+/* One row of a bitboard. Bit x represents column x of the map.
+ */
+typedef	unsigned long	bitrow;
+
+/* The description of one block, as seen by the search functions.
+ */
+typedef	struct searchblock {
+    short	id;			/* the block's ID in the map */
+    short	group;			/* first block interchangeable with it */
+    short	groupsize;		/* number of blocks in that group */
+    short	goalclass;		/* equivalency class in the goal */
+    short	cellcount;		/* number of cells in the block */
+    short	cellindex;		/* the block's first entry in cells */
+    short	height;			/* height of the bounding box */
+    short	width;			/* width of the bounding box */
+    short	shapeindex;		/* the block's first entry in shapes */
+} searchblock;
+
+/* The cells in one row of the goal that require a certain class of
+ * block.
+ */
+typedef	struct goalrow {
+    short	goalclass;		/* the equivalency class required */
+    short	y;			/* the row */
+    bitrow	bits;			/* the cells within the row */
+} goalrow;
+
+/* The unchanging data needed to search a single puzzle. Positions are
+ * stored in a packed format: the location of each block's anchor
+ * (the top-left corner of its bounding box), in one or two bytes
+ * depending on the size of the map, followed by a bit for each door
+ * indicating whether or not it has been opened. Blocks that are
+ * identical in shape and in their goal requirements are always stored
+ * in increasing order, so that equivalent positions pack identically.
+ */
+typedef	struct searchinfo {
+    short	ysize;			/* height of the puzzle's map */
+    short	xsize;			/* width of the puzzle's map */
+    short	blockcount;		/* number of movable blocks */
+    short	doorcount;		/* number of door cells */
+    short	keyblock;		/* index of the key block, or -1 */
+    short	possize;		/* bytes used to store one location */
+    short	statesize;		/* bytes used to store one position */
+    short	goalcount;		/* number of entries in goals */
+    short	innerwidth;		/* width of the map's interior */
+    searchblock	blocks[SEARCHMAXBLOCKS]; /* the movable blocks */
+    short	cells[SEARCHMAXHEIGHT * SEARCHXSIZE];
+					/* anchor offsets of block cells */
+    bitrow	shapes[SEARCHMAXHEIGHT * SEARCHXSIZE];
+					/* bitboards of block shapes */
+    bitrow	walls[SEARCHMAXHEIGHT];	/* bitboard of the walls */
+    bitrow	doorrows[SEARCHMAXHEIGHT]; /* bitboard of the door cells */
+    short	doors[MAXSEARCHDOORS];	/* location of each door cell */
+    goalrow	goals[SEARCHMAXHEIGHT * SEARCHXSIZE];
+					/* the goal's requirements */
+    unsigned char start[MAXSTATESIZE];	/* the packed starting position */
+    cell	map[SEARCHMAXHEIGHT * SEARCHXSIZE];
+					/* the puzzle's starting map */
+} searchinfo;
+
+/* The results of exploring a puzzle's positions.
+ */
+typedef	struct searchstats {
+    long	statecount;		/* total number of positions found */
+    long	goalcount;		/* number of positions that are solved */
+    int		firstgoal;		/* steps to nearest solution, or -1 */
+    int		depth;			/* number of entries in layers */
+    long       *layers;			/* number of positions at each step */
+    int		error;			/* errno of a file error, or zero */
+} searchstats;
+
+/* A function called for each position that is one step away from a
+ * given position. state is the packed position, block is the index
+ * of the block that moved, and dir is the direction of the step's
+ * first move.
+ */
+typedef	void (*successorfunc)(unsigned char const *state,
+			      int block, int dir, void *data);
+
+/* Initialize info for searching game. FALSE is returned if the puzzle
+ * is too large, or has too many blocks or doors, to be searched.
+ */
+extern int initsearch(searchinfo *info, gamesetup const *game);
+
+/* Pack the position shown in map into state.
+ */
+extern void packstate(searchinfo const *info, cell const *map,
+		      unsigned char *state);
+
+/* Draw the packed position into map, as a map of block IDs. Walls
+ * are copied from the puzzle's starting map, and doors are marked as
+ * closed or open.
+ */
+extern void unpackstate(searchinfo const *info, unsigned char const *state,
+			cell *map);
+
+/* Return TRUE if the packed position solves the puzzle.
+ */
+extern int isgoalstate(searchinfo const *info, unsigned char const *state);
+
+/* Return the map index of the first cell of the given block in the
+ * packed position.
+ */
+extern int getblockcell(searchinfo const *info, unsigned char const *state,
+			int block);
+
+/* Call func once for every position that can be reached from state
+ * in a single step, i.e. by moving one block any number of times.
+ * Each block's possible locations are found with bitboards: one word
+ * per row, so that testing a block against every other block, wall,
+ * and door in a row is a shift and an AND.
+ */
+extern void getsuccessors(searchinfo const *info, unsigned char const *state,
+			  successorfunc func, void *data);
+
+/* Explore every position that can be reached from the puzzle's
+ * starting position, breadth-first. Each layer of the search is kept
+ * in a sorted temporary file created in tmpdir, and duplicates are
+ * removed by merging, so that the amount of memory used is fixed at
+ * about bufsize bytes regardless of the number of positions. Separate
+ * searches may run in separate threads. FALSE is returned if a file
+ * error occurs, in which case the error is stored in stats rather
+ * than reported, so that the caller can report it from its own
+ * thread.
+ */
+extern int exploreondisk(searchinfo const *info, char const *tmpdir,
+			 long bufsize, searchstats *stats);
+
+/* Free the memory allocated in stats.
+ */
+extern void freesearchstats(searchstats *stats);
+
+#endif
@@ -28,6 +28,10 @@ extern int ioinitialize(int silence);
  */
 extern int input(void);
 
+/* Return TRUE if more keystrokes are already waiting to be read.
+ */
+extern int inputpending(void);
+
 /* Ring the bell.
  */
 extern void ding(void);
@@ -628,10 +628,13 @@ int mousecallback(int pos, int button)
 }
 
 /* The main loop, exited only when the user requests to leave the
- * program.
+ * program. Redrawing is put off while more keystrokes are waiting, so
+ * that held-down keys do not leave the display lagging behind.
  */
 static void playgame(void)
 {
+    int	redraw = FALSE;
+
     for (;;) {
 	if (game.state == S_PLAYING) {
 	    if (game.cellcount - game.exposedcount == game.minecount) {
@@ -640,13 +643,20 @@ static void playgame(void)
 		settimer(0);
 		drawgamescreen(!game.peekcount && checkrecord(gettimer()) ?
 						status_besttime : status_won);
+		redraw = FALSE;
+	    }
+	}
+	if (!inputpending()) {
+	    if (redraw) {
+		drawgamescreen(status_normal);
+		redraw = FALSE;
 	    }
+	    if (game.state != S_ENDED)
+		setcursorpos(game.currpos);
 	}
-	if (game.state != S_ENDED)
-	    setcursorpos(game.currpos);
 	switch (doturn()) {
 	  case RET_REDRAW:
-	    drawgamescreen(status_normal);
+	    redraw = TRUE;
 	    break;
 	  case RET_DING:
 	    ding();
@@ -656,6 +666,7 @@ static void playgame(void)
 	    settimer(0);
 	    game.state = S_ENDED;
 	    drawgamescreen(status_lost);
+	    redraw = FALSE;
 	    break;
 	  case RET_QUIT:
 	    settimer(0);
@@ -8,6 +8,7 @@
 #include	<ctype.h>
 #include	<errno.h>
 #include	<unistd.h>
+#include	<sys/ioctl.h>
 #include	<ncurses.h>
 #include	"cmines.h"
 #include	"userio.h"
@@ -346,6 +347,20 @@ int input(void)
     }
 }
 
+/* Return TRUE if keystrokes are waiting to be read. curses reads the
+ * terminal a byte at a time, so the terminal's own queue is checked.
+ */
+int inputpending(void)
+{
+#ifdef FIONREAD
+    int	n;
+
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+#else
+    return FALSE;
+#endif
+}
+
 /*
  * Top-level functions
  */
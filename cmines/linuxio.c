@@ -12,10 +12,13 @@
 #include	<ctype.h>
 #include	<time.h>
 #include	<signal.h>
+#include	<errno.h>
 #include	<unistd.h>
 #include	<termios.h>
-#include	<sys/time.h>
+#include	<poll.h>
 #include	<sys/ioctl.h>
+#include	<sys/signalfd.h>
+#include	<sys/timerfd.h>
 #include	"cmines.h"
 #include	"userio.h"
 
@@ -92,6 +95,20 @@ static Gpm_Event lastgpm;
 #define	ATTR_WHITE	(ATTR_RED | ATTR_GREEN | ATTR_BLUE)
 #define	ATTR_BRIGHT	0x0800
 
+/* The largest number of unchanged cells that are rewritten rather
+ * than skipped over with a cursor movement.
+ */
+#define	MAXREWRITE	4
+
+/* The fewest blank cells that are cleared with a single erase
+ * sequence rather than being written out.
+ */
+#define	MINERASE	8
+
+/* The most bytes that a single call to out() may add to the output.
+ */
+#define	MAXOUTPUT	256
+
 /* Reset and erase the console screen.
  */
 #define	erasescreen()	(write(STDOUT_FILENO, "\033c\033[H\033[J", 8))
@@ -108,6 +125,8 @@ static int const	minecell = '*' | ATTR_RED;
 static int const	boomcell = '*' | ATTR_RED | ATTR_BRIGHT;
 static int const	flagcell = '+' | ATTR_WHITE;
 static int const	badflagcell = 'x' | ATTR_RED | ATTR_BRIGHT;
+static int const	blankcell = ' ' | ATTR_WHITE;
+#define	bordercell(ch)	((ch) | ATTR_WHITE | ATTR_VT100CHAR)
 
 static int const	numbercell[9] = { ' ' | ATTR_WHITE,
 					  '1' | ATTR_BLUE,
@@ -145,6 +164,24 @@ static int		usingmouse = FALSE;
  */
 static int		redrawrequest = FALSE;
 
+/* Keystrokes that have been read but not yet returned by getkey().
+ */
+static unsigned char	inbuf[64];
+static int		inpos = 0;
+static int		incount = 0;
+
+/* A descriptor that receives SIGWINCH, or -1 if the signal is caught
+ * by a handler instead.
+ */
+static int		winchfd = -1;
+
+/* A descriptor that expires on each second while the timer is
+ * running, or -1 if the keyboard is polled once a second instead,
+ * and TRUE if it is currently set to expire.
+ */
+static int		timerfd = -1;
+static int		timerarmed = FALSE;
+
 /* Signal handlers that were installed on startup that may need to be
  * reinstalled.
  */
@@ -179,6 +216,34 @@ static int		showsmileys = FALSE;
  */
 static int		silence = FALSE;
 
+/* The contents of the screen to the left of the timer as of the last
+ * update, the contents being composed for the next one, and their
+ * dimensions. Each cell holds a character and its attributes.
+ */
+static int	       *shownscreen = NULL;
+static int	       *nextscreen = NULL;
+static int		screenlines = 0;
+static int		screencols = 0;
+
+/* FALSE if the screen may not hold what shownscreen says it does.
+ */
+static int		screenshown = FALSE;
+
+/* The attributes currently in effect while updating the screen.
+ */
+static int		outattr = 0;
+
+/* TRUE if the timer is currently visible on the screen.
+ */
+static int		timershown = FALSE;
+
+/* The output waiting to be written to the screen, and the size of
+ * the buffer holding it.
+ */
+static char	       *outbuf = NULL;
+static int		outlen = 0;
+static int		outsize = 0;
+
 /* The name of the program (for use in error messages).
  */
 char const	       *programname = "";
@@ -254,28 +319,52 @@ static int setrawmode(int raw)
     return TRUE;
 }
 
-/* Enqueue characters for output formatted according to fmt. If fmt is
- * NULL, the accumulated characters are flushed to the screen, and the
- * mouse cursor is redrawn immediately afterwards if it was visible.
+/* Make room in the output buffer for n more bytes.
+ */
+static void reserveout(int n)
+{
+    if (outlen + n <= outsize)
+	return;
+    if (!outsize)
+	outsize = 8192;
+    while (outlen + n > outsize)
+	outsize *= 2;
+    if (!(outbuf = realloc(outbuf, outsize)))
+	die("out of memory");
+}
+
+/* Enqueue characters for output formatted according to fmt, which
+ * may produce no more than MAXOUTPUT bytes. If fmt is NULL, the
+ * accumulated characters are flushed to the screen all at once, and
+ * the mouse cursor is redrawn immediately afterwards if it was
+ * visible.
  */
 static void out(char const *fmt, ...)
 {
-    static char	out[8192];
-    static int	size = 0;
     va_list	args;
+    int		n, i;
 
     if (fmt) {
+	reserveout(MAXOUTPUT);
 	va_start(args, fmt);
-	size += vsprintf(out + size, fmt, args);
+	outlen += vsprintf(outbuf + outlen, fmt, args);
 	va_end(args);
-    } else if (size) {
-	write(STDOUT_FILENO, out, size);
-	size = 0;
+    } else if (outlen) {
+	i = 0;
+	while (i < outlen) {
+	    n = write(STDOUT_FILENO, outbuf + i, outlen - i);
+	    if (n > 0)
+		i += n;
+	    else if (errno != EINTR)
+		break;
+	}
+	outlen = 0;
 	drawmousepos();
     }
 }
 
-/* Update the timer display without altering the cursor position.
+/* Update the timer display without altering the cursor position,
+ * erasing it if it has been turned off since it was last shown.
  * Output is flushed whether or not the timer is currently being
  * displayed.
  */
@@ -283,11 +372,150 @@ static void displaytimer(void)
 {
     if (starttime > 0)
 	timer = time(NULL) - starttime;
-    if (starttime >= 0)
+    if (starttime >= 0) {
 	out("\033[s\033[1;%dH%7d\033[u", timercolumn, timer);
+	timershown = TRUE;
+    } else if (timershown) {
+	out("\033[s\033[1;%dH%7s\033[u", timercolumn, "");
+	timershown = FALSE;
+    }
     out(NULL);
 }
 
+/* Begin composing the next update of the screen, starting from a
+ * blank screen of the current size. The columns used by the timer
+ * are not included.
+ */
+static void startframe(void)
+{
+    int	n, i;
+
+    n = lastline * (timercolumn - 1);
+    if (screenlines != lastline || screencols != timercolumn - 1) {
+	free(shownscreen);
+	free(nextscreen);
+	shownscreen = malloc(n * sizeof *shownscreen);
+	nextscreen = malloc(n * sizeof *nextscreen);
+	if (!shownscreen || !nextscreen)
+	    die("out of memory");
+	screenlines = lastline;
+	screencols = timercolumn - 1;
+	screenshown = FALSE;
+    }
+    for (i = 0 ; i < n ; ++i)
+	nextscreen[i] = blankcell;
+}
+
+/* Add a single cell to the next update at line y and column x.
+ */
+static void framecell(int y, int x, int cell)
+{
+    if (y >= 0 && y < screenlines && x >= 0 && x < screencols)
+	nextscreen[y * screencols + x] = cell;
+}
+
+/* Add characters formatted according to fmt, shown with the
+ * attributes attr, to the next update starting at line y and column
+ * x. Anything that runs past the right edge is dropped.
+ */
+static void frametext(int y, int x, int attr, char const *fmt, ...)
+{
+    char	buf[256];
+    va_list	args;
+    int		i;
+
+    va_start(args, fmt);
+    vsprintf(buf, fmt, args);
+    va_end(args);
+    for (i = 0 ; buf[i] ; ++i)
+	framecell(y, x + i, (unsigned char)buf[i] | attr);
+}
+
+/* Output the character in one cell, changing the character set and
+ * the color first if necessary. A blank looks the same in any of
+ * them.
+ */
+static void outcell(int cell)
+{
+    char	ch;
+
+    ch = (char)(cell & ATTR_CHARACTER);
+    if (ch != ' ') {
+	if ((cell ^ outattr) & ATTR_VT100CHAR)
+	    out("\033(%c", cell & ATTR_VT100CHAR ? '0' : 'B');
+	if ((cell ^ outattr) & ATTR_COLOR)
+	    out("\033[%s;3%cm", cell & ATTR_BRIGHT ? "1" : "22",
+				'0' + COLORVAL(cell));
+	outattr = cell;
+    }
+    reserveout(1);
+    outbuf[outlen++] = ch;
+}
+
+/* Return the number of blank cells at the start of the n cells in
+ * row.
+ */
+static int blankrun(int const *row, int n)
+{
+    int	i;
+
+    for (i = 0 ; i < n && row[i] == blankcell ; ++i) ;
+    return i;
+}
+
+/* Bring the screen up to date with the next update. Only the cells
+ * that differ from the last update are output, each run of them
+ * preceded by a cursor movement, and long stretches of blanks are
+ * erased instead of written out. If the screen's contents are not
+ * known, it is erased and then treated as blank.
+ */
+static void endframe(void)
+{
+    int const  *shown;
+    int const  *next;
+    int		y, x, cx, n, blanks;
+
+    n = screenlines * screencols;
+    out("\033%%@");
+    if (!screenshown) {
+	out("\033[H\033[J");
+	for (x = 0 ; x < n ; ++x)
+	    shownscreen[x] = blankcell;
+	screenshown = TRUE;
+	timershown = FALSE;
+    }
+    outattr = blankcell;
+    for (y = 0 ; y < screenlines ; ++y) {
+	shown = shownscreen + y * screencols;
+	next = nextscreen + y * screencols;
+	cx = -1;
+	for (x = 0 ; x < screencols ; ++x) {
+	    if (next[x] == shown[x])
+		continue;
+	    if (cx < 0 || x - cx > MAXREWRITE)
+		out("\033[%d;%dH", y + 1, x + 1);
+	    else
+		for ( ; cx < x ; ++cx)
+		    outcell(next[cx]);
+	    blanks = blankrun(next + x, screencols - x);
+	    if (blanks >= MINERASE) {
+		out("\033[%dX", blanks);
+		x += blanks - 1;
+		cx = -1;
+	    } else {
+		outcell(next[x]);
+		cx = x + 1;
+	    }
+	}
+    }
+    if (outattr & ATTR_VT100CHAR)
+	out("\033(B");
+    if ((outattr & ATTR_COLOR) != ATTR_WHITE)
+	out("\033[22;39m");
+    out("\033%%G");
+    memcpy(shownscreen, nextscreen, n * sizeof *shownscreen);
+}
+
 /* Display the game state on the console. The field is placed in the
  * upper left corner, and status information appears in the upper
  * right corner.
@@ -296,29 +524,33 @@ void displaygame(cell const *field, int ysize, int xsize,
 		 int minecount, int flagcount, int status)
 {
     cell const *p;
-    int		lastattr;
     int		y, x, ch;
 
-    out("\033[H\033%%@\033[22;39m");
-
     if (ysize + 2 > lastline ||
 			xsize * 2 + (showsmileys ? 11 : 7) > timercolumn) {
-	out("\033(BThe screen is too small to show the game.\033[J");
+	out("\033[H\033[22;39m\033(B"
+	    "The screen is too small to show the game.\033[J");
 	out(NULL);
+	screenshown = FALSE;
+	timershown = FALSE;
 	return;
     }
 
-    out("\033(0lq");
-    for (x = 0 ; x < xsize ; ++x)
-	out("qq");
-    out("k \033(B%-4d", minecount - flagcount);
-    if (showsmileys && status != status_ignore)
-	out("%s", smiley[status]);
-    out("\033[K\n\033(0");
+    startframe();
+    framecell(0, 0, bordercell('l'));
+    framecell(0, xsize * 2 + 2, bordercell('k'));
+    framecell(ysize + 1, 0, bordercell('m'));
+    framecell(ysize + 1, xsize * 2 + 2, bordercell('j'));
+    for (x = 1 ; x <= xsize * 2 + 1 ; ++x) {
+	framecell(0, x, bordercell('q'));
+	framecell(ysize + 1, x, bordercell('q'));
+    }
+    frametext(0, xsize * 2 + 4, ATTR_WHITE, "%-4d%s", minecount - flagcount,
+	      showsmileys && status != status_ignore ? smiley[status] : "");
 
     for (y = 0, p = field ; y < ysize ; ++y, p += XSIZE) {
-	lastattr = ATTR_VT100CHAR | ATTR_WHITE;
-	out("x ");
+	framecell(y + 1, 0, bordercell('x'));
+	framecell(y + 1, xsize * 2 + 2, bordercell('x'));
 	for (x = 0 ; x < xsize ; ++x) {
 	    if (p[x] & MINED) {
 		if (p[x] & FLAGGED)
@@ -333,24 +565,12 @@ void displaygame(cell const *field, int ysize, int xsize,
 		ch = numbercell[p[x] & NEIGHBOR_MASK];
 	    else
 		ch = coveredcell;
-	    if ((ch ^ lastattr) & ATTR_VT100CHAR)
-		out("\033(%c", ch & ATTR_VT100CHAR ? '0' : 'B');
-	    if ((ch ^ lastattr) & ATTR_COLOR)
-		out("\033[%s;3%cm", ch & ATTR_BRIGHT ? "1" : "22",
-				    '0' + COLORVAL(ch));
-	    lastattr = ch;
-	    out("%c ", ch & ATTR_CHARACTER);
+	    framecell(y + 1, x * 2 + 2, ch);
 	}
-	if (!(lastattr & ATTR_VT100CHAR))
-	    out("\033(0");
-	if ((lastattr & ATTR_COLOR) != ATTR_WHITE)
-	    out("\033[22;39m");
-	out("x\033[K\n");
     }
-    out("mq");
-    for (x = 0 ; x < xsize ; ++x)
-	out("qq");
-    out("j \033(B\033%%G\033[J");
+    endframe();
+
+    out("\033[%d;%dH", ysize + 2, xsize * 2 + 5);
     displaytimer();
 }
 
@@ -410,6 +630,8 @@ void displayhelp(int keycount, char const *keys[],
     }
     out("\033[J\033[%d;0HPress any key to return.", lastline);
     out(NULL);
+    screenshown = FALSE;
+    timershown = FALSE;
 }
 
 /* Move the cursor to the given field cell.
@@ -434,43 +656,89 @@ void setcursorpos(int pos)
  * Input functions
  */
 
-/* Read a single character. The keyboard and mouse are polled once a
- * second, with the timer being updated between polls. If
- * redrawrequest has been set to TRUE, reset the display and return a
- * faked Ctrl-L.
+/* Set timerfd to expire on each second, or stop it.
+ */
+static void armtimer(int arm)
+{
+    struct itimerspec	when;
+
+    if (timerfd < 0 || arm == timerarmed)
+	return;
+    when.it_interval.tv_sec = arm ? 1 : 0;
+    when.it_interval.tv_nsec = 0;
+    when.it_value.tv_sec = arm ? time(NULL) + 1 : 0;
+    when.it_value.tv_nsec = 0;
+    timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &when, NULL);
+    timerarmed = arm;
+}
+
+/* Discard the signals waiting in winchfd and arrange for the screen
+ * to be redrawn at its new size.
+ */
+static void resized(void)
+{
+    struct signalfd_siginfo	info;
+
+    while (read(winchfd, &info, sizeof info) > 0) ;
+    redrawrequest = TRUE;
+}
+
+/* Read a single character. The process sleeps in poll() until the
+ * keyboard, the mouse, winchfd, or timerfd has something to say, so
+ * that the timer is updated as each second passes and an idle game
+ * does not wake up at all. Without the mouse, everything waiting to
+ * be read is taken in at once, so that inputpending() can see what
+ * is left. If redrawrequest has been set to TRUE, reset the display
+ * and return a faked Ctrl-L.
  */
 static int getkey(void)
 {
-    struct timeval	waitfor;
-    fd_set		in, empty;
-    int			max;
-    char		ch;
+    struct pollfd	fds[4];
+    char		expired[8];
+    int			ticking, n;
 
     for (;;) {
-	if (starttime > 0 && (updatetimer || !usingmouse))
-	    displaytimer();
-	waitfor.tv_sec = 1;
-	waitfor.tv_usec = 0;
-	FD_ZERO(&in);
-	FD_ZERO(&empty);
-	FD_SET(STDIN_FILENO, &in);
-	if (mousefd >= 0) {
-	    FD_SET(mousefd, &in);
-	    max = (STDIN_FILENO > mousefd ? STDIN_FILENO : mousefd) + 1;
-	    if (select(max, &in, &empty, &empty, &waitfor) > 0)
-		return mousegetchar();
-	} else {
-	    if (select(STDIN_FILENO + 1, &in, &empty, &empty, &waitfor) > 0) {
-		read(STDIN_FILENO, &ch, 1);
-		return ch;
-	    }
-	}
+	if (inpos < incount)
+	    return inbuf[inpos++];
 	if (redrawrequest) {
 	    redrawrequest = FALSE;
 	    erasescreen();
 	    measurescreen();
+	    screenshown = FALSE;
+	    timershown = FALSE;
 	    return '\f';
 	}
+	ticking = starttime > 0 && (updatetimer || !usingmouse);
+	if (ticking)
+	    displaytimer();
+	armtimer(ticking);
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = winchfd;
+	fds[1].events = POLLIN;
+	fds[2].fd = timerfd;
+	fds[2].events = POLLIN;
+	fds[3].fd = mousefd;
+	fds[3].events = POLLIN;
+	if (poll(fds, 4, ticking && timerfd < 0 ? 1000 : -1) < 0) {
+	    if (errno != EINTR)
+		return EOF;
+	    continue;
+	}
+	if (fds[1].revents & POLLIN)
+	    resized();
+	if (fds[2].revents & POLLIN)
+	    read(timerfd, expired, sizeof expired);
+	if (mousefd >= 0 && (fds[0].revents || fds[3].revents))
+	    return mousegetchar();
+	if (fds[0].revents) {
+	    n = read(STDIN_FILENO, inbuf, sizeof inbuf);
+	    if (n > 0) {
+		inpos = 0;
+		incount = n;
+	    } else if (n == 0 || errno != EINTR)
+		return EOF;
+	}
     }
 }
 
@@ -504,9 +772,22 @@ int input(void)
 	    }
 	}
     }
+    if (key == '\f')
+	screenshown = FALSE;
     return key;
 }
 
+/* Return TRUE if keystrokes are waiting to be read.
+ */
+int inputpending(void)
+{
+    int	n;
+
+    if (inpos < incount)
+	return TRUE;
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+}
+
 #ifndef NOMOUSE
 
 /* Handle mouse activity. The screen coordinates are translated into a
@@ -558,6 +839,8 @@ static int startup(void)
     hidelastevent();
 
     erasescreen();
+    screenshown = FALSE;
+    timershown = FALSE;
     return TRUE;
 }
 
@@ -616,6 +899,7 @@ int ioinitialize(int updatetimerflag, int showsmileysflag, int silenceflag,
 		 int allowoffclicksflag)
 {
     struct sigaction	act;
+    sigset_t		mask;
 
     updatetimer = updatetimerflag;
     showsmileys = showsmileysflag;
@@ -633,8 +917,16 @@ int ioinitialize(int updatetimerflag, int showsmileysflag, int silenceflag,
     act.sa_handler = chainandredraw;
     myhandler[SIGTSTP] = act;
     sigaction(SIGTSTP, &act, prevhandler + SIGTSTP);
-    myhandler[SIGWINCH] = act;
-    sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    winchfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (winchfd >= 0)
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+    else {
+	myhandler[SIGWINCH] = act;
+	sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    }
+    timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
 
     act.sa_handler = bailout;
     sigaction(SIGINT, &act, prevhandler + SIGINT);
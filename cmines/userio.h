@@ -31,6 +31,10 @@ extern int ioinitialize(int updatetimerflag, int showsmileyflag,
  */
 extern int input(void);
 
+/* Return TRUE if more keystrokes are already waiting to be read.
+ */
+extern int inputpending(void);
+
 /* Ring the bell.
  */
 extern void ding(void);
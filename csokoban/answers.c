@@ -1,4 +1,4 @@
-/* answers.h: Functions for reading and saving puzzle solutions.
+/* answers.c: Functions for reading and saving puzzle solutions.
  *
  * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
  * License. No warranty. See COPYING for details.
@@ -6,6 +6,8 @@
 
 #include	<stdio.h>
 #include	<stdlib.h>
+#include	<stddef.h>
+#include	<string.h>
 #include	<ctype.h>
 #include	"gen.h"
 #include	"csokoban.h"
@@ -15,6 +17,76 @@
 #include	"play.h"
 #include	"answers.h"
 
+/* The suffix added to the name of an answer file while it is being
+ * rewritten.
+ */
+#define	NEWSUFFIX	".new"
+
+/* The suffix added to the name of an answer file to name its cache in
+ * the save directory.
+ */
+#define	CACHESUFFIX	".bin"
+
+/* The number that begins every answer cache.
+ */
+#define	CACHEMAGIC	0x43534f32L
+
+/* The longest run of identical moves that one byte of the cache can
+ * hold.
+ */
+#define	MAXRUN		32
+
+/* How the entry for a puzzle in the answer cache is to be read.
+ */
+#define	CACHE_TEXT	0	/* the answer file must be read instead */
+#define	CACHE_NONE	1	/* there is no solution */
+#define	CACHE_PARTIAL	2	/* there is one incomplete solution */
+#define	CACHE_ONE	3	/* one solution serves for both */
+#define	CACHE_TWO	4	/* least-moves and least-pushes solutions */
+
+/* The beginning of an answer cache. The cache is only used while the
+ * answer file has the size and modification time recorded here.
+ */
+typedef	struct cacheheader {
+    long		magic;		/* CACHEMAGIC */
+    long		answersize;	/* size of the answer file */
+    long		answertime;	/* modification time of the same */
+    long		count;		/* number of entries */
+    unsigned long	checksum;	/* checksum of the fields above */
+} cacheheader;
+
+/* The entry for one puzzle in the answer cache. The solutions follow
+ * the entries, with each run of up to MAXRUN identical moves stored
+ * in one byte: the move's code in the low three bits, and the length
+ * of the run less one in the rest.
+ */
+typedef	struct cacheentry {
+    long	start;			/* the puzzle's slot in the */
+    long	pos;			/*   answer file */
+    long	end;
+    long	kind;			/* one of the CACHE_ values */
+    long	movecount[2];		/* moves in each solution */
+    long	pushcount[2];		/* pushes in each solution */
+    long	offset;			/* where the solutions begin */
+    long	size[2];		/* bytes taken by each solution */
+    unsigned long checksum;		/* checksum of the entry and its
+					   solutions */
+} cacheentry;
+
+/* A buffer of encoded solutions, used while writing a cache.
+ */
+typedef	struct cachebuf {
+    unsigned char      *data;		/* the buffer */
+    long		size;		/* bytes in use */
+    long		allocated;	/* bytes allocated */
+} cachebuf;
+
+/* The characters for the moves, indexed by their codes. The codes
+ * are the moves' values in a dyxlist, which are also what is stored
+ * in the cache.
+ */
+static char const	movecodes[] = "hjklHJKL";
+
 /* The directory containing the user's solution files.
  */
 char   *savedir = NULL;
@@ -30,7 +102,7 @@ int	savedirchecked = FALSE;
  */
 static int readanswer(FILE *fp, dyxlist *moves, int movecount)
 {
-    dyx	move = { 0, 0 };
+    dyx	move = mkmove(WEST, FALSE);
     int	ch = EOF;
     int	r;
 
@@ -39,14 +111,14 @@ static int readanswer(FILE *fp, dyxlist *moves, int movecount)
 	if (isspace(ch))
 	    continue;
 	switch (ch) {
-	  case 'h':	move.yx = -1;	  move.box = FALSE;	break;
-	  case 'j':	move.yx = +XSIZE; move.box = FALSE;	break;
-	  case 'k':	move.yx = -XSIZE; move.box = FALSE;	break;
-	  case 'l':	move.yx = +1;	  move.box = FALSE;	break;
-	  case 'H':	move.yx = -1;	  move.box = TRUE;	break;
-	  case 'J':	move.yx = +XSIZE; move.box = TRUE;	break;
-	  case 'K':	move.yx = -XSIZE; move.box = TRUE;	break;
-	  case 'L':	move.yx = +1;	  move.box = TRUE;	break;
+	  case 'h':	move = mkmove(WEST, FALSE);	break;
+	  case 'j':	move = mkmove(SOUTH, FALSE);	break;
+	  case 'k':	move = mkmove(NORTH, FALSE);	break;
+	  case 'l':	move = mkmove(EAST, FALSE);	break;
+	  case 'H':	move = mkmove(WEST, TRUE);	break;
+	  case 'J':	move = mkmove(SOUTH, TRUE);	break;
+	  case 'K':	move = mkmove(NORTH, TRUE);	break;
+	  case 'L':	move = mkmove(EAST, TRUE);	break;
 	}
 	moves->list[--movecount] = move;
     }
@@ -70,20 +142,14 @@ static int readanswer(FILE *fp, dyxlist *moves, int movecount)
 static int saveanswer(FILE *fp, dyxlist const *moves, int inc)
 {
     dyx const  *move;
-    int		ch, i;
+    int		i;
 
     move = moves->list + moves->count;
     for (i = 0 ; i < moves->count ; ++i) {
 	if (i && !(i & 63))
 	    fputc('\n', fp);
 	--move;
-	if (move->yx < 0)
-	    ch = move->yx == -1 ? 'h' : 'k';
-	else
-	    ch = move->yx == +1 ? 'l' : 'j';
-	if (move->box)
-	    ch = toupper(ch);
-	fputc(ch, fp);
+	fputc(movecodes[*move & 7], fp);
     }
     if (inc)
 	fwrite(" ...", 1, 4, fp);
@@ -92,35 +158,628 @@ static int saveanswer(FILE *fp, dyxlist const *moves, int inc)
     return TRUE;
 }
 
-/* Read the solutions for game, if any, from the current file
- * position, and store them in game as "redo" lists. The actual move
- * sequences are always preceded by a line of the form "N moves, M
- * pushes", where N and M specify the number of moves and pushes
- * contained in the following sequence. If there are two solutions,
- * the first one uses fewer moves, and the second one uses fewer
- * pushes. If there is only one solution, it is used for both. In the
- * case of no solution, the entry will consist of a single line
- * beginning with a dash. The solutions for each puzzle are separated
- * from each other by blank lines and/or lines beginning with a
- * semicolon (i.e., comments).
+/* Skip over a sequence of movecount moves in fp, as written by
+ * saveanswer(), and the rest of the line it ends on. FALSE is
+ * returned if the file ends first.
  */
-int readanswers(FILE *fp, gamesetup *game)
+static int skipanswer(FILE *fp, int movecount)
 {
-    char	buf[256];
-    int		m, n;
+    int	ch = EOF;
 
-    initmovelist(&game->moveanswer);
-    initmovelist(&game->pushanswer);
-    if (!fp)
+    while (movecount && (ch = fgetc(fp)) != EOF)
+	if (!isspace(ch))
+	    --movecount;
+    if (movecount)
+	return FALSE;
+    while (ch != EOF && ch != '\n')
+	ch = fgetc(fp);
+    return TRUE;
+}
+
+/* Record that the solutions for puzzle number level are stored
+ * between start and end in the answer file, superseding any earlier
+ * entry for the same puzzle.
+ */
+static void setanswerslot(gameseries *series, int level,
+			  long start, long pos, long end)
+{
+    answerslot *slot;
+    int		n;
+
+    if (level >= series->answercount) {
+	for (n = series->answercount ? series->answercount : 16 ;
+	     n <= level ; n *= 2) ;
+	if (!(series->answers = realloc(series->answers,
+					n * sizeof *series->answers)))
+	    memerrexit();
+	for ( ; series->answercount < n ; ++series->answercount)
+	    series->answers[series->answercount].pos = -1;
+    }
+    slot = series->answers + level;
+    if (slot->pos >= 0)
+	series->answerlive -= slot->end - slot->start;
+    slot->start = start;
+    slot->pos = pos;
+    slot->end = end;
+    series->answerlive += end - start;
+}
+
+/*
+ * The answer cache
+ */
+
+/* Return an allocated copy of series's filename with suffix added.
+ */
+static char *suffixedname(gameseries const *series, char const *suffix)
+{
+    char       *name;
+
+    if (!(name = malloc(strlen(series->filename) + strlen(suffix) + 1)))
+	memerrexit();
+    strcpy(name, series->filename);
+    strcat(name, suffix);
+    return name;
+}
+
+/* Compute the Adler-32 checksum of size bytes of data, continuing
+ * from sum, the checksum of whatever came before them. (The sums are
+ * only reduced every 5552 bytes, which is as long as they can go
+ * without overflowing.)
+ */
+static unsigned long checksum(unsigned long sum,
+			      unsigned char const *data, long size)
+{
+    unsigned long	a, b;
+    long		n;
+
+    a = sum & 0xFFFF;
+    b = (sum >> 16) & 0xFFFF;
+    while (size > 0) {
+	n = size < 5552 ? size : 5552;
+	size -= n;
+	while (n--) {
+	    a += *data++;
+	    b += a;
+	}
+	a %= 65521;
+	b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* Compute the checksum of a cache header.
+ */
+static unsigned long headerchecksum(cacheheader const *header)
+{
+    return checksum(1, (unsigned char const*)header,
+		    offsetof(cacheheader, checksum));
+}
+
+/* Compute the checksum of a cache entry, given where its encoded
+ * moves are in memory. Each entry is checked on its own, so that one
+ * entry can be replaced without the rest of the cache being read.
+ */
+static unsigned long entrychecksum(cacheentry const *entry,
+				   unsigned char const *data)
+{
+    return checksum(checksum(1, (unsigned char const*)entry,
+			     offsetof(cacheentry, checksum)),
+		    data, entry->size[0] + entry->size[1]);
+}
+
+/* Append size bytes of data to buf.
+ */
+static void addtocache(cachebuf *buf, unsigned char const *data, long size)
+{
+    if (buf->size + size > buf->allocated) {
+	if (!buf->allocated)
+	    buf->allocated = BUFSIZ;
+	while (buf->size + size > buf->allocated)
+	    buf->allocated *= 2;
+	if (!(buf->data = realloc(buf->data, buf->allocated)))
+	    memerrexit();
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+/* Add a run of identical moves to buf.
+ */
+static void addruntocache(cachebuf *buf, int code, int run)
+{
+    unsigned char	byte;
+
+    byte = (unsigned char)(code | ((run - 1) << 3));
+    addtocache(buf, &byte, 1);
+}
+
+/* Read a sequence of movecount moves from fp, as readanswer() does,
+ * and add them to buf. complete is set to FALSE if the sequence is
+ * marked as incomplete. FALSE is returned if the sequence is cut
+ * short or contains anything unexpected.
+ */
+static int encodeanswer(FILE *fp, cachebuf *buf, int movecount,
+			int *complete)
+{
+    char const *p;
+    int		ch = EOF;
+    int		code, last, run;
+
+    last = -1;
+    run = 0;
+    while (movecount && (ch = fgetc(fp)) != EOF) {
+	if (isspace(ch))
+	    continue;
+	if (!(p = strchr(movecodes, ch)) || !*p)
+	    return FALSE;
+	code = p - movecodes;
+	if (code == last && run < MAXRUN) {
+	    ++run;
+	} else {
+	    if (run)
+		addruntocache(buf, last, run);
+	    last = code;
+	    run = 1;
+	}
+	--movecount;
+    }
+    if (movecount)
+	return FALSE;
+    if (run)
+	addruntocache(buf, last, run);
+
+    *complete = TRUE;
+    while (ch != EOF && ch != '\n') {
+	if (ch == '.')
+	    *complete = FALSE;
+	ch = fgetc(fp);
+    }
+    return TRUE;
+}
+
+/* Read the entry at pos in the answer file, and store it in entry
+ * and buf. Whatever the cache cannot reproduce exactly as
+ * readanswers() would read it is left as CACHE_TEXT.
+ */
+static void encodeentry(FILE *fp, long pos, cacheentry *entry,
+			cachebuf *buf)
+{
+    char	line[256];
+    long	size;
+    int		complete, n, m;
+
+    entry->kind = CACHE_TEXT;
+    entry->offset = buf->size;
+    fseek(fp, pos, SEEK_SET);
+    if (getnline(fp, line, sizeof line) < 0)
+	return;
+    if (*line == '-') {
+	entry->kind = CACHE_NONE;
+	return;
+    }
+    if (sscanf(line, "%d moves, %d pushes", &n, &m) < 2
+			|| !encodeanswer(fp, buf, n, &complete)) {
+	buf->size = entry->offset;
+	return;
+    }
+    entry->movecount[0] = n;
+    entry->pushcount[0] = m;
+    entry->size[0] = buf->size - entry->offset;
+    if (!complete) {
+	entry->kind = CACHE_PARTIAL;
+	return;
+    }
+
+    entry->kind = CACHE_ONE;
+    size = buf->size;
+    if (getnline(fp, line, sizeof line) <= 0
+			|| sscanf(line, "%d moves, %d pushes", &n, &m) < 2
+			|| !encodeanswer(fp, buf, n, &complete) || !complete) {
+	buf->size = size;
+	return;
+    }
+    entry->kind = CACHE_TWO;
+    entry->movecount[1] = n;
+    entry->pushcount[1] = m;
+    entry->size[1] = buf->size - size;
+}
+
+/* Map the cache for series into memory, if its header is intact and
+ * it was made from an answer file of the given size and modification
+ * time. The entries are checked as they are used.
+ */
+static int mapcache(gameseries *series, long size, long mtime)
+{
+    cacheheader const  *header;
+    char const	       *data;
+    char	       *name;
+    long		csize, ctime;
+
+    name = suffixedname(series, CACHESUFFIX);
+    data = mapfileindir(savedir, name, &csize, &ctime);
+    free(name);
+    if (!data)
+	return FALSE;
+    header = (cacheheader const*)data;
+    if (csize < (long)sizeof *header || header->magic != CACHEMAGIC
+		|| header->answersize != size || header->answertime != mtime
+		|| header->count < 0
+		|| header->count > (csize - (long)sizeof *header)
+					/ (long)sizeof(cacheentry)
+		|| header->checksum != headerchecksum(header)) {
+	unmapfile(data, csize);
+	return FALSE;
+    }
+    series->answercache = data;
+    series->answercachesize = csize;
+    return TRUE;
+}
+
+/* Release the cache for series, if it is mapped.
+ */
+static void unmapcache(gameseries *series)
+{
+    if (series->answercache) {
+	unmapfile(series->answercache, series->answercachesize);
+	series->answercache = NULL;
+    }
+}
+
+/* Return the cache's entry for puzzle number level, or NULL if the
+ * cache has none or the entry is damaged.
+ */
+static cacheentry const *cachedentry(gameseries const *series, int level)
+{
+    cacheheader const  *header;
+    cacheentry const   *entry;
+
+    if (!series->answercache)
+	return NULL;
+    header = (cacheheader const*)series->answercache;
+    if (level >= header->count)
+	return NULL;
+    entry = (cacheentry const*)(header + 1) + level;
+    if (entry->offset < 0 || entry->size[0] < 0 || entry->size[1] < 0
+		|| entry->offset + entry->size[0] + entry->size[1]
+					> series->answercachesize
+		|| entry->checksum != entrychecksum(entry,
+				(unsigned char const*)series->answercache
+							+ entry->offset))
+	return NULL;
+    return entry;
+}
+
+/* Expand a solution of movecount moves, stored in the cache at
+ * offset, into moves. FALSE is returned if the solution is shorter
+ * than it should be.
+ */
+static int decodeanswer(gameseries const *series, long offset, long size,
+			dyxlist *moves, int movecount)
+{
+    unsigned char const	       *p;
+    dyx				move;
+    int				run;
+
+    setmovelist(moves, movecount);
+    p = (unsigned char const*)series->answercache + offset;
+    for ( ; size && movecount ; --size, ++p) {
+	move = (dyx)(*p & 7);
+	for (run = (*p >> 3) + 1 ; run && movecount ; --run)
+	    moves->list[--movecount] = move;
+    }
+    if (movecount) {
+	initmovelist(moves);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/* Store the solutions in a cache entry in game, exactly as
+ * readanswers() would from the answer file, and return what it would
+ * return. -1 is returned if the answer file must be read instead.
+ */
+static int readcachedanswers(gameseries const *series,
+			     cacheentry const *entry, gamesetup *game)
+{
+    switch (entry->kind) {
+      case CACHE_NONE:
+	return TRUE;
+      case CACHE_PARTIAL:
+	if (!decodeanswer(series, entry->offset, entry->size[0],
+			  &game->moveanswer, entry->movecount[0]))
+	    return -1;
+	game->movebestcount = 0;
+	game->movebestpushcount = 0;
+	return FALSE;
+      case CACHE_ONE:
+      case CACHE_TWO:
+	if (!decodeanswer(series, entry->offset, entry->size[0],
+			  &game->moveanswer, entry->movecount[0]))
+	    return -1;
+	game->movebestcount = entry->movecount[0];
+	game->movebestpushcount = entry->pushcount[0];
+	if (entry->kind == CACHE_TWO
+		&& decodeanswer(series, entry->offset + entry->size[0],
+				entry->size[1], &game->pushanswer,
+				entry->movecount[1])) {
+	    game->pushbestcount = entry->pushcount[1];
+	    game->pushbestmovecount = entry->movecount[1];
+	} else {
+	    copymovelist(&game->pushanswer, &game->moveanswer);
+	    game->pushbestcount = game->movebestpushcount;
+	    game->pushbestmovecount = game->movebestcount;
+	}
+	return TRUE;
+    }
+    return -1;
+}
+
+/* Write the cache for series, and map it in place of the old one. The
+ * entries are copied from the old cache, save for puzzle number level
+ * and any that the old cache does not hold, which are read from the
+ * answer file. Empty entries are added to leave room for at least as
+ * many more puzzles, so that updatecache() rarely needs to call here.
+ * The cache is written under a temporary name and then renamed, like
+ * the answer file. Failing to write it is not an error; the answer
+ * file will simply be read the next time.
+ */
+static void writecache(gameseries *series, int level)
+{
+    cacheheader		header;
+    cacheentry	       *entries, *entry;
+    cacheentry const   *old;
+    cachebuf		buf;
+    FILE	       *fp;
+    char	       *name, *tmpname;
+    long		size, mtime, offset;
+    int			used, count, i, r;
+
+    if (!getfilestamp(series->answerfp, &size, &mtime)) {
+	unmapcache(series);
+	return;
+    }
+    for (used = series->answercount ; used ; --used)
+	if (series->answers[used - 1].pos >= 0)
+	    break;
+    for (count = 16 ; count < 2 * used ; count *= 2) ;
+    if (!(entries = malloc(count * sizeof *entries)))
+	memerrexit();
+    memset(entries, 0, count * sizeof *entries);
+    buf.data = NULL;
+    buf.size = buf.allocated = 0;
+    for (i = 0, entry = entries ; i < count ; ++i, ++entry) {
+	if (i >= used || series->answers[i].pos < 0) {
+	    entry->pos = -1;
+	    entry->kind = CACHE_NONE;
+	    continue;
+	}
+	entry->start = series->answers[i].start;
+	entry->pos = series->answers[i].pos;
+	entry->end = series->answers[i].end;
+	old = i == level ? NULL : cachedentry(series, i);
+	if (old && old->kind != CACHE_TEXT) {
+	    entry->kind = old->kind;
+	    entry->movecount[0] = old->movecount[0];
+	    entry->movecount[1] = old->movecount[1];
+	    entry->pushcount[0] = old->pushcount[0];
+	    entry->pushcount[1] = old->pushcount[1];
+	    entry->offset = buf.size;
+	    entry->size[0] = old->size[0];
+	    entry->size[1] = old->size[1];
+	    addtocache(&buf, (unsigned char const*)series->answercache
+							+ old->offset,
+			     old->size[0] + old->size[1]);
+	} else
+	    encodeentry(series->answerfp, entry->pos, entry, &buf);
+    }
+    clearerr(series->answerfp);
+
+    offset = sizeof header + count * sizeof *entries;
+    for (i = 0, entry = entries ; i < count ; ++i, ++entry) {
+	entry->offset += offset;
+	entry->checksum = entrychecksum(entry,
+					buf.data + entry->offset - offset);
+    }
+    header.magic = CACHEMAGIC;
+    header.answersize = size;
+    header.answertime = mtime;
+    header.count = count;
+    header.checksum = headerchecksum(&header);
+
+    name = suffixedname(series, CACHESUFFIX);
+    tmpname = suffixedname(series, CACHESUFFIX NEWSUFFIX);
+    r = FALSE;
+    if ((fp = openfileindir(savedir, tmpname, "w"))) {
+	fwrite(&header, sizeof header, 1, fp);
+	fwrite(entries, sizeof *entries, count, fp);
+	if (buf.size)
+	    fwrite(buf.data, 1, buf.size, fp);
+	r = !ferror(fp);
+	if (fclose(fp))
+	    r = FALSE;
+	if (r)
+	    r = renamefileindir(savedir, tmpname, name);
+    }
+    free(tmpname);
+    free(name);
+    free(buf.data);
+    free(entries);
+    unmapcache(series);
+    if (r)
+	mapcache(series, size, mtime);
+}
+
+/* Bring the cache for series up to date after the solutions for puzzle
+ * number level have been appended to the answer file. Only the new
+ * encoded moves, the puzzle's entry and the header are written, so
+ * that the cost does not depend on the size of the series. The moves
+ * being replaced are left in the file until the cache is next written
+ * in full, which happens here only if there is no cache or it has no
+ * entry for the puzzle.
+ */
+static void updatecache(gameseries *series, int level)
+{
+    cacheheader		header;
+    cacheentry		entry;
+    cachebuf		buf;
+    FILE	       *fp;
+    char	       *name;
+    long		size, mtime, end;
+    int			r;
+
+    if (!series->answercache
+		|| level >= ((cacheheader const*)series->answercache)->count) {
+	writecache(series, level);
+	return;
+    }
+    header = *(cacheheader const*)series->answercache;
+    end = series->answercachesize;
+    unmapcache(series);
+    if (!getfilestamp(series->answerfp, &size, &mtime))
+	return;
+
+    memset(&entry, 0, sizeof entry);
+    entry.start = series->answers[level].start;
+    entry.pos = series->answers[level].pos;
+    entry.end = series->answers[level].end;
+    buf.data = NULL;
+    buf.size = buf.allocated = 0;
+    encodeentry(series->answerfp, entry.pos, &entry, &buf);
+    clearerr(series->answerfp);
+    entry.offset += end;
+    entry.checksum = entrychecksum(&entry, buf.data + entry.offset - end);
+    header.answersize = size;
+    header.answertime = mtime;
+    header.checksum = headerchecksum(&header);
+
+    name = suffixedname(series, CACHESUFFIX);
+    r = FALSE;
+    if ((fp = openfileindir(savedir, name, "r+"))) {
+	fseek(fp, end, SEEK_SET);
+	if (buf.size)
+	    fwrite(buf.data, 1, buf.size, fp);
+	fseek(fp, sizeof header + level * sizeof entry, SEEK_SET);
+	fwrite(&entry, sizeof entry, 1, fp);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof header, 1, fp);
+	r = !ferror(fp);
+	if (fclose(fp))
+	    r = FALSE;
+    }
+    free(name);
+    free(buf.data);
+    if (r)
+	mapcache(series, size, mtime);
+}
+
+/* Open the answer file for series, if there is one, and find where
+ * the entry for each puzzle begins. An entry normally belongs to the
+ * puzzle after the one before it, but a comment of the form ";Level
+ * N" assigns the next entry to puzzle N instead. When there is more
+ * than one entry for a puzzle, the last one is used. An entry that
+ * was cut short by the end of the file is ignored.
+ */
+int openanswers(gameseries *series)
+{
+    cacheentry const   *entry;
+    char		buf[256];
+    long		start, pos, mark, size, mtime;
+    int			level, n, m;
+
+    series->answercount = 0;
+    series->answerlive = 0;
+    series->answerfp = NULL;
+    if (!*savedir)
+	return TRUE;
+    series->answerfp = openfileindir(savedir, series->filename, "r");
+    if (!series->answerfp)
 	return TRUE;
+    savedirchecked = TRUE;
+    series->answersreadonly = TRUE;
 
+    if (getfilestamp(series->answerfp, &size, &mtime)
+			&& mapcache(series, size, mtime)) {
+	for (level = 0 ; (entry = cachedentry(series, level)) ; ++level)
+	    if (entry->pos >= 0)
+		setanswerslot(series, level, entry->start, entry->pos,
+			      entry->end);
+	if (level == ((cacheheader const*)series->answercache)->count)
+	    return TRUE;
+	unmapcache(series);
+	series->answercount = 0;
+	series->answerlive = 0;
+    }
+
+    level = 0;
+    start = -1;
     for (;;) {
-	n = getnline(fp, buf, sizeof buf);
-	if (n < 0)
-	    return FALSE;
-	if (*buf != '\n' && *buf != ';')
+	pos = ftell(series->answerfp);
+	if (getnline(series->answerfp, buf, sizeof buf) < 0)
 	    break;
+	if (*buf == ';') {
+	    if (sscanf(buf, ";Level %d", &n) == 1 && n > 0) {
+		level = n - 1;
+		start = pos;
+	    }
+	    continue;
+	}
+	if (*buf == '\n')
+	    continue;
+	if (start < 0)
+	    start = pos;
+	if (*buf != '-' && sscanf(buf, "%d moves, %d pushes", &n, &m) == 2) {
+	    if (!skipanswer(series->answerfp, n))
+		break;
+	    mark = ftell(series->answerfp);
+	    if (getnline(series->answerfp, buf, sizeof buf) > 0
+			&& sscanf(buf, "%d moves, %d pushes", &n, &m) == 2) {
+		if (!skipanswer(series->answerfp, n))
+		    break;
+	    } else
+		fseek(series->answerfp, mark, SEEK_SET);
+	}
+	setanswerslot(series, level, start, pos, ftell(series->answerfp));
+	++level;
+	start = -1;
     }
+    clearerr(series->answerfp);
+    writecache(series, -1);
+    return TRUE;
+}
+
+/* Read the solutions for puzzle number level, if any, from the
+ * answer file, and store them in the puzzle as "redo" lists. The
+ * actual move sequences are always preceded by a line of the form "N
+ * moves, M pushes", where N and M specify the number of moves and
+ * pushes contained in the following sequence. If there are two
+ * solutions, the first one uses fewer moves, and the second one uses
+ * fewer pushes. If there is only one solution, it is used for both.
+ * In the case of no solution, the entry will consist of a single line
+ * beginning with a dash.
+ */
+int readanswers(gameseries *series, int level)
+{
+    cacheentry const   *entry;
+    gamesetup	       *game;
+    FILE	       *fp;
+    char		buf[256];
+    int			m, n;
+
+    game = series->games + level;
+    initmovelist(&game->moveanswer);
+    initmovelist(&game->pushanswer);
+    fp = series->answerfp;
+    if (!fp || level >= series->answercount
+	    || series->answers[level].pos < 0)
+	return TRUE;
+    if ((entry = cachedentry(series, level))
+		&& (n = readcachedanswers(series, entry, game)) >= 0)
+	return n;
+    if (ftell(fp) != series->answers[level].pos)
+	fseek(fp, series->answers[level].pos, SEEK_SET);
+
+    if (getnline(fp, buf, sizeof buf) < 0)
+	return FALSE;
     if (*buf == '-')
 	return TRUE;
 
@@ -147,43 +806,113 @@ int readanswers(FILE *fp, gamesetup *game)
     return TRUE;
 }
 
-/* Write out all the solutions for series. Since each file contains
- * solutions for all the puzzles in one series, saving a new solution
- * requires that the function create the entire file's contents
- * afresh. In the case where only part of the original file has been
- * parsed, the unexamined contents are copied verbatim into a
- * temporary memory buffer, and then appended to the new file.
+/* Write out the solutions for game, as read by readanswers().
  */
-int saveanswers(gameseries *series)
+static void writeanswers(FILE *fp, gamesetup const *game)
 {
-    gamesetup  *game;
-    char       *tbuf = NULL;
-    int		tbufsize = 0;
-    fpos_t	pos;
-    int		i, n;
+    if (!game->moveanswer.count) {
+	fputs("---\n", fp);
+	return;
+    }
+    fprintf(fp, "%d moves, %d pushes\n",
+		game->moveanswer.count, game->movebestpushcount);
+    if (!game->movebestcount) {
+	saveanswer(fp, &game->moveanswer, TRUE);
+	return;
+    }
+    saveanswer(fp, &game->moveanswer, FALSE);
+    if (game->pushbestcount != game->movebestpushcount
+		&& game->pushbestmovecount != game->movebestcount) {
+	fprintf(fp, "%d moves, %d pushes\n",
+		    game->pushanswer.count, game->pushbestcount);
+	saveanswer(fp, &game->pushanswer, FALSE);
+    }
+}
 
-    if (!*savedir)
-	return TRUE;
+/* Rewrite the answer file for series with one entry per puzzle, in
+ * order, leaving out the entries that have since been replaced. The
+ * new file is written under a temporary name and then renamed over
+ * the old one, so that the old file is intact until the new one is
+ * complete.
+ */
+static int compactanswers(gameseries *series)
+{
+    answerslot *slots;
+    FILE       *fp;
+    char       *tmpname;
+    char	buf[BUFSIZ];
+    long	size;
+    int		count, i, n;
 
-    currentfilename = series->filename;
+    for (count = series->answercount ; count ; --count)
+	if (series->answers[count - 1].pos >= 0)
+	    break;
+    tmpname = suffixedname(series, NEWSUFFIX);
+    if (!(slots = malloc(series->answercount * sizeof *slots)))
+	memerrexit();
+    if (!(fp = openfileindir(savedir, tmpname, "w"))) {
+	free(slots);
+	free(tmpname);
+	return FALSE;
+    }
 
-    if (series->answerfp && !series->allanswersread) {
-	n = 0;
-	while (!feof(series->answerfp)) {
-	    if (tbufsize >= n) {
-		n = n ? n * 2 : BUFSIZ;
-		if (!(tbuf = realloc(tbuf, n)))
-		    memerrexit();
-		i = fread(tbuf + tbufsize, 1, n - tbufsize, series->answerfp);
-		if (i <= 0) {
-		    if (i < 0)
-			fileerr(NULL);
+    for (i = 0 ; i < count ; ++i) {
+	slots[i].start = ftell(fp);
+	fprintf(fp, ";Level %d\n", i + 1);
+	slots[i].pos = ftell(fp);
+	if (series->answers[i].pos < 0)
+	    fputs("---\n", fp);
+	else {
+	    fseek(series->answerfp, series->answers[i].pos, SEEK_SET);
+	    size = series->answers[i].end - series->answers[i].pos;
+	    for (n = 0 ; size > 0 ; size -= n) {
+		n = size < (long)sizeof buf ? (int)size : (int)sizeof buf;
+		n = fread(buf, 1, n, series->answerfp);
+		if (n <= 0)
 		    break;
-		}
-		tbufsize += i;
+		fwrite(buf, 1, n, fp);
 	    }
+	    if (n > 0 && buf[n - 1] != '\n')
+		fputc('\n', fp);
 	}
+	slots[i].end = ftell(fp);
+    }
+
+    size = ftell(fp);
+    if (fclose(fp) || ferror(series->answerfp)
+		    || !renamefileindir(savedir, tmpname, series->filename)) {
+	clearerr(series->answerfp);
+	free(slots);
+	free(tmpname);
+	return FALSE;
     }
+    free(tmpname);
+    fclose(series->answerfp);
+    series->answerfp = openfileindir(savedir, series->filename, "a+");
+    for (i = 0 ; i < series->answercount ; ++i)
+	if (series->answers[i].pos < 0)
+	    slots[i].pos = -1;
+    free(series->answers);
+    series->answers = slots;
+    series->answerlive = size;
+    return series->answerfp != NULL;
+}
+
+/* Save the solutions for puzzle number level in series. The new entry
+ * is appended to the answer file, where it replaces any earlier entry
+ * for the same puzzle, so that saving does not depend on the size of
+ * the series. When the replaced entries come to take up more of the
+ * file than the ones still in use, the file is rewritten.
+ */
+int saveanswers(gameseries *series, int level)
+{
+    FILE       *fp;
+    long	start, pos, end;
+
+    if (!*savedir)
+	return TRUE;
+
+    currentfilename = series->filename;
 
     if (!series->answerfp || series->answersreadonly) {
 	if (!savedirchecked) {
@@ -195,47 +924,44 @@ int saveanswers(gameseries *series)
 	}
 	if (series->answerfp)
 	    fclose(series->answerfp);
-	else
-	    series->allanswersread = TRUE;
-	series->answerfp = openfileindir(savedir, series->filename, "w+");
+	series->answerfp = openfileindir(savedir, series->filename, "a+");
 	if (!series->answerfp) {
 	    *savedir = '\0';
 	    return fileerr(NULL);
 	}
+	series->answersreadonly = FALSE;
     }
+    fp = series->answerfp;
 
-    fseek(series->answerfp, 0, SEEK_SET);
-    for (i = 0, game = series->games ; i < series->count ; ++i, ++game) {
-	fprintf(series->answerfp, ";Level %d\n", i + 1);
-	if (!game->moveanswer.count) {
-	    fputs("---\n", series->answerfp);
-	    continue;
-	}
-	fprintf(series->answerfp, "%d moves, %d pushes\n",
-				  game->moveanswer.count,
-				  game->movebestpushcount);
-	if (!game->movebestcount) {
-	    saveanswer(series->answerfp, &game->moveanswer, TRUE);
-	    continue;
-	}
-	saveanswer(series->answerfp, &game->moveanswer, FALSE);
-	if (game->pushbestcount != game->movebestpushcount
-		&& game->pushbestmovecount != game->movebestcount) {
-	    fprintf(series->answerfp, "%d moves, %d pushes\n",
-				      game->pushanswer.count,
-				      game->pushbestcount);
-	    saveanswer(series->answerfp, &game->pushanswer, FALSE);
+    fseek(fp, 0, SEEK_END);
+    start = ftell(fp);
+    if (start > 0) {
+	fseek(fp, -1, SEEK_CUR);
+	if (fgetc(fp) != '\n') {
+	    fseek(fp, 0, SEEK_END);
+	    fputc('\n', fp);
+	    ++start;
 	}
+	fseek(fp, 0, SEEK_END);
     }
-    if (tbufsize) {
-	fgetpos(series->answerfp, &pos);
-	if (*tbuf != ';' && *tbuf != '\n')
-	    fprintf(series->answerfp, ";Level %d\n", i + 1);
-	fwrite(tbuf, 1, tbufsize, series->answerfp);
-	fsetpos(series->answerfp, &pos);
+    fprintf(fp, ";Level %d\n", level + 1);
+    pos = ftell(fp);
+    writeanswers(fp, series->games + level);
+    fflush(fp);
+    end = ftell(fp);
+    if (ferror(fp)) {
+	clearerr(fp);
+	return fileerr(NULL);
     }
-    if (tbuf)
-	free(tbuf);
+    setanswerslot(series, level, start, pos, end);
+
+    if (end - series->answerlive > series->answerlive && end > BUFSIZ) {
+	if (!compactanswers(series))
+	    return fileerr(NULL);
+	writecache(series, level);
+    } else
+	updatecache(series, level);
+    updatecatalog(series);
 
     return TRUE;
 }
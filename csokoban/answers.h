@@ -18,13 +18,17 @@ extern char    *savedir;
  */
 extern int	savedirchecked;
 
-/* Read the solutions for game, if any, from the current file
- * position.
+/* Open the answer file for series, if it exists, and find the
+ * solutions for each puzzle in it.
  */
-extern int readanswers(FILE *fp, gamesetup *game);
+extern int openanswers(gameseries *series);
 
-/* Write out all the solutions for series.
+/* Read the solutions for puzzle number level in series, if any.
  */
-extern int saveanswers(gameseries *series);
+extern int readanswers(gameseries *series, int level);
+
+/* Save the solutions for puzzle number level in series.
+ */
+extern int saveanswers(gameseries *series, int level);
 
 #endif
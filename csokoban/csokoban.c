@@ -15,6 +15,8 @@
 #include	"dirio.h"
 #include	"fileread.h"
 #include	"answers.h"
+#include	"prefetch.h"
+#include	"journal.h"
 #include	"play.h"
 #include	"userio.h"
 
@@ -32,12 +34,13 @@ typedef	struct startupdata {
     int		silence;	/* FALSE if we are allowed to ring the bell */
     int		listseries;	/* TRUE if the files should be displayed */
     int		writeanswer;	/* TRUE if the solution should be displayed */
+    int		cutloops;	/* TRUE if loops should be cut from the moves */
 } startupdata;
 
 /* Online help.
  */
 static char const *yowzitch = 
-	"Usage: csokoban [-hvqlwW] [-D DIR] [-S DIR] [NAME] [-LEVEL]\n"
+	"Usage: csokoban [-hvqlpwW] [-D DIR] [-S DIR] [NAME] [-LEVEL]\n"
 	"   -h  Display this help\n"
 	"   -v  Display version information\n"
 	"   -l  Print out the list of available setup files\n"
@@ -46,6 +49,7 @@ static char const *yowzitch =
 	"   -D  Read setup files from DIR instead of the default\n"
 	"   -S  Save games in DIR instead of the default\n"
 	"   -q  Be quiet; don't ring the bell\n"
+	"   -p  Cut out moves that return to an earlier position\n"
 	"NAME specifies which setup file to read.\n"
 	"LEVEL specifies which level number to start with.\n"
 	"(Press ? during the game for further help.)\n";
@@ -91,6 +95,7 @@ int readlevel(void)
 {
     int	level = currentgame;
 
+    stopprefetch();
     while (level < 0) {
 	if (!currentseries)
 	    return FALSE;
@@ -118,27 +123,34 @@ static void displayserieslist(void)
     int	namewidth;
     int	i, n;
 
+    for (i = 0 ; i < seriescount ; ++i)
+	if (!iscatalogued(serieslist + i)
+			&& !readlevelinseries(serieslist + i, 0))
+	    serieslist[i].levelcount = 0;
+    writecatalog();
+
     namewidth = 0;
     for (i = 0 ; i < seriescount ; ++i) {
-	n = strlen(serieslist[i].filename);
-	if (!readlevelinseries(serieslist + i, 0)) {
-	    *serieslist[i].filename = '\0';
+	if (!serieslist[i].levelcount)
 	    continue;
-	}
-	if (n > 4 && !strcmp(serieslist[i].filename + n - 4, ".txt")) {
+	n = strlen(serieslist[i].filename);
+	if (n > 4 && !strcmp(serieslist[i].filename + n - 4, ".txt"))
 	    n -= 4;
-	    serieslist[i].filename[n] = '\0';
-	}
 	if (n > namewidth)
 	    namewidth = n;
     }
     for (i = 0 ; i < seriescount ; ++i) {
+	if (!serieslist[i].levelcount)
+	    continue;
+	n = strlen(serieslist[i].filename);
+	if (n > 4 && !strcmp(serieslist[i].filename + n - 4, ".txt"))
+	    n -= 4;
 	if (*serieslist[i].name)
-	    printf("%-*.*s  %s\n", namewidth, namewidth,
+	    printf("%-*.*s  %s\n", namewidth, n,
 				   serieslist[i].filename,
 				   serieslist[i].name);
 	else
-	    puts(serieslist[i].filename);
+	    printf("%.*s\n", n, serieslist[i].filename);
     }
 }
 
@@ -175,6 +187,9 @@ static void pickstartinggame(char const *startfile, int startlevel)
 	}
     } else {
 	currentgame = 0;
+	while (currentseries + 1 < seriescount
+			&& isseriessolved(serieslist + currentseries))
+	    ++currentseries;
 	if (!readlevel()) {
 	    if (*startfile)
 		die("Couldn't find any levels in %s.", startfile);
@@ -190,6 +205,38 @@ static void pickstartinggame(char const *startfile, int startlevel)
 	    }
 	}
     }
+    writecatalog();
+}
+
+/* If the previous run left a puzzle unfinished, make it the current
+ * puzzle and return the events that were recorded for it. NULL is
+ * returned if there is no such puzzle, or if it can no longer be
+ * found, in which case the current puzzle is left as it was.
+ */
+static char *pickjournaledgame(void)
+{
+    char       *filename, *events;
+    int		oldseries, oldgame, level, i;
+
+    if (!readjournal(&filename, &level, &events))
+	return NULL;
+    for (i = 0 ; i < seriescount ; ++i)
+	if (!strcmp(serieslist[i].filename, filename))
+	    break;
+    free(filename);
+    if (i < seriescount) {
+	oldseries = currentseries;
+	oldgame = currentgame;
+	currentseries = i;
+	currentgame = level;
+	if (readlevel() && currentseries == i && currentgame == level)
+	    return events;
+	currentseries = oldseries;
+	currentgame = oldgame;
+	readlevel();
+    }
+    free(events);
+    return NULL;
 }
 
 /*
@@ -200,7 +247,9 @@ static void pickstartinggame(char const *startfile, int startlevel)
  */
 static int partialsave(void)
 {
-    return replaceanswers(TRUE) && saveanswers(serieslist + currentseries);
+    stopprefetch();
+    return replaceanswers(TRUE)
+	&& saveanswers(serieslist + currentseries, currentgame);
 }
 
 /* Display information on the various key commands during a game.
@@ -213,6 +262,8 @@ static void drawhelpscreen(void)
 				   "X\0undo eight moves",
 				   "z\0redo undone move",
 				   "Z\0redo eight undone moves",
+				   "[ ]\0undo or redo a tenth of the moves",
+				   "{ }\0undo or redo all of the moves",
 				   "R ^R\0return to starting position",
 				   "s\0save current position",
 				   "r\0restore saved position",
@@ -241,18 +292,22 @@ static int doturn(void)
     }
 
     switch (input()) {
-      case 'k':		newmove(-XSIZE);			break;
-      case 'l':		newmove(+1);				break;
-      case 'j':		newmove(+XSIZE);			break;
-      case 'h':		newmove(-1);				break;
-      case 'K':		while (newmove(-XSIZE)) ;		break;
-      case 'L':		while (newmove(+1)) ;			break;
-      case 'J':		while (newmove(+XSIZE)) ;		break;
-      case 'H':		while (newmove(-1)) ;			break;
+      case 'k':		newmove(NORTH);			break;
+      case 'l':		newmove(EAST);			break;
+      case 'j':		newmove(SOUTH);			break;
+      case 'h':		newmove(WEST);			break;
+      case 'K':		while (newmove(NORTH)) ;	break;
+      case 'L':		while (newmove(EAST)) ;		break;
+      case 'J':		while (newmove(SOUTH)) ;	break;
+      case 'H':		while (newmove(WEST)) ;		break;
       case 'x':		if (!undomove())		ding();	break;
       case 'z':		if (!redomove())		ding();	break;
       case 'X':		if (!undomoves(8))		ding();	break;
       case 'Z':		if (!redomoves(8))		ding();	break;
+      case '[':		if (!seektenths(-1))		ding();	break;
+      case ']':		if (!seektenths(+1))		ding();	break;
+      case '{':		if (!seektenths(-10))		ding();	break;
+      case '}':		if (!seektenths(+10))		ding();	break;
       case 'R':		initgamestate(TRUE);			break;
       case '\022':	initgamestate(FALSE);			break;
       case 's':		savestate();				break;
@@ -294,7 +349,9 @@ static int endinput(int endofsession)
 }
 
 /* Play the current puzzle. Return when the user solves the puzzle or
- * requests a different puzzle.
+ * requests a different puzzle. The screen is not redrawn while more
+ * keystrokes are waiting, so that held-down keys do not leave the
+ * display lagging behind.
  */
 static void playgame(void)
 {
@@ -306,7 +363,10 @@ static void playgame(void)
     index += currentgame;
 
     if (drawscreen(index)) {
+	prefetchlevels(serieslist + currentseries, currentgame);
 	do {
+	    if (!isplaying())
+		flushjournal();
 	    if ((n = doturn())) {
 		currentgame += n;
 		if (readlevel())
@@ -314,11 +374,16 @@ static void playgame(void)
 		currentgame -= n;
 		ding();
 	    }
-	    drawscreen(index);
+	    if (!inputpending() || checkfinished())
+		drawscreen(index);
 	} while (!checkfinished());
 	freesavedstates();
-	if (checkfinished() && replaceanswers(FALSE))
-	    saveanswers(serieslist + currentseries);
+	stopprefetch();
+	if (checkfinished()) {
+	    if (replaceanswers(FALSE))
+		saveanswers(serieslist + currentseries, currentgame);
+	    clearjournal();
+	}
     }
 
     if (!n) {
@@ -359,8 +424,9 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
     start->silence = FALSE;
     start->listseries = FALSE;
     start->writeanswer = FALSE;
+    start->cutloops = FALSE;
 
-    while ((ch = getopt(argc, argv, "0123456789D:S:hlqvWw")) != EOF) {
+    while ((ch = getopt(argc, argv, "0123456789D:S:hlpqvWw")) != EOF) {
 	switch (ch) {
 	  case '0': case '1': case '2': case '3': case '4':
 	  case '5': case '6': case '7': case '8': case '9':
@@ -370,6 +436,7 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
 	  case 'S':	strncpy(savedir, optarg, pathlen - 1);		break;
 	  case 'q':	start->silence = TRUE;				break;
 	  case 'l':	start->listseries = TRUE;			break;
+	  case 'p':	start->cutloops = TRUE;				break;
 	  case 'W':	start->writeanswer = -1;			break;
 	  case 'w':	start->writeanswer = +1;			break;
 	  case 'h':	fputs(yowzitch, stdout); 	exit(EXIT_SUCCESS);
@@ -391,6 +458,7 @@ static void initwithcmdline(int argc, char *argv[], startupdata *start)
 int main(int argc, char *argv[])
 {
     startupdata	start;
+    char       *events;
 
     initwithcmdline(argc, argv, &start);
 
@@ -405,6 +473,9 @@ int main(int argc, char *argv[])
     pickstartinggame(start.filename, start.level);
 
     if (start.writeanswer) {
+	if (!loadlevel(serieslist + currentseries, currentgame))
+	    die("Couldn't read level %d in %s.", currentgame + 1,
+		serieslist[currentseries].filename);
 	selectgame(serieslist[currentseries].games + currentgame, currentgame);
 	initgamestate(start.writeanswer > 0);
 	if (!displaygamesolution())
@@ -415,10 +486,21 @@ int main(int argc, char *argv[])
 
     if (!ioinitialize(start.silence))
 	die("Failed to initialize terminal.");
+    setloopcutting(start.cutloops);
+
+    events = *start.filename || start.level ? NULL : pickjournaledgame();
 
     for (;;) {
+	if (!loadlevel(serieslist + currentseries, currentgame))
+	    die("Couldn't read level %d in %s.", currentgame + 1,
+		serieslist[currentseries].filename);
+	reservelevels(serieslist + currentseries, currentgame + 2);
 	selectgame(serieslist[currentseries].games + currentgame, currentgame);
-	initgamestate(usemoves);
+	startjournal(serieslist[currentseries].filename, currentgame);
+	if (!events || !replayjournal(events))
+	    initgamestate(usemoves);
+	free(events);
+	events = NULL;
 	playgame();
 	if (!readlevel())
 	    break;
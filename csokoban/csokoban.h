@@ -7,14 +7,12 @@
 #ifndef	_csokoban_h_
 #define	_csokoban_h_
 
-/* The maximum dimensions of a puzzle.
+/* The maximum dimensions of a puzzle. Each map is allocated to the
+ * size of its own puzzle, and one row of a map array is as wide as
+ * the puzzle.
  */
-#define	MAXWIDTH	32
-#define	MAXHEIGHT	32
-
-/* The width of one row in a map array.
- */
-#define	XSIZE		MAXWIDTH
+#define	MAXWIDTH	255
+#define	MAXHEIGHT	255
 
 /* An empty cell.
  */
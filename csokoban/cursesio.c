@@ -11,6 +11,7 @@
 #include	<errno.h>
 #include	<ncurses.h>
 #include	<unistd.h>
+#include	<sys/ioctl.h>
 #include	"gen.h"
 #include	"csokoban.h"
 #include	"userio.h"
@@ -115,7 +116,7 @@ int displaygame(cell const *map, int ysize, int xsize,
     }
 
     p = map;
-    for (y = 1, p += XSIZE ; y < ysize - 1 ; ++y, p += XSIZE) {
+    for (y = 1, p += xsize ; y < ysize - 1 ; ++y, p += xsize) {
 	if (y != 1)
 	    addch('\n');
 	for (x = 1 ; x < xsize - 1 ; ++x) {
@@ -235,6 +236,20 @@ int input(void)
     }
 }
 
+/* Return TRUE if keystrokes are waiting to be read. curses reads the
+ * terminal a byte at a time, so the terminal's own queue is checked.
+ */
+int inputpending(void)
+{
+#ifdef FIONREAD
+    int	n;
+
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+#else
+    return FALSE;
+#endif
+}
+
 /*
  * Initialization functions
  */
@@ -11,6 +11,8 @@
 #include	<dirent.h>
 #include	<sys/types.h>
 #include	<sys/stat.h>
+#include	<sys/mman.h>
+#include	<fcntl.h>
 #include	"gen.h"
 #include	"dirio.h"
 
@@ -88,6 +90,47 @@ int finddir(char const *dir)
     return stat(dir, &st) ? mkdir(dir, 0755) == 0 : S_ISDIR(st.st_mode);
 }
 
+/* Store the size and the modification time of an open file.
+ */
+int getfilestamp(FILE *fp, long *size, long *mtime)
+{
+    struct stat	st;
+
+    if (fstat(fileno(fp), &st))
+	return FALSE;
+    *size = (long)st.st_size;
+    *mtime = (long)st.st_mtime;
+    return TRUE;
+}
+
+/* Store the size and the modification time of a file, using dir as
+ * the directory if filename is not a path.
+ */
+int getfilestampindir(char const *dir, char const *filename,
+		      long *size, long *mtime)
+{
+    struct stat	st;
+    char	buf[PATH_MAX + 1];
+    int		n;
+
+    if (!dir || !*dir || strchr(filename, '/'))
+	n = stat(filename, &st);
+    else {
+	n = strlen(dir);
+	if (n + 1 + strlen(filename) > PATH_MAX)
+	    return FALSE;
+	memcpy(buf, dir, n);
+	buf[n++] = '/';
+	strcpy(buf + n, filename);
+	n = stat(buf, &st);
+    }
+    if (n)
+	return FALSE;
+    *size = (long)st.st_size;
+    *mtime = (long)st.st_mtime;
+    return TRUE;
+}
+
 /* Open a file, using dir as the directory if filename is not a path.
  */
 FILE *openfileindir(char const *dir, char const *filename, char const *mode)
@@ -112,6 +155,77 @@ FILE *openfileindir(char const *dir, char const *filename, char const *mode)
     return fp;
 }
 
+/* Rename the file from to to, using dir as the directory of both if
+ * they are not paths.
+ */
+int renamefileindir(char const *dir, char const *from, char const *to)
+{
+    char	frombuf[PATH_MAX + 1];
+    char	tobuf[PATH_MAX + 1];
+    int		n;
+
+    if (!dir || !*dir || strchr(from, '/') || strchr(to, '/'))
+	return rename(from, to) == 0;
+    n = strlen(dir);
+    if (n + 1 + strlen(from) > PATH_MAX || n + 1 + strlen(to) > PATH_MAX) {
+	errno = ENAMETOOLONG;
+	return FALSE;
+    }
+    sprintf(frombuf, "%s/%s", dir, from);
+    sprintf(tobuf, "%s/%s", dir, to);
+    return rename(frombuf, tobuf) == 0;
+}
+
+/* Map a file into memory, using dir as the directory if filename is
+ * not a path. An empty file is given a (non-NULL) empty buffer.
+ */
+char const *mapfileindir(char const *dir, char const *filename,
+			 long *size, long *mtime)
+{
+    static char const	empty[1] = "";
+    struct stat		st;
+    char		buf[PATH_MAX + 1];
+    void	       *data;
+    int			fd, n;
+
+    if (!dir || !*dir || strchr(filename, '/'))
+	fd = open(filename, O_RDONLY);
+    else {
+	n = strlen(dir);
+	if (n + 1 + strlen(filename) > PATH_MAX) {
+	    errno = ENAMETOOLONG;
+	    return NULL;
+	}
+	memcpy(buf, dir, n);
+	buf[n++] = '/';
+	strcpy(buf + n, filename);
+	fd = open(buf, O_RDONLY);
+    }
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &st)) {
+	close(fd);
+	return NULL;
+    }
+    *size = (long)st.st_size;
+    *mtime = (long)st.st_mtime;
+    if (!*size) {
+	close(fd);
+	return empty;
+    }
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return data == MAP_FAILED ? NULL : (char const*)data;
+}
+
+/* Release a file mapped by mapfileindir().
+ */
+void unmapfile(char const *data, long size)
+{
+    if (size)
+	munmap((void*)data, size);
+}
+
 /* Call filecallback once for every file in dir.
  */
 int findfiles(char const *dir, void *data,
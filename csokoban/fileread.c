@@ -20,6 +20,7 @@
 typedef	struct seriesdata {
     gameseries *list;
     int		count;
+    int		allocated;
 } seriesdata;
 
 /* The character representations used in the puzzle files, keyed to
@@ -54,23 +55,80 @@ int getnline(FILE *fp, char *buf, int len)
     return n;
 }
 
-/* Recursively flood-fill an area surrounded by WALLs with an absence
- * of FLOORs.
+/* The suffix added to the name of a puzzle file to name its index in
+ * the save directory.
  */
-static void pullflooring(cell *map, yx pos)
+#define	INDEXSUFFIX	".idx"
+
+/* The name of the catalogue of puzzle files in the save directory.
+ * (The leading dot keeps findfiles() from mistaking it for a puzzle
+ * file when the two directories are the same.)
+ */
+#define	CATALOGNAME	".catalog"
+
+/* The complete list of puzzle files, as recorded in the catalogue.
+ */
+static gameseries      *catalog = NULL;
+static int		catalogcount = 0;
+
+/* TRUE if the catalogue needs to be saved again.
+ */
+static int		catalogchanged = FALSE;
+
+/* The map being read in, with rows MAXWIDTH cells apart. It is
+ * packed into the puzzle's run-length encoding once the puzzle's
+ * dimensions are known.
+ */
+static cell	readbuf[MAXHEIGHT * MAXWIDTH];
+
+/* The longest run of identical cells that one byte of a packed map
+ * can hold. Each byte stores the run's length less one in the upper
+ * four bits, and the cell as it appears in the file in the lower
+ * four.
+ */
+#define	MAXRUN		16
+
+/* Flood-fill an area surrounded by WALLs with an absence of FLOORs,
+ * starting at pos. The cells still to be visited are kept on a stack
+ * of their own, since the area can be as large as the map.
+ */
+static void pullflooring(gamesetup const *game, cell *map, yx pos)
 {
+    static yx  *stack = NULL;
+    static int	allocated = 0;
+    int		w = game->xsize;
+    int		n;
+
     if (map[pos] & WALL)
 	return;
+    if (allocated < game->ysize * w) {
+	allocated = game->ysize * w;
+	if (!(stack = realloc(stack, allocated * sizeof *stack)))
+	    memerrexit();
+    }
     map[pos] &= ~FLOOR;
-    if (pos >= XSIZE && (map[pos - XSIZE] & (WALL | FLOOR)) == FLOOR)
-	pullflooring(map, pos - XSIZE);
-    if (pos <= MAXHEIGHT * MAXWIDTH - XSIZE &&
-			(map[pos + XSIZE] & (WALL | FLOOR)) == FLOOR)
-	pullflooring(map, pos + XSIZE);
-    if (pos % XSIZE > 0 && (map[pos - 1] & (WALL | FLOOR)) == FLOOR)
-	pullflooring(map, pos - 1);
-    if (pos % XSIZE < MAXWIDTH - 1 && (map[pos + 1] & (WALL | FLOOR)) == FLOOR)
-	pullflooring(map, pos + 1);
+    n = 0;
+    stack[n++] = pos;
+    while (n) {
+	pos = stack[--n];
+	if (pos >= w && (map[pos - w] & (WALL | FLOOR)) == FLOOR) {
+	    map[pos - w] &= ~FLOOR;
+	    stack[n++] = pos - w;
+	}
+	if (pos < (game->ysize - 1) * w &&
+			(map[pos + w] & (WALL | FLOOR)) == FLOOR) {
+	    map[pos + w] &= ~FLOOR;
+	    stack[n++] = pos + w;
+	}
+	if (pos % w > 0 && (map[pos - 1] & (WALL | FLOOR)) == FLOOR) {
+	    map[pos - 1] &= ~FLOOR;
+	    stack[n++] = pos - 1;
+	}
+	if (pos % w < w - 1 && (map[pos + 1] & (WALL | FLOOR)) == FLOOR) {
+	    map[pos + 1] &= ~FLOOR;
+	    stack[n++] = pos + 1;
+	}
+    }
 }
 
 /* Add data not explicitly defined in the file's representation.
@@ -80,187 +138,269 @@ static void pullflooring(cell *map, yx pos)
  * that the player is not allowed to leave the map and go walking
  * through the heap).
  */
-static int improvemap(gamesetup *game)
+static void improvemap(gamesetup const *game, cell *map)
 {
-    cell       *map;
-    yx		initpos;
-    int 	y, x;
+    cell       *p;
+    int 	y, x, w;
 
-    initpos = 0;
-    map = game->map;
-    for (y = 0 ; y < game->ysize ; ++y, map += XSIZE) {
-	for (x = 0 ; x < game->xsize ; ++x) {
-	    if (map[x] & WALL)
-		continue;
+    w = game->xsize;
+    for (x = 0 ; x < game->ysize * w ; ++x)
+	if (!(map[x] & WALL))
 	    map[x] |= FLOOR;
-	    if (map[x] & PLAYER) {
-		if (initpos)
-		    return fileerr("multiple players in map");
-		initpos = &map[x] - game->map;
-	    }
+
+    pullflooring(game, map, 0);
+
+    p = map;
+    for (y = 1, p += w ; y < game->ysize - 1 ; ++y, p += w) {
+	for (x = 1 ; x < w - 1 ; ++x) {
+	    if (!(p[x] & WALL))
+		continue;
+	    if (p[x + w] & WALL)
+		p[x + w] |= EXTENDNORTH;
+	    if (p[x - w] & WALL)
+		p[x - w] |= EXTENDSOUTH;
+	    if (p[x + 1] & WALL)
+		p[x + 1] |= EXTENDWEST;
+	    if (p[x - 1] & WALL)
+		p[x - 1] |= EXTENDEAST;
 	}
     }
-    if (!initpos)
-	return fileerr("no player in map");
 
-    pullflooring(game->map, 0);
+    p = map;
+    memset(p, WALL, w);
+    for (y = 1, p += w ; y < game->ysize - 1 ; ++y, p += w)
+	p[0] = p[w - 1] = WALL;
+    memset(p, WALL, w);
+}
 
-    map = game->map;
-    for (y = 1, map += XSIZE ; y < game->ysize - 1 ; ++y, map += XSIZE) {
-	for (x = 1 ; x < game->xsize - 1 ; ++x) {
-	    if (!(map[x] & WALL))
-		continue;
-	    if (map[x + XSIZE] & WALL)
-		map[x + XSIZE] |= EXTENDNORTH;
-	    if (map[x - XSIZE] & WALL)
-		map[x - XSIZE] |= EXTENDSOUTH;
-	    if (map[x + 1] & WALL)
-		map[x + 1] |= EXTENDWEST;
-	    if (map[x - 1] & WALL)
-		map[x - 1] |= EXTENDEAST;
+/* Store the map in readbuf into game in packed form, as a sequence of
+ * runs of identical cells.
+ */
+static void packmap(gamesetup *game)
+{
+    static unsigned char	packbuf[MAXHEIGHT * MAXWIDTH];
+    cell			c, prev;
+    int				y, x, n, run;
+
+    n = 0;
+    run = 0;
+    prev = EMPTY;
+    for (y = 0 ; y < game->ysize ; ++y) {
+	for (x = 0 ; x < game->xsize ; ++x) {
+	    c = readbuf[y * MAXWIDTH + x];
+	    if (run && (c != prev || run == MAXRUN)) {
+		packbuf[n++] = ((run - 1) << 4) | prev;
+		run = 0;
+	    }
+	    prev = c;
+	    ++run;
 	}
     }
+    packbuf[n++] = ((run - 1) << 4) | prev;
 
-    map = game->map;
-    memset(map, WALL, game->xsize);
-    for (y = 1, map += XSIZE ; y < game->ysize - 1 ; ++y, map += XSIZE)
-	map[0] = map[game->xsize - 1] = WALL;
-    memset(map, WALL, game->xsize);
+    if (!(game->packedmap = malloc(n)))
+	memerrexit();
+    memcpy(game->packedmap, packbuf, n);
+    game->packedsize = n;
+}
 
-    return TRUE;
+/* Expand the puzzle's packed map into map.
+ */
+void unpackmap(gamesetup const *game, cell *map)
+{
+    unsigned char const	       *p;
+    int				n;
+
+    for (p = game->packedmap ; p < game->packedmap + game->packedsize ; ++p)
+	for (n = (*p >> 4) + 1 ; n ; --n)
+	    *map++ = *p & 0x0F;
+    improvemap(game, map - game->ysize * game->xsize);
+}
+
+/* Return the line beginning at fb's current position, and advance
+ * the position to the start of the next line. The length of the line,
+ * not counting the newline, is stored in len. The line is not copied
+ * out of the file's buffer, and so is not NUL-terminated. NULL is
+ * returned at the end of the file.
+ */
+static char const *nextline(filebuf *fb, int *len)
+{
+    char const *line, *end;
+
+    if (fb->pos >= fb->size)
+	return NULL;
+    line = fb->data + fb->pos;
+    if ((end = memchr(line, '\n', fb->size - fb->pos))) {
+	*len = end - line;
+	fb->pos += *len + 1;
+    } else {
+	*len = fb->size - fb->pos;
+	fb->pos = fb->size;
+    }
+    return line;
 }
 
-/* Read a single map from the current position of fp and use it to
+/* Copy the len characters at text into name, which can hold size
+ * bytes, without any leading or trailing whitespace.
+ */
+static void copyname(char *name, int size, char const *text, int len)
+{
+    for ( ; len && isspace((unsigned char)*text) ; ++text, --len) ;
+    if (len >= size)
+	len = size - 1;
+    for ( ; len && isspace((unsigned char)text[len - 1]) ; --len) ;
+    memcpy(name, text, len);
+    name[len] = '\0';
+}
+
+/* Read a single map from the current position of fb and use it to
  * initialize the given gamesetup structure. Maps in the file are
  * separated by blank lines and/or lines beginning with a semicolon,
  * equal sign, or single quote. A semicolon appearing inside a line
- * in a map causes the remainder of the line to be ignored.
+ * in a map causes the remainder of the line to be ignored. A map that
+ * is too large is read through to its end before being rejected, so
+ * that its remaining lines are not taken for the next map. If quiet
+ * is TRUE, nothing is displayed, and FALSE is returned as soon as an
+ * error is found.
  */
-static int readlevelmap(FILE *fp, gamesetup *game)
+static int readlevelmap(filebuf *fb, gamesetup *game, int quiet)
 {
-    char	buf[256];
-    char       *p, *q;
-    int		badmap = FALSE;
+    char const *line, *p, *q;
+    cell	c;
+    int		badmap = FALSE, toolarge = FALSE;
     int		y, x, n, ch;
 
     game->name[0] = '\0';
-    memset(game->map, EMPTY, sizeof game->map);
+    free(game->packedmap);
+    game->packedmap = NULL;
+    game->packedsize = 0;
+    memset(readbuf, EMPTY, MAXWIDTH);
     game->xsize = 1;
 
-    for (y = 1 ; y < MAXHEIGHT ; ++y) {
-	ch = fgetc(fp);
-	if (ch == EOF) {
+    for (y = 1 ; ; ++y) {
+	if (y < MAXHEIGHT)
+	    memset(readbuf + y * MAXWIDTH, EMPTY, MAXWIDTH);
+	if (fb->pos >= fb->size) {
 	    if (y > 1)
 		break;
 	    else
 		return FALSE;
-	} else if (ch == '\n' || ch == ';' || ch == '=' || ch == '\'') {
-	    if (y > 1) {
-		ungetc(ch, fp);
+	}
+	ch = fb->data[fb->pos];
+	if (ch == '\n' || ch == ';' || ch == '=' || ch == '\'') {
+	    if (y > 1)
 		break;
-	    }
 	    --y;
-	    if (ch == '\n')
-		continue;
-	    n = getnline(fp, buf, sizeof buf);
-	    if (n < 0)
-		return FALSE;
-	    if (ch == ';' && *buf == ';') {
-		for (x = 1 ; isspace(buf[x]) ; ++x) ;
-		n -= x;
-		if (n >= (int)(sizeof game->name))
-		    n = sizeof game->name - 1;
-		memcpy(game->name, buf + x, n);
-		for (--n ; isspace(game->name[n]) ; --n) ;
-		game->name[n + 1] = '\0';
-	    }
+	    line = nextline(fb, &n);
+	    if (ch == ';' && n > 1 && line[1] == ';')
+		copyname(game->name, sizeof game->name, line + 2, n - 2);
 	    continue;
 	}
-	buf[0] = ch;
-	getnline(fp, buf + 1, sizeof buf - 1);
-	if (badmap)
+	line = nextline(fb, &n);
+	if (y >= MAXHEIGHT)
+	    toolarge = TRUE;
+	if (badmap || toolarge)
 	    continue;
-	x = 1;
-	p = buf;
-	for ( ; x < MAXWIDTH && *p && *p != '\n' && *p != ';' ; ++x, ++p) {
+	for (x = 1, p = line ; p < line + n && *p && *p != ';' ; ++x, ++p) {
+	    if (x >= MAXWIDTH) {
+		toolarge = TRUE;
+		break;
+	    }
 	    if (*p == '\t') {
 		x |= 7;
 		continue;
 	    }
 	    if (!(q = strchr(filecells, *p))) {
+		if (quiet)
+		    return FALSE;
 		fileerr("unrecognized character in level");
 		badmap = TRUE;
 		break;
 	    }
-	    game->map[y * XSIZE + x] = q - filecells;
+	    readbuf[y * MAXWIDTH + x] = q - filecells;
 	}
-	if (game->xsize <= x) {
+	if (game->xsize <= x)
 	    game->xsize = x + 1;
-	    if (game->xsize > MAXWIDTH)
-		break;
-	}
     }
 
+    if (toolarge || y + 1 > MAXHEIGHT || game->xsize > MAXWIDTH)
+	return quiet ? FALSE
+		     : fileerr("ignoring map which exceeds maximum dimensions");
     game->ysize = y + 1;
-    if (game->ysize > MAXHEIGHT || game->xsize > MAXWIDTH)
-	return fileerr("ignoring map which exceeds maximum dimensions");
-
-    if (!improvemap(game))
-	return FALSE;
 
+    game->start = 0;
     game->boxcount = 0;
     game->goalcount = 0;
     game->storecount = 0;
-    for (n = 0 ; n < game->ysize * XSIZE ; ++n) {
-	if (game->map[n] & PLAYER)
-	    game->start = n;
-	else if (game->map[n] & BOX) {
-	    ++game->boxcount;
-	    if (game->map[n] & GOAL)
-		++game->storecount;
+    for (y = 0 ; y < game->ysize ; ++y) {
+	for (x = 0 ; x < game->xsize ; ++x) {
+	    c = readbuf[y * MAXWIDTH + x];
+	    if (c & PLAYER) {
+		if (game->start)
+		    return quiet ? FALSE : fileerr("multiple players in map");
+		game->start = y * game->xsize + x;
+	    } else if (c & BOX) {
+		++game->boxcount;
+		if (c & GOAL)
+		    ++game->storecount;
+	    }
+	    if (c & GOAL)
+		++game->goalcount;
 	}
-	if (game->map[n] & GOAL)
-	    ++game->goalcount;
     }
+    if (!game->start)
+	return quiet ? FALSE : fileerr("no player in map");
 
+    packmap(game);
+    return TRUE;
+}
+
+/* Map the puzzle file for series into memory, and store its size and
+ * modification time.
+ */
+static int openmapfile(gameseries *series, long *size, long *mtime)
+{
+    series->mapfile.data = mapfileindir(datadir, series->filename,
+					size, mtime);
+    if (!series->mapfile.data)
+	return FALSE;
+    series->mapfile.size = *size;
+    series->mapfile.pos = 0;
     return TRUE;
 }
 
+/* Release the memory holding the puzzle file for series.
+ */
+static void closemapfile(gameseries *series)
+{
+    unmapfile(series->mapfile.data, series->mapfile.size);
+    series->mapfile.data = NULL;
+}
+
 /* Examine the top of the file for series and extract the display
  * string, if present. FALSE is returned if the file appears to be
  * invalid or bereft of maps.
  */
 static int readseriesheader(gameseries *series)
 {
-    char	buf[256];
-    int		ch;
-    int		n;
+    filebuf    *fb = &series->mapfile;
+    char const *line;
+    int		ch, n;
 
-    for (;;) {
-	ch = fgetc(series->mapfp);
-	if (ch == ';') {
-	    getnline(series->mapfp, buf, sizeof buf);
-	    if (*buf == ';') {
-		for (n = 1 ; isspace(buf[n]) ; ++n) ;
-		strncpy(series->name, buf + n, sizeof series->name - 1);
-		series->name[sizeof series->name - 1] = '\0';
-		n = strlen(series->name);
-		for (--n ; isspace(series->name[n]) ; --n) ;
-		series->name[n + 1] = '\0';
-		return TRUE;
-	    }
-	} else if (ch != '\n')
-	    break;
+    while (fb->pos < fb->size) {
+	ch = fb->data[fb->pos];
+	if (ch != ';' && ch != '\n')
+	    return TRUE;
+	line = nextline(fb, &n);
+	if (ch == ';' && n > 1 && line[1] == ';') {
+	    copyname(series->name, sizeof series->name, line + 2, n - 2);
+	    return TRUE;
+	}
     }
 
-    if (ch == EOF) {
-	fclose(series->mapfp);
-	series->mapfp = NULL;
-	series->allmapsread = TRUE;
-	return FALSE;
-    }
-    ungetc(ch, series->mapfp);
-    return TRUE;
+    closemapfile(series);
+    series->allmapsread = TRUE;
+    return FALSE;
 }
 
 /* A callback function that initializes a gameseries structure for
@@ -268,25 +408,35 @@ static int readseriesheader(gameseries *series)
  */
 static int getseriesfile(char *filename, void *data)
 {
-    static int	allocated = 0;
     seriesdata *sdata = (seriesdata*)data;
     gameseries *series;
 
-    while (sdata->count >= allocated) {
-	++allocated;
+    while (sdata->count >= sdata->allocated) {
+	++sdata->allocated;
 	if (!(sdata->list = realloc(sdata->list,
-				    allocated * sizeof *sdata->list)))
+				    sdata->allocated * sizeof *sdata->list)))
 	    memerrexit();
     }
     series = sdata->list + sdata->count++;
     series->filename = filename;
-    series->mapfp = NULL;
+    series->mapfile.data = NULL;
     series->answerfp = NULL;
     series->allmapsread = FALSE;
-    series->allanswersread = FALSE;
+    series->background = FALSE;
+    series->answercount = 0;
+    series->answers = NULL;
+    series->answerlive = 0;
+    series->answercache = NULL;
+    series->answercachesize = 0;
     series->allocated = 0;
     series->count = 0;
     series->games = NULL;
+    series->indexcount = -1;
+    series->index = NULL;
+    series->filesize = series->filetime = -1;
+    series->answersize = series->answertime = -1;
+    series->levelcount = -1;
+    series->solvedcount = -1;
     *series->name = '\0';
     return 1;
 }
@@ -299,40 +449,365 @@ static int gameseriescmp(void const *a, void const *b)
     return strcmp(((gameseries*)a)->filename, ((gameseries*)b)->filename);
 }
 
+/* Read the catalogue saved by a previous run into c. The catalogue
+ * begins with the modification time of the puzzle directory, followed
+ * by one line for each puzzle file, giving the sizes and modification
+ * times of the puzzle file and its answer file, the number of puzzles,
+ * the number of puzzles solved before the first unsolved one, the
+ * filename, and the series's name. TRUE is returned if the directory
+ * has not changed since, in which case the catalogue's list of files
+ * can be used in place of the directory's. Modification times only
+ * count whole seconds, so the directory is not trusted unless its
+ * time is older than the catalogue's own; otherwise a file added in
+ * the second the catalogue was written could go unseen.
+ */
+static int readcatalog(seriesdata *c)
+{
+    FILE       *fp;
+    gameseries *series;
+    char	buf[512];
+    char       *filename, *name;
+    long	dirtime, cattime, size, mtime;
+    int		n;
+
+    if (!*savedir || !(fp = openfileindir(savedir, CATALOGNAME, "r")))
+	return FALSE;
+    if (!getfilestamp(fp, &size, &cattime)
+			|| getnline(fp, buf, sizeof buf) < 0
+			|| sscanf(buf, "%ld", &dirtime) != 1) {
+	fclose(fp);
+	return FALSE;
+    }
+    while (getnline(fp, buf, sizeof buf) >= 0) {
+	buf[strcspn(buf, "\n")] = '\0';
+	if (!(filename = malloc(strlen(buf) + 1)))
+	    memerrexit();
+	getseriesfile(filename, c);
+	series = c->list + c->count - 1;
+	if (sscanf(buf, "%ld %ld %ld %ld %d %d %n",
+			&series->filesize, &series->filetime,
+			&series->answersize, &series->answertime,
+			&series->levelcount, &series->solvedcount, &n) < 6
+		|| !(name = strchr(buf + n, '\t'))) {
+	    free(filename);
+	    --c->count;
+	    fclose(fp);
+	    return FALSE;
+	}
+	*name++ = '\0';
+	strcpy(filename, buf + n);
+	sprintf(series->name, "%.*s", (int)(sizeof series->name - 1), name);
+    }
+    fclose(fp);
+    return getfilestampindir(datadir, ".", &size, &mtime)
+	&& mtime == dirtime && dirtime < cattime;
+}
+
 /* Search the game file directory and generate an array of gameseries
- * structures corresponding to the puzzle files found there.
+ * structures corresponding to the puzzle files found there. If the
+ * directory has not changed since the catalogue was saved, the
+ * catalogue's list is used instead. Otherwise, whatever the catalogue
+ * knows about the files that are still present is carried over.
  */
 int getseriesfiles(char *filename, gameseries **list, int *count)
 {
-    seriesdata	s;
+    seriesdata	s, c;
+    gameseries *found;
+    int		i;
 
     s.list = NULL;
     s.count = 0;
+    s.allocated = 0;
     if (*filename && isfilename(filename)) {
 	if (getseriesfile(filename, &s) <= 0 || !s.count)
 	    die("Couldn't access \"%s\"", filename);
 	*datadir = '\0';
 	*savedir = '\0';
     } else {
-	if (!findfiles(datadir, &s, getseriesfile) || !s.count)
-	    die("Couldn't find any data files in \"%s\".", datadir);
+	c.list = NULL;
+	c.count = 0;
+	c.allocated = 0;
+	if (readcatalog(&c) && c.count) {
+	    s = c;
+	    c.list = NULL;
+	    c.count = 0;
+	} else {
+	    if (!findfiles(datadir, &s, getseriesfile) || !s.count)
+		die("Couldn't find any data files in \"%s\".", datadir);
+	    catalogchanged = TRUE;
+	}
 	if (s.count > 1)
 	    qsort(s.list, s.count, sizeof *s.list, gameseriescmp);
+	if (c.count > 1)
+	    qsort(c.list, c.count, sizeof *c.list, gameseriescmp);
+	for (i = 0 ; i < c.count ; ++i) {
+	    found = bsearch(c.list + i, s.list, s.count, sizeof *s.list,
+			    gameseriescmp);
+	    if (found) {
+		found->filesize = c.list[i].filesize;
+		found->filetime = c.list[i].filetime;
+		found->answersize = c.list[i].answersize;
+		found->answertime = c.list[i].answertime;
+		found->levelcount = c.list[i].levelcount;
+		found->solvedcount = c.list[i].solvedcount;
+		strcpy(found->name, c.list[i].name);
+	    }
+	    free(c.list[i].filename);
+	}
+	free(c.list);
+	catalog = s.list;
+	catalogcount = s.count;
     }
     *list = s.list;
     *count = s.count;
     return TRUE;
 }
 
+/* Return TRUE if the puzzle file has not changed since series's
+ * catalogue entry was made.
+ */
+int iscatalogued(gameseries const *series)
+{
+    long	size, mtime;
+
+    return series->filesize >= 0
+	&& getfilestampindir(datadir, series->filename, &size, &mtime)
+	&& size == series->filesize && mtime == series->filetime;
+}
+
+/* Return TRUE if the catalogue shows every puzzle in series as
+ * solved, and neither the puzzle file nor the answer file has changed
+ * since.
+ */
+int isseriessolved(gameseries const *series)
+{
+    long	size, mtime;
+
+    return series->levelcount > 0
+	&& series->solvedcount == series->levelcount
+	&& iscatalogued(series)
+	&& getfilestampindir(savedir, series->filename, &size, &mtime)
+	&& size == series->answersize && mtime == series->answertime;
+}
+
+/* Bring series's catalogue entry up to date with what has been read
+ * of the series so far. The count of solved puzzles is only changed
+ * when the first unsolved puzzle has been read, or all of them have.
+ */
+static void refreshcatalog(gameseries *series)
+{
+    long	size, mtime;
+    int		n;
+
+    n = series->levelcount;
+    if (series->indexcount >= 0)
+	n = series->indexcount;
+    else if (series->allmapsread)
+	n = series->count;
+    if (n != series->levelcount) {
+	series->levelcount = n;
+	catalogchanged = TRUE;
+    }
+    for (n = 0 ; n < series->count && series->games[n].movebestcount ; ++n) ;
+    if (n < series->count || n == series->levelcount) {
+	if (n != series->solvedcount) {
+	    series->solvedcount = n;
+	    catalogchanged = TRUE;
+	}
+    } else if (series->solvedcount < n && series->solvedcount >= 0) {
+	series->solvedcount = -1;
+	catalogchanged = TRUE;
+    }
+    if (!series->answerfp
+		|| !getfilestamp(series->answerfp, &size, &mtime))
+	size = mtime = -1;
+    if (size != series->answersize || mtime != series->answertime) {
+	series->answersize = size;
+	series->answertime = mtime;
+	catalogchanged = TRUE;
+    }
+}
+
+/* Update series's catalogue entry and save the catalogue.
+ */
+void updatecatalog(gameseries *series)
+{
+    refreshcatalog(series);
+    writecatalog();
+}
+
+/* Save the catalogue in the save directory. The file is created
+ * before the puzzle directory's modification time is looked up, so
+ * that creating it does not make it out of date when the two
+ * directories are the same.
+ */
+void writecatalog(void)
+{
+    FILE       *fp;
+    gameseries *series;
+    long	size, mtime;
+    int		i;
+
+    if (!catalogchanged || !*savedir || !catalogcount)
+	return;
+    for (i = 0, series = catalog ; i < catalogcount ; ++i, ++series)
+	if (strpbrk(series->filename, "\t\n"))
+	    return;
+    if (!savedirchecked) {
+	savedirchecked = TRUE;
+	if (!finddir(savedir))
+	    return;
+    }
+    if (!(fp = openfileindir(savedir, CATALOGNAME, "w")))
+	return;
+    if (getfilestampindir(datadir, ".", &size, &mtime)) {
+	fprintf(fp, "%ld\n", mtime);
+	for (i = 0, series = catalog ; i < catalogcount ; ++i, ++series)
+	    fprintf(fp, "%ld %ld %ld %ld %d %d %s\t%s\n",
+			series->filesize, series->filetime,
+			series->answersize, series->answertime,
+			series->levelcount, series->solvedcount,
+			series->filename, series->name);
+    }
+    fclose(fp);
+    catalogchanged = FALSE;
+}
+
+/* Open the index file for series in the save directory.
+ */
+static FILE *openindexfile(gameseries const *series, char const *mode)
+{
+    FILE       *fp;
+    char       *name;
+
+    if (!(name = malloc(strlen(series->filename) + sizeof INDEXSUFFIX)))
+	memerrexit();
+    strcpy(name, series->filename);
+    strcat(name, INDEXSUFFIX);
+    fp = openfileindir(savedir, name, mode);
+    free(name);
+    return fp;
+}
+
+/* Read the index for series saved by a previous run. FALSE is
+ * returned if there is no index, or if the puzzle file's size or
+ * modification time no longer matches the one that was indexed.
+ */
+static int readindex(gameseries *series, long size, long mtime)
+{
+    FILE       *fp;
+    long	isize, imtime;
+    int		count, ysize, xsize, n;
+
+    if (!(fp = openindexfile(series, "r")))
+	return FALSE;
+    if (fscanf(fp, "%ld %ld %d", &isize, &imtime, &count) != 3
+			|| isize != size || imtime != mtime || count < 0) {
+	fclose(fp);
+	return FALSE;
+    }
+    if (!(series->index = malloc((count + 1) * sizeof *series->index)))
+	memerrexit();
+    for (n = 0 ; n < count ; ++n) {
+	if (fscanf(fp, "%ld %d %d", &series->index[n].offset,
+				    &ysize, &xsize) != 3)
+	    break;
+	series->index[n].ysize = ysize;
+	series->index[n].xsize = xsize;
+    }
+    fclose(fp);
+    if (n < count) {
+	free(series->index);
+	series->index = NULL;
+	return FALSE;
+    }
+    series->indexcount = count;
+    return TRUE;
+}
+
+/* Build the index for series by reading through every map in the file
+ * once, and save it for future runs. The file is left positioned at
+ * the first map.
+ */
+static void buildindex(gameseries *series, long size, long mtime)
+{
+    gamesetup	scratch;
+    FILE       *fp;
+    long	start, offset;
+    int		allocated, n;
+
+    memset(&scratch, 0, sizeof scratch);
+    start = series->mapfile.pos;
+    allocated = 0;
+    series->indexcount = 0;
+    while (series->mapfile.pos < series->mapfile.size) {
+	offset = series->mapfile.pos;
+	if (!readlevelmap(&series->mapfile, &scratch, FALSE))
+	    continue;
+	if (series->indexcount >= allocated) {
+	    allocated = allocated ? allocated * 2 : 16;
+	    series->index = realloc(series->index,
+				    allocated * sizeof *series->index);
+	    if (!series->index)
+		memerrexit();
+	}
+	series->index[series->indexcount].offset = offset;
+	series->index[series->indexcount].ysize = scratch.ysize;
+	series->index[series->indexcount].xsize = scratch.xsize;
+	++series->indexcount;
+    }
+    free(scratch.packedmap);
+    series->mapfile.pos = start;
+
+    if (!savedirchecked) {
+	savedirchecked = TRUE;
+	if (!finddir(savedir))
+	    return;
+    }
+    if (!(fp = openindexfile(series, "w")))
+	return;
+    fprintf(fp, "%ld %ld %d\n", size, mtime, series->indexcount);
+    for (n = 0 ; n < series->indexcount ; ++n)
+	fprintf(fp, "%ld %d %d\n", series->index[n].offset,
+				   series->index[n].ysize,
+				   series->index[n].xsize);
+    fclose(fp);
+}
+
+/* Make room in series for at least count puzzles.
+ */
+void reservelevels(gameseries *series, int count)
+{
+    int	n;
+
+    if (count <= series->allocated)
+	return;
+    n = series->allocated ? series->allocated : 16;
+    while (n < count)
+	n *= 2;
+    if (!(series->games = realloc(series->games, n * sizeof *series->games)))
+	memerrexit();
+    memset(series->games + series->allocated, 0,
+	   (n - series->allocated) * sizeof *series->games);
+    series->allocated = n;
+}
+
 /* Read the puzzle file corresponding to series, and the corresponding
  * solutions in the answer file, until at least level maps have been
  * successfully parsed, or the end is reached. The files are opened if
  * they have not been already. No files are opened if the requested
- * level has already been loaded into memory.
+ * level has already been loaded into memory. When the file has an
+ * index in the save directory, only the puzzles' dimensions are taken
+ * from the index, and the maps are left for loadlevel() to read.
+ * While series->background is TRUE, no files are opened and no
+ * errors are displayed: the reading stops at the first map that
+ * cannot be parsed, so that the map is read again, and the error
+ * reported, when the puzzle is requested from the main thread.
  */
 int readlevelinseries(gameseries *series, int level)
 {
-    int	n;
+    gamesetup  *game;
+    long	size, mtime, pos;
 
     if (level < 0)
 	return FALSE;
@@ -340,48 +815,94 @@ int readlevelinseries(gameseries *series, int level)
 	return TRUE;
 
     if (!series->allmapsread) {
-	if (!series->mapfp) {
+	if (!series->mapfile.data) {
+	    if (series->background)
+		return FALSE;
 	    currentfilename = series->filename;
-	    series->mapfp = openfileindir(datadir, series->filename, "r");
-	    if (!series->mapfp)
+	    if (!openmapfile(series, &size, &mtime))
 		return fileerr(NULL);
-	    if (!readseriesheader(series))
+	    if (size != series->filesize || mtime != series->filetime) {
+		series->filesize = size;
+		series->filetime = mtime;
+		series->levelcount = -1;
+		series->solvedcount = -1;
+		catalogchanged = TRUE;
+	    }
+	    if (!readseriesheader(series)) {
+		series->levelcount = 0;
+		catalogchanged = TRUE;
 		return fileerr("file contains no maps");
-	    if (*savedir) {
-		series->answerfp = openfileindir(savedir, 
-						 series->filename, "r");
-		if (series->answerfp) {
-		    savedirchecked = TRUE;
-		    series->answersreadonly = TRUE;
-		}
-	    } else
-		series->answerfp = NULL;
+	    }
+	    openanswers(series);
+	    if (!series->answerfp
+			|| !getfilestamp(series->answerfp, &size, &mtime))
+		size = mtime = -1;
+	    if (size != series->answersize || mtime != series->answertime)
+		series->solvedcount = -1;
+	    if (*savedir && series->filesize >= 0
+			 && !readindex(series, series->filesize,
+				       series->filetime))
+		buildindex(series, series->filesize, series->filetime);
 	}
 	while (!series->allmapsread && series->count <= level) {
-	    while (series->count >= series->allocated) {
-		n = series->allocated ? series->allocated * 2 : 16;
-		if (!(series->games = realloc(series->games,
-					      n * sizeof *series->games)))
-		    memerrexit();
-		memset(series->games + series->allocated, 0,
-		       (n - series->allocated) * sizeof *series->games);
-		series->allocated = n;
+	    if (series->count == series->indexcount) {
+		closemapfile(series);
+		series->allmapsread = TRUE;
+		break;
+	    }
+	    reservelevels(series, series->count + 1);
+	    game = series->games + series->count;
+	    pos = series->mapfile.pos;
+	    if (series->indexcount >= 0) {
+		game->ysize = series->index[series->count].ysize;
+		game->xsize = series->index[series->count].xsize;
+	    } else if (!readlevelmap(&series->mapfile, game,
+				     series->background)) {
+		if (series->background) {
+		    series->mapfile.pos = pos;
+		    break;
+		}
+		game = NULL;
 	    }
-	    if (readlevelmap(series->mapfp, series->games + series->count)) {
-		series->games[series->count].seriesname = series->name;
-		if (!series->allanswersread)
-		    readanswers(series->answerfp,
-				series->games + series->count);
+	    if (game) {
+		game->seriesname = series->name;
+		readanswers(series, series->count);
 		++series->count;
 	    }
-	    if (feof(series->mapfp)) {
-		fclose(series->mapfp);
-		series->mapfp = NULL;
+	    if (series->indexcount < 0
+			&& series->mapfile.pos >= series->mapfile.size) {
+		closemapfile(series);
 		series->allmapsread = TRUE;
 	    }
-	    if (series->answerfp && feof(series->answerfp))
-		series->allanswersread = TRUE;
 	}
+	refreshcatalog(series);
     }
     return series->count > level;
 }
+
+/* Read the map of puzzle number level, if it has not been already.
+ * As with readlevelinseries(), nothing is displayed while
+ * series->background is TRUE, and the map is left unread if an error
+ * occurs.
+ */
+int loadlevel(gameseries *series, int level)
+{
+    gamesetup  *game;
+    long	size, mtime;
+
+    if (!readlevelinseries(series, level))
+	return FALSE;
+    game = series->games + level;
+    if (game->packedmap)
+	return TRUE;
+
+    if (!series->background)
+	currentfilename = series->filename;
+    if (!series->mapfile.data && !openmapfile(series, &size, &mtime))
+	return series->background ? FALSE : fileerr(NULL);
+    if (series->index[level].offset >= series->mapfile.size)
+	return series->background ? FALSE
+				  : fileerr("index does not match the file");
+    series->mapfile.pos = series->index[level].offset;
+    return readlevelmap(&series->mapfile, game, series->background);
+}
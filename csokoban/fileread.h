@@ -29,9 +29,36 @@ typedef	struct gamesetup {
     int		level;			/* index of puzzle in series */
     char const *seriesname;		/* pointer to the name of the series */
     char	name[64];		/* name of the puzzle */
-    cell	map[MAXHEIGHT * MAXWIDTH]; /* the map proper */
+    int		packedsize;		/* size of packedmap in bytes */
+    unsigned char *packedmap;		/* the map, run-length encoded */
 } gamesetup;
 
+/* The location of one puzzle in its file, and the puzzle's dimensions.
+ */
+typedef	struct levelindex {
+    long	offset;			/* where the puzzle begins in the file */
+    short	ysize;			/* height of the map */
+    short	xsize;			/* width of the map */
+} levelindex;
+
+/* A file of puzzles mapped into memory, and the position of the
+ * parser within it.
+ */
+typedef	struct filebuf {
+    char const *data;			/* the contents of the file */
+    long	size;			/* the size of the file */
+    long	pos;			/* where the next line begins */
+} filebuf;
+
+/* Where the solutions for one puzzle are in the answer file. A pos
+ * of -1 indicates that the file has nothing for that puzzle.
+ */
+typedef	struct answerslot {
+    long	start;			/* where the entry and its label begin */
+    long	pos;			/* where the solutions themselves begin */
+    long	end;			/* where the entry ends */
+} answerslot;
+
 /* The collection of data maintained for each file of puzzles.
  */
 typedef	struct gameseries {
@@ -39,11 +66,26 @@ typedef	struct gameseries {
     int		count;			/* actual size of array */
     gamesetup  *games;			/* the list of puzzles */
     char       *filename;		/* the name of the files */
-    FILE       *mapfp;			/* the file containing the puzzles */
+    filebuf	mapfile;		/* the file containing the puzzles */
     FILE       *answerfp;		/* the file of the user's solutions */
-    int		allmapsread;		/* TRUE if mapfp has reached EOF */
-    int		allanswersread;		/* TRUE if answerfp has reached EOF */
+    int		allmapsread;		/* TRUE if mapfile has reached EOF */
+    int		background;		/* TRUE while being read by the
+					   prefetch thread */
+    int		answercount;		/* size of answers */
+    answerslot *answers;		/* where each puzzle is in answerfp */
+    long	answerlive;		/* bytes of answerfp still in use */
+    char const *answercache;		/* the answers' cache, if mapped */
+    long	answercachesize;	/* the size of the same */
     int		answersreadonly;	/* TRUE if answerfp is open readonly */
+    int		indexcount;		/* size of index, or -1 if none */
+    levelindex *index;			/* where each puzzle is in mapfile */
+    long	filesize;		/* size of the puzzle file */
+    long	filetime;		/* modification time of the same */
+    long	answersize;		/* size of the answer file */
+    long	answertime;		/* modification time of the same */
+    int		levelcount;		/* number of puzzles, or -1 if unknown */
+    int		solvedcount;		/* puzzles solved before the first
+					   unsolved one, or -1 if unknown */
     char	name[64];		/* the series's name */
 } gameseries;
 
@@ -63,8 +105,44 @@ extern int getnline(FILE *fp, char *buf, int len);
  */
 extern int getseriesfiles(char *filename, gameseries **list, int *count);
 
-/* Read the given puzzle file up to puzzle number level.
+/* Make room in series for at least count puzzles, so that reading
+ * more of the file will not move the puzzles already in memory.
+ */
+extern void reservelevels(gameseries *series, int count);
+
+/* Read the given puzzle file up to puzzle number level. If the file
+ * has an index, the maps themselves are not read.
  */
 extern int readlevelinseries(gameseries *series, int level);
 
+/* Make sure that the map of puzzle number level has been read,
+ * seeking directly to it if the file has an index.
+ */
+extern int loadlevel(gameseries *series, int level);
+
+/* Return TRUE if the catalogue's record of series is still current,
+ * in which case its name and levelcount can be used without opening
+ * the file.
+ */
+extern int iscatalogued(gameseries const *series);
+
+/* Return TRUE if the catalogue shows every puzzle in series as solved.
+ */
+extern int isseriessolved(gameseries const *series);
+
+/* Update the catalogue's record of series after its solutions have
+ * been saved.
+ */
+extern void updatecatalog(gameseries *series);
+
+/* Save the catalogue of the puzzle files in the save directory, if
+ * anything in it has changed.
+ */
+extern void writecatalog(void);
+
+/* Expand the puzzle's packed map into map, which must have room for
+ * ysize * xsize cells, and add the walls' joins and the floor.
+ */
+extern void unpackmap(gamesetup const *game, cell *map);
+
 #endif
@@ -0,0 +1,227 @@
+/* journal.c: Functions for recording the progress of the current
+ * puzzle as it is made.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	"gen.h"
+#include	"dirio.h"
+#include	"fileread.h"
+#include	"answers.h"
+#include	"journal.h"
+
+/* The name of the journal in the save directory. (The leading dot
+ * keeps findfiles() from mistaking it for a puzzle file when the two
+ * directories are the same.)
+ */
+#define	JOURNALNAME	".journal"
+
+/* The shortest time, in seconds, between two synchronizations of the
+ * journal with the disk, and so about the longest that written events
+ * are left for the system to put on the disk at its leisure.
+ */
+#ifndef SYNCINTERVAL
+#define	SYNCINTERVAL	5
+#endif
+
+/* The journal of the current puzzle, or NULL if nothing is being
+ * recorded.
+ */
+static FILE	       *journalfp = NULL;
+
+/* When the journal was last synchronized with the disk, if that is
+ * done in the main thread.
+ */
+static time_t		lastsync = 0;
+
+/* A duplicate of the journal's descriptor, which the background
+ * thread is to synchronize and close, or -1 if nothing has been
+ * written since the last synchronization began.
+ */
+static int		syncfd = -1;
+
+/* TRUE once the background thread is running, and FALSE for good if
+ * it could not be started.
+ */
+static int		started = FALSE;
+static int		enabled = TRUE;
+
+/* The lock shared by both threads, and the condition the background
+ * thread waits on.
+ */
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wakeup = PTHREAD_COND_INITIALIZER;
+
+/* Read the journal left by a previous run. The first line of the
+ * journal holds the puzzle's index and the name of its file, and the
+ * rest of the journal is the events, in the order they happened. An
+ * empty journal belongs to a puzzle that was finished.
+ */
+int readjournal(char **filename, int *level, char **events)
+{
+    FILE       *fp;
+    char       *buf;
+    int		len, size, n;
+
+    if (!*savedir || !(fp = openfileindir(savedir, JOURNALNAME, "r")))
+	return FALSE;
+    len = getpathbufferlength() + 16;
+    if (!(buf = malloc(len)))
+	memerrexit();
+    if (getnline(fp, buf, len) < 0 || sscanf(buf, "%d %n", level, &n) < 1
+				   || *level < 0) {
+	free(buf);
+	fclose(fp);
+	return FALSE;
+    }
+    buf[n + strcspn(buf + n, "\n")] = '\0';
+    if (!(*filename = malloc(strlen(buf + n) + 1)))
+	memerrexit();
+    strcpy(*filename, buf + n);
+    free(buf);
+
+    size = 0;
+    len = BUFSIZ;
+    if (!(*events = malloc(len)))
+	memerrexit();
+    while ((n = fread(*events + size, 1, len - size - 1, fp)) > 0) {
+	size += n;
+	if (size + 1 == len) {
+	    len *= 2;
+	    if (!(*events = realloc(*events, len)))
+		memerrexit();
+	}
+    }
+    (*events)[size] = '\0';
+    fclose(fp);
+    return TRUE;
+}
+
+/* The background thread. It sleeps until the journal has been written
+ * to, synchronizes it with the disk, and then waits out SYNCINTERVAL
+ * before doing so again, so that the main thread never waits on the
+ * disk and no event is left unsynchronized for much longer than that.
+ */
+static void *syncthread(void *data)
+{
+    int	fd;
+
+    (void)data;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+	while (syncfd < 0)
+	    pthread_cond_wait(&wakeup, &lock);
+	fd = syncfd;
+	syncfd = -1;
+	pthread_mutex_unlock(&lock);
+	fdatasync(fd);
+	close(fd);
+	sleep(SYNCINTERVAL);
+	pthread_mutex_lock(&lock);
+    }
+    return NULL;
+}
+
+/* Ask the background thread to synchronize the journal, starting it
+ * if need be. The thread is given its own descriptor for the file, so
+ * that the journal can be closed without waiting for it. FALSE is
+ * returned if the thread could not be started.
+ */
+static int requestsync(void)
+{
+    pthread_t	thread;
+    int		r;
+
+    pthread_mutex_lock(&lock);
+    if (!started && enabled) {
+	if (pthread_create(&thread, NULL, syncthread, NULL))
+	    enabled = FALSE;
+	else
+	    started = TRUE;
+    }
+    if (started && syncfd < 0) {
+	syncfd = dup(fileno(journalfp));
+	pthread_cond_signal(&wakeup);
+    }
+    r = started;
+    pthread_mutex_unlock(&lock);
+    return r;
+}
+
+/* Truncate the journal and write its first line. The journal is kept
+ * open, and stdio's buffering gathers each turn's events into a
+ * single write.
+ */
+void startjournal(char const *filename, int level)
+{
+    if (journalfp) {
+	fclose(journalfp);
+	journalfp = NULL;
+    }
+    if (!*savedir || strchr(filename, '\n'))
+	return;
+    if (!savedirchecked) {
+	savedirchecked = TRUE;
+	if (!finddir(savedir))
+	    return;
+    }
+    if (!(journalfp = openfileindir(savedir, JOURNALNAME, "w")))
+	return;
+    fprintf(journalfp, "%d %s\n", level, filename);
+    flushjournal();
+}
+
+/* Add an event to the journal's buffer.
+ */
+void addtojournal(char const *event)
+{
+    if (journalfp)
+	fputs(event, journalfp);
+}
+
+/* Write out the buffered events, and have them synchronized with the
+ * disk in the background. If the background thread could not be
+ * started, fdatasync() is called here instead, but only if the last
+ * one was long enough ago, so that a quick succession of moves does
+ * not wait on the disk.
+ */
+void flushjournal(void)
+{
+    time_t	now;
+
+    if (!journalfp)
+	return;
+    if (fflush(journalfp)) {
+	fclose(journalfp);
+	journalfp = NULL;
+	return;
+    }
+    if (requestsync())
+	return;
+    now = time(NULL);
+    if (now - lastsync >= SYNCINTERVAL) {
+	fdatasync(fileno(journalfp));
+	lastsync = now;
+    }
+}
+
+/* Truncate the journal to nothing and stop recording.
+ */
+void clearjournal(void)
+{
+    if (!journalfp)
+	return;
+    fclose(journalfp);
+    journalfp = openfileindir(savedir, JOURNALNAME, "w");
+    if (journalfp) {
+	fclose(journalfp);
+	journalfp = NULL;
+    }
+}
@@ -13,7 +13,9 @@
 #include	<errno.h>
 #include	<unistd.h>
 #include	<termios.h>
+#include	<poll.h>
 #include	<sys/ioctl.h>
+#include	<sys/signalfd.h>
 #include	<linux/kd.h>
 #include	"gen.h"
 #include 	"csokoban.h"
@@ -42,6 +44,26 @@
 #define	DONE_LEVELNAME	0x08
 #define	DONE_ALL	0x0F
 
+/* The largest number of unchanged cells that are rewritten rather
+ * than skipped over with a cursor movement.
+ */
+#define	MAXREWRITE	4
+
+/* The fewest blank cells that are cleared with a single erase
+ * sequence rather than being written out.
+ */
+#define	MINERASE	8
+
+/* The most bytes that a single call to out() may add to the output.
+ */
+#define	MAXOUTPUT	256
+
+/* One character cell of the screen, holding either an ASCII
+ * character or, with FONTCELL set, a character from the console font.
+ */
+typedef	unsigned short	screencell;
+#define	FONTCELL	0x100
+
 /* Given a console font and a character, calculate a pointer to the
  * data for that character.
  */
@@ -126,6 +148,17 @@ static int			usingfont = FALSE;
  */
 static int			redrawrequest = FALSE;
 
+/* Keystrokes that have been read but not yet returned by getkey().
+ */
+static unsigned char		inbuf[64];
+static int			inpos = 0;
+static int			incount = 0;
+
+/* A descriptor that receives SIGWINCH, or -1 if the signal is caught
+ * by a handler instead.
+ */
+static int			winchfd = -1;
+
 /* Signal handlers that were installed on startup that may need to be
  * reinstalled.
  */
@@ -172,6 +205,31 @@ static int			sidebar;
  */
 static int			silence = FALSE;
 
+/* The contents of the screen as of the last update, the contents
+ * being composed for the next one, and their dimensions.
+ */
+static screencell	       *shownscreen = NULL;
+static screencell	       *nextscreen = NULL;
+static int			screenlines = 0;
+static int			screencols = 0;
+
+/* FALSE if the screen may not hold what shownscreen says it does.
+ */
+static int			screenshown = FALSE;
+
+/* The output waiting to be written to the screen, and the size of
+ * the buffer holding it.
+ */
+static char		       *outbuf = NULL;
+static int			outlen = 0;
+static int			outsize = 0;
+
+/* The UTF-8 encodings of the characters in the console font. The
+ * user-defined Unicode area U+F000 to U+F0FF is defined on the Linux
+ * console to map directly to the current font character.
+ */
+static char			fontcodes[256][3];
+
 /* The name of the program and the file currently being accessed,
  * for use in error messages (declared in gen.h).
  */
@@ -410,6 +468,19 @@ static void createfontchars(char *chardata)
     makewalls(chardata);
 }
 
+/* Fill in the UTF-8 encodings of the font characters.
+ */
+static void makefontcodes(void)
+{
+    int	n;
+
+    for (n = 0 ; n < 256 ; ++n) {
+	fontcodes[n][0] = (char)0xEF;
+	fontcodes[n][1] = (char)(0x80 | (n >> 6));
+	fontcodes[n][2] = (char)(0x80 | (n & 0x3F));
+    }
+}
+
 /*
  * Output functions
  */
@@ -457,31 +528,200 @@ static int measurescreen(void)
     return TRUE;
 }
 
-/* Enqueue characters for output formatted according to fmt. If fmt is
- * NULL, the accumulated characters are flushed to the screen. The
- * cursor is always left in the bottom right.
+/* Make room in the output buffer for n more bytes.
+ */
+static void reserveout(int n)
+{
+    if (outlen + n <= outsize)
+	return;
+    if (!outsize)
+	outsize = 8192;
+    while (outlen + n > outsize)
+	outsize *= 2;
+    if (!(outbuf = realloc(outbuf, outsize)))
+	memerrexit();
+}
+
+/* Add n bytes to the output as they are.
+ */
+static void outbytes(char const *bytes, int n)
+{
+    reserveout(n);
+    memcpy(outbuf + outlen, bytes, n);
+    outlen += n;
+}
+
+/* Write out everything in the output buffer at once.
+ */
+static void flushout(void)
+{
+    int	n, i;
+
+    i = 0;
+    while (i < outlen) {
+	n = write(STDOUT_FILENO, outbuf + i, outlen - i);
+	if (n > 0)
+	    i += n;
+	else if (errno != EINTR)
+	    break;
+    }
+    outlen = 0;
+}
+
+/* Enqueue characters for output formatted according to fmt, which
+ * may produce no more than MAXOUTPUT bytes. If fmt is NULL, the
+ * accumulated characters are flushed to the screen. The cursor is
+ * always left in the bottom right.
  */
 static void out(char const *fmt, ...)
 {
-    static char	out[8192];
-    static int	size = 0;
     va_list	args;
 
+    reserveout(MAXOUTPUT);
     if (fmt) {
 	va_start(args, fmt);
-	size += vsprintf(out + size, fmt, args);
+	outlen += vsprintf(outbuf + outlen, fmt, args);
 	va_end(args);
     } else {
-	size += sprintf(out + size, "\033[%d;%dH", lastline,
-						   sidebar + SIDEBARWIDTH);
-	write(STDOUT_FILENO, out, size);
-	size = 0;
+	outlen += sprintf(outbuf + outlen, "\033[%d;%dH", lastline,
+							 sidebar + SIDEBARWIDTH);
+	flushout();
+    }
+}
+
+/* Begin composing the next update of the screen, starting from a
+ * blank screen of the current size.
+ */
+static void startframe(void)
+{
+    int	n, i;
+
+    n = lastline * (sidebar + SIDEBARWIDTH);
+    if (screenlines != lastline || screencols != sidebar + SIDEBARWIDTH) {
+	free(shownscreen);
+	free(nextscreen);
+	shownscreen = malloc(n * sizeof *shownscreen);
+	nextscreen = malloc(n * sizeof *nextscreen);
+	if (!shownscreen || !nextscreen)
+	    memerrexit();
+	screenlines = lastline;
+	screencols = sidebar + SIDEBARWIDTH;
+	screenshown = FALSE;
+    }
+    for (i = 0 ; i < n ; ++i)
+	nextscreen[i] = ' ';
+}
+
+/* Add characters formatted according to fmt to the next update,
+ * starting at line y and column x. Anything that runs past the right
+ * edge is dropped.
+ */
+static void frametext(int y, int x, char const *fmt, ...)
+{
+    char	buf[256];
+    screencell *p;
+    va_list	args;
+    int		i;
+
+    if (y < 0 || y >= screenlines)
+	return;
+    va_start(args, fmt);
+    vsprintf(buf, fmt, args);
+    va_end(args);
+    p = nextscreen + y * screencols;
+    for (i = 0 ; buf[i] && x < screencols ; ++i, ++x)
+	if (x >= 0)
+	    p[x] = (unsigned char)buf[i];
+}
+
+/* Add two characters from the current console font to the next
+ * update, at line y and column x.
+ */
+static void framepair(int y, int x, char const pair[2])
+{
+    screencell *p;
+
+    if (y < 0 || y >= screenlines || x < 0 || x + 1 >= screencols)
+	return;
+    p = nextscreen + y * screencols + x;
+    p[0] = FONTCELL | (unsigned char)pair[0];
+    p[1] = FONTCELL | (unsigned char)pair[1];
+}
+
+/* Output the character in one cell.
+ */
+static void outcell(screencell cell)
+{
+    char	ch;
+
+    if (cell & FONTCELL)
+	outbytes(fontcodes[cell & 0xFF], 3);
+    else {
+	ch = (char)cell;
+	outbytes(&ch, 1);
+    }
+}
+
+/* Return the number of blank cells at the start of the n cells in
+ * row.
+ */
+static int blankrun(screencell const *row, int n)
+{
+    int	i;
+
+    for (i = 0 ; i < n && row[i] == ' ' ; ++i) ;
+    return i;
+}
+
+/* Bring the screen up to date with the next update. Only the cells
+ * that differ from the last update are output, each run of them
+ * preceded by a cursor movement, and long stretches of blanks are
+ * erased instead of written out. If the screen's contents are not
+ * known, it is erased and then treated as blank.
+ */
+static void endframe(void)
+{
+    screencell const   *shown;
+    screencell const   *next;
+    int			y, x, cx, n, blanks;
+
+    n = screenlines * screencols;
+    if (!screenshown) {
+	out("\033[H\033[J");
+	for (x = 0 ; x < n ; ++x)
+	    shownscreen[x] = ' ';
+	screenshown = TRUE;
+    }
+    for (y = 0 ; y < screenlines ; ++y) {
+	shown = shownscreen + y * screencols;
+	next = nextscreen + y * screencols;
+	cx = -1;
+	for (x = 0 ; x < screencols ; ++x) {
+	    if (next[x] == shown[x])
+		continue;
+	    if (cx < 0 || x - cx > MAXREWRITE)
+		out("\033[%d;%dH", y + 1, x + 1);
+	    else
+		for ( ; cx < x ; ++cx)
+		    outcell(next[cx]);
+	    blanks = blankrun(next + x, screencols - x);
+	    if (blanks >= MINERASE) {
+		out("\033[%dX", blanks);
+		x += blanks - 1;
+		cx = -1;
+	    } else {
+		outcell(next[x]);
+		cx = x + 1;
+	    }
+	}
     }
+    memcpy(shownscreen, nextscreen, n * sizeof *shownscreen);
 }
 
-/* Output a single line's worth of a string without breaking up words.
+/* Add a single line's worth of a string to line y of the next update
+ * without breaking up words.
  */
-static int lineout(char const *str, int index)
+static int lineout(int y, char const *str, int index)
 {
     int	n;
 
@@ -490,7 +730,7 @@ static int lineout(char const *str, int index)
     if (str[index]) {
 	n = strlen(str + index);
 	if (n < SIDEBARWIDTH) {
-	    out("%*s", SIDEBARWIDTH, str + index);
+	    frametext(y, sidebar - 2, "%*s", SIDEBARWIDTH, str + index);
 	    index += n;
 	} else {
 	    if (n > SIDEBARWIDTH)
@@ -498,12 +738,13 @@ static int lineout(char const *str, int index)
 	    while (!isspace(str[index + n]) && n >= 0)
 		--n;
 	    if (n < 0) {
-		out("%.*s", SIDEBARWIDTH, str + index);
+		frametext(y, sidebar - 2, "%.*s", SIDEBARWIDTH, str + index);
 		index += SIDEBARWIDTH;
 		while (str[index] && !isspace(str[index]))
 		    ++index;
 	    } else {
-		out("%*.*s", SIDEBARWIDTH, n, str + index);
+		frametext(y, sidebar - 2, "%*.*s", SIDEBARWIDTH, n,
+					  str + index);
 		index += n + 1;
 	    }
 	}
@@ -511,18 +752,6 @@ static int lineout(char const *str, int index)
     return index;
 }
 
-/* Display two characters directly from the current console font. The
- * user-defined Unicode area U+F000 to U+F0FF is defined on the Linux
- * console to map directly to the current font character. The function
- * handles the conversion to UTF-8.
- */
-static void outpair(char const pair[2])
-{
-    out("\xEF%c%c\xEF%c%c",
-	0x80 | ((unsigned char)pair[0] >> 6), 0x80 | (pair[0] & 0x3F),
-	0x80 | ((unsigned char)pair[1] >> 6), 0x80 | (pair[1] & 0x3F));
-}
-
 /* Display the game state on the console. The map is placed in the
  * upper left corner, and the textual information appears in the upper
  * right corner.
@@ -539,69 +768,59 @@ int displaygame(cell const *map, int ysize, int xsize,
     int		nameindex = 0;
     int		y, x;
 
-    out("\033[H");
-
     if (ysize > fieldheight || xsize > fieldwidth) {
-	out("Level %d won't fit on the screen.\033[J", index);
+	out("\033[HLevel %d won't fit on the screen.\033[J", index);
 	out(NULL);
+	screenshown = FALSE;
 	return FALSE;
     }
 
-    p = map;
+    startframe();
     for (y = 1 ; done != DONE_ALL && y <= lastline ; ++y) {
-	p += XSIZE;
-	if (y > 1)
-	    out("\n");
 	if (y < ysize - 1) {
+	    p = map + y * xsize;
 	    for (x = 1 ; x < xsize - 1 ; ++x) {
 		if (p[x] == EMPTY)
-		    out("  ");
+		    continue;
 		else if (p[x] & WALL)
-		    outpair(wallcells[p[x] >> 4]);
+		    framepair(y - 1, x * 2 - 2, wallcells[p[x] >> 4]);
 		else
-		    outpair(screencells[p[x] & 0x0F]);
+		    framepair(y - 1, x * 2 - 2, screencells[p[x] & 0x0F]);
 	    }
-	} else {
-	    x = 1;
+	} else
 	    done |= DONE_MAP;
-	}
 	switch (y) {
 	  case 1:
 	    sprintf(buf, "# %d", index);
-	    out("%*s", sidebar + SIDEBARWIDTH - x * 2, buf);
+	    frametext(0, sidebar - 2, "%*s", SIDEBARWIDTH, buf);
 	    break;
 	  case 2:
-	    out("%*s Boxes: %-3d", sidebar - x * 2, "", boxcount);
-	    if (recording)
-		out("    R");
-	    else if (macro)
-		out("    M");
+	    frametext(1, sidebar - 2, " Boxes: %-3d%s", boxcount,
+		      recording ? "    R" : macro ? "    M" : "");
 	    break;
 	  case 3:
-	    out("%*sStored: %-3d", sidebar - x * 2, "", storecount);
-	    if (save)
-		out("    S");
+	    frametext(2, sidebar - 2, "Stored: %-3d%s", storecount,
+		      save ? "    S" : "");
 	    break;
 	  case 4:
-	    out("%*s Moves: %d", sidebar - x * 2, "", movecount);
+	    frametext(3, sidebar - 2, " Moves: %d", movecount);
 	    break;
 	  case 5:
-	    out("%*sPushes: %d", sidebar - x * 2, "", pushcount);
+	    frametext(4, sidebar - 2, "Pushes: %d", pushcount);
 	    break;
 	  case 6:
-	    if (bestmovecount && bestpushcount) {
-		out("%*s  Best: %d", sidebar - x * 2, "", bestmovecount);
-		if (bestmovecount < 100000)
-		    out(" moves");
-	    }
+	    if (bestmovecount && bestpushcount)
+		frametext(5, sidebar - 2, "  Best: %d%s", bestmovecount,
+			  bestmovecount < 100000 ? " moves" : "");
 	    break;
 	  case 7:
 	    if (bestmovecount && bestpushcount) {
-		out("%*s", sidebar - x * 2, "");
 		if (bestpushcount < 10000)
-		    out("        %d pushes", bestpushcount);
+		    frametext(6, sidebar - 2, "        %d pushes",
+			      bestpushcount);
 		else
-		    out("     %7d pushes", bestpushcount);
+		    frametext(6, sidebar - 2, "     %7d pushes",
+			      bestpushcount);
 	    }
 	    break;
 	  case 8:
@@ -611,16 +830,14 @@ int displaygame(cell const *map, int ysize, int xsize,
 	  default:
 	    if (!(done & DONE_SERIESNAME)) {
 		if (seriesname && seriesname[nameindex]) {
-		    out("%*s", sidebar - x * 2, "");
-		    nameindex = lineout(seriesname, nameindex);
+		    nameindex = lineout(y - 1, seriesname, nameindex);
 		} else {
 		    done |= DONE_SERIESNAME;
 		    nameindex = 0;
 		}
 	    } else if (!(done & DONE_LEVELNAME)) {
 		if (levelname && levelname[nameindex]) {
-		    out("%*s", sidebar - x * 2, "");
-		    nameindex = lineout(levelname, nameindex);
+		    nameindex = lineout(y - 1, levelname, nameindex);
 		} else {
 		    done |= DONE_LEVELNAME;
 		    nameindex = 0;
@@ -628,10 +845,9 @@ int displaygame(cell const *map, int ysize, int xsize,
 	    }
 	    break;
 	}
-	out("\033[K");
     }
+    endframe();
 
-    out("\033[J");
     out(NULL);
     return TRUE;
 }
@@ -673,6 +889,7 @@ void displayhelp(char const *keys[], int keycount)
 
     out("\033[J\n\nPress any key to return.");
     out(NULL);
+    screenshown = FALSE;
 }
 
 /* Display a closing message appropriate to the completion of a
@@ -684,32 +901,67 @@ void displayendmessage(int endofsession)
 	lastline - 1, sidebar + 1, lastline, sidebar + 1,
 	endofsession ? "  to exit" : "to continue");
     out(NULL);
+    screenshown = FALSE;
 }
 
 /*
  * Input functions
  */
 
-/* Read a single character. If redrawrequest has been set to TRUE,
- * reset the display and return a faked Ctrl-L.
+/* Discard the signals waiting in winchfd and arrange for the screen
+ * to be redrawn at its new size. The font is loaded again, in case the
+ * resizing replaced it.
+ */
+static void resized(void)
+{
+    struct signalfd_siginfo	info;
+
+    while (read(winchfd, &info, sizeof info) > 0) ;
+    if (usingfont)
+	setfontdata(newfontdata);
+    redrawrequest = TRUE;
+}
+
+/* Read a single character. The process sleeps in poll() until the
+ * keyboard or winchfd has something to say. Everything waiting to be
+ * read is taken in at once, so that inputpending() can see what is
+ * left. If redrawrequest has been set to TRUE, reset the display and
+ * return a faked Ctrl-L.
  */
 static int getkey(void)
 {
-    unsigned char	in;
+    struct pollfd	fds[2];
     int			n;
 
     for (;;) {
-	n = read(STDIN_FILENO, &in, 1);
-	if (n > 0)
-	    return in;
-	else if (n == 0 || errno != EINTR)
-	    return EOF;
-	else if (redrawrequest) {
+	if (inpos < incount)
+	    return inbuf[inpos++];
+	if (redrawrequest) {
 	    redrawrequest = FALSE;
 	    erasescreen();
 	    measurescreen();
+	    screenshown = FALSE;
 	    return '\f';
 	}
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = winchfd;
+	fds[1].events = POLLIN;
+	if (poll(fds, 2, -1) < 0) {
+	    if (errno != EINTR)
+		return EOF;
+	    continue;
+	}
+	if (fds[1].revents & POLLIN)
+	    resized();
+	if (fds[0].revents) {
+	    n = read(STDIN_FILENO, inbuf, sizeof inbuf);
+	    if (n > 0) {
+		inpos = 0;
+		incount = n;
+	    } else if (n == 0 || errno != EINTR)
+		return EOF;
+	}
     }
 }
 
@@ -742,9 +994,22 @@ int input(void)
 	    }
 	}
     }
+    if (key == '\f')
+	screenshown = FALSE;
     return key;
 }
 
+/* Return TRUE if keystrokes are waiting to be read.
+ */
+int inputpending(void)
+{
+    int	n;
+
+    if (inpos < incount)
+	return TRUE;
+    return !ioctl(STDIN_FILENO, FIONREAD, &n) && n > 0;
+}
+
 /*
  * Top-level functions
  */
@@ -758,6 +1023,7 @@ static int startup(void)
     if (setrawmode(TRUE))
 	return FALSE;
     erasescreen();
+    screenshown = FALSE;
     return TRUE;
 }
 
@@ -816,6 +1082,7 @@ static void bailout(int signum)
 int ioinitialize(int silenceflag)
 {
     struct sigaction	act;
+    sigset_t		mask;
 
     silence = silenceflag;
 
@@ -834,8 +1101,15 @@ int ioinitialize(int silenceflag)
     act.sa_handler = chainandredraw;
     myhandler[SIGTSTP] = act;
     sigaction(SIGTSTP, &act, prevhandler + SIGTSTP);
-    myhandler[SIGWINCH] = act;
-    sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    winchfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (winchfd >= 0)
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+    else {
+	myhandler[SIGWINCH] = act;
+	sigaction(SIGWINCH, &act, prevhandler + SIGWINCH);
+    }
 
     act.sa_handler = bailout;
     sigaction(SIGINT, &act, prevhandler + SIGINT);
@@ -853,6 +1127,7 @@ int ioinitialize(int silenceflag)
 	memerrexit();
     memcpy(newfontdata, origfont.chardata, fullfontsize);
     createfontchars(newfontdata);
+    makefontcodes();
 
     return startup();
 }
@@ -879,6 +1154,7 @@ int fileerr(char const *msg)
     fputs(": ", stderr);
     fputs(msg ? msg : errno ? strerror(errno) : "unknown error", stderr);
     fputc('\n', stderr);
+    screenshown = FALSE;
     return FALSE;
 }
 
@@ -7,14 +7,32 @@
 #ifndef	_movelist_h_
 #define	_movelist_h_
 
-/* A coordinate is stored in a single short as a map array offset.
+/* A coordinate is stored in a single int as a map array offset.
  */
-typedef short	yx;
+typedef int	yx;
 
-/* A move is stored as a delta value plus a boolean indicating if a
- * box was pushed.
+/* The four directions of movement. The values are the same as the
+ * positions of the move letters in "hjkl".
  */
-typedef	struct dyx { int yx:14, box:2; } dyx;
+#define	WEST		0
+#define	SOUTH		1
+#define	NORTH		2
+#define	EAST		3
+
+/* The direction opposite to d.
+ */
+#define	backwards(d)	(3 - (d))
+
+/* A move is stored in a single byte, as a direction in the low two
+ * bits plus a bit indicating if a box was pushed. The delta value of
+ * the direction depends on the width of the map, and so is not
+ * stored.
+ */
+typedef	unsigned char	dyx;
+
+#define	movedir(m)	((m) & 3)
+#define	movebox(m)	(((m) & 4) != 0)
+#define	mkmove(d, b)	((dyx)((d) | ((b) ? 4 : 0)))
 
 /* A list of moves.
  */
@@ -4,28 +4,102 @@
  * License. No warranty. See COPYING for details.
  */
 
+#include	<stdio.h>
 #include	<stdlib.h>
 #include	<string.h>
 #include	"gen.h"
 #include	"csokoban.h"
 #include	"userio.h"
+#include	"journal.h"
 #include	"play.h"
 
-/* One entry on the saved-state stack.
+/* How many moves apart the checkpoints are.
+ */
+#ifndef CHECKPOINTINTERVAL
+#define	CHECKPOINTINTERVAL	128
+#endif
+
+/* A copy of the position after a multiple of CHECKPOINTINTERVAL moves
+ * along the current line of play, which is the undo list followed by
+ * the redo list.
+ */
+typedef	struct checkpoint {
+    cell       *map;		/* the map */
+    yx		player;		/* the player's position */
+    short	storecount;	/* number of boxes on goal cells */
+    int		pushcount;	/* number of pushes made */
+    unsigned long hash;		/* the position's hash */
+} checkpoint;
+
+/* A position along the line of play, as seen in passing.
+ */
+typedef	struct linepos {
+    unsigned long hash;		/* the position's hash */
+    int		pushcount;	/* number of pushes made to reach it */
+} linepos;
+
+/* One entry on the saved-state stack. A saved state does not copy
+ * the game: its undo and redo lists begin with moves shared with the
+ * current lists, and only the moves after those are kept in the
+ * entry, in reverse order. The moves of the current lists are moved
+ * into an entry's tails just before they are overwritten, so saving
+ * costs the same no matter how long the game has been, and the map is
+ * recreated when restoring by undoing and redoing moves.
  */
 typedef	struct gamestack gamestack;
 struct gamestack {
     gamestack  *next;		/* pointer to the next entry */
-    gamestate	state;		/* the saved state */
+    int		shared[2];	/* moves shared with the undo and redo lists */
+    dyxlist	tail[2];	/* the rest of the saved lists, reversed */
 };
 
+/* The indexes of the two lists in a gamestack entry.
+ */
+#define	UNDOLIST	0
+#define	REDOLIST	1
+
 /* The stack of saved states.
  */
 static gamestack       *stack = NULL;
 
-/* The array of macros.
+/* No entry on the stack shares more than this many moves of the
+ * current undo and redo lists.
+ */
+static int		pinned[2] = { 0, 0 };
+
+/* The checkpoints along the current line of play, the number of them
+ * that are valid, and the number that have been allocated.
+ */
+static checkpoint      *checkpoints = NULL;
+static int		checkpointcount = 0;
+static int		checkpointsallocated = 0;
+
+/* The positions along the current line of play, indexed by the
+ * number of moves made, the number of them that are valid, and the
+ * number that have been allocated.
  */
-static dyxlist		macros[MAXHEIGHT * MAXWIDTH];
+static linepos	       *positions = NULL;
+static int		positioncount = 0;
+static int		positionsallocated = 0;
+
+/* A hash table of indexes into positions, its size (always a power of
+ * two), and the number of slots that are not empty (-1). Entries are
+ * never removed: the ones that no longer match their position are
+ * ignored, and dropped when the table is rebuilt.
+ */
+static int	       *postable = NULL;
+static int		postablesize = 0;
+static int		postableused = 0;
+
+/* TRUE if loops are cut out of the undo list as they are made.
+ */
+static int		cutloops = FALSE;
+
+/* The array of macros, one for each cell of the current map, and its
+ * size.
+ */
+static dyxlist	       *macros = NULL;
+static int		macrocount = 0;
 
 /* The macro currently being recorded or played back.
  */
@@ -44,25 +118,211 @@ static int		macroplay = -1;
  */
 static gamestate	state;
 
+/* The delta values of the four directions on the current map.
+ */
+static yx		dirdelta[4];
+
 /*
  * Game state handling functions
  */
 
-/* Make a copy of from that shares no memory with to.
+/* Give the saved states their own copies of the moves in the current
+ * undo list (which is UNDOLIST) or redo list (REDOLIST) from index n
+ * on. This must be called before the list is changed at index n.
+ */
+static void unsharemoves(int which, int n)
+{
+    dyxlist const      *list;
+    gamestack	       *s;
+    int			i;
+
+    if (n >= pinned[which])
+	return;
+    list = which == UNDOLIST ? &state.undo : &state.redo;
+    for (s = stack ; s ; s = s->next) {
+	for (i = s->shared[which] - 1 ; i >= n ; --i)
+	    addtomovelist(&s->tail[which], list->list[i]);
+	if (s->shared[which] > n)
+	    s->shared[which] = n;
+    }
+    pinned[which] = n;
+}
+
+/* Scramble the low 32 bits of n.
+ */
+static unsigned long mixbits(unsigned long n)
+{
+    n &= 0xFFFFFFFFUL;
+    n ^= n >> 16;
+    n = (n * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    n ^= n >> 13;
+    n = (n * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+    return n ^ (n >> 16);
+}
+
+/* Return the hash value of the player (box is FALSE) or a box (box is
+ * TRUE) at pos. The hash of a position is the exclusive-or of the
+ * values of everything in it, and so can be updated a move at a time.
+ * All the bits of an unsigned long are used, up to 64.
  */
-static void copygamestate(gamestate *to, gamestate const *from)
+static unsigned long poskey(int pos, int box)
 {
-    *to = *from;
-    copymovelist(&to->undo, &from->undo);
-    copymovelist(&to->redo, &from->redo);
+    unsigned long	n;
+
+    n = pos * 2 + box;
+    return mixbits(n + 0x9E3779B9UL) | mixbits(n + 0x7F4A7C15UL) << 16 << 16;
 }
 
-/* Free allocated memory associated with s.
+/* Put entry n of positions into the hash table, which must have room
+ * for it. A slot holding an entry that is no longer valid is reused.
  */
-static void freegamestate(gamestate *s)
+static void placeposition(int n)
 {
-    destroymovelist(&s->undo);
-    destroymovelist(&s->redo);
+    int	mask, i, k;
+
+    mask = postablesize - 1;
+    for (i = positions[n].hash & mask ; ; i = (i + 1) & mask) {
+	k = postable[i];
+	if (k < 0) {
+	    ++postableused;
+	    break;
+	}
+	if (k >= positioncount || k == n)
+	    break;
+    }
+    postable[i] = n;
+}
+
+/* Rebuild the hash table from the valid positions, making it big
+ * enough that it can take as many again before it is half full.
+ */
+static void rebuildpostable(void)
+{
+    int	n;
+
+    if (postablesize < 4 * positioncount) {
+	n = postablesize ? postablesize : 256;
+	while (n < 4 * positioncount)
+	    n *= 2;
+	free(postable);
+	if (!(postable = malloc(n * sizeof *postable)))
+	    memerrexit();
+	postablesize = n;
+    }
+    memset(postable, -1, postablesize * sizeof *postable);
+    postableused = 0;
+    for (n = 0 ; n < positioncount ; ++n)
+	placeposition(n);
+}
+
+/* Return TRUE if the position after the first n moves of the undo
+ * list, whose hash is the same as the current position's, is in fact
+ * the same position. It is rebuilt from the checkpoint before it, so
+ * that a collision of the hashes cannot pass for a loop.
+ */
+static int isrepeat(int n)
+{
+    cell       *map;
+    yx		player, d;
+    dyx		move;
+    int		size, same, i;
+
+    size = state.game->ysize * state.game->xsize;
+    if (!(map = malloc(size * sizeof *map)))
+	memerrexit();
+    memcpy(map, checkpoints[n / CHECKPOINTINTERVAL].map, size * sizeof *map);
+    player = checkpoints[n / CHECKPOINTINTERVAL].player;
+    for (i = n - n % CHECKPOINTINTERVAL ; i < n ; ++i) {
+	move = state.undo.list[i];
+	d = dirdelta[movedir(move)];
+	player += d;
+	if (movebox(move)) {
+	    map[player] &= ~BOX;
+	    map[player + d] |= BOX;
+	}
+    }
+    same = player == state.player;
+    for (i = 0 ; same && i < size ; ++i)
+	if ((map[i] ^ state.map[i]) & BOX)
+	    same = FALSE;
+    free(map);
+    return same;
+}
+
+/* Return the index of the earliest position in the undo list that is
+ * the same as the current one, or -1 if there is none.
+ */
+static int findrepeat(void)
+{
+    int	mask, found, i, k;
+
+    found = -1;
+    if (!postablesize)
+	return found;
+    mask = postablesize - 1;
+    for (i = state.hash & mask ; (k = postable[i]) >= 0 ; i = (i + 1) & mask)
+	if (k < state.undo.count && k < positioncount
+				 && positions[k].hash == state.hash
+				 && (found < 0 || k < found) && isrepeat(k))
+	    found = k;
+    return found;
+}
+
+/* Record the current position along the line of play, if it has not
+ * been already, and make it the next checkpoint if that is due.
+ */
+static void markposition(void)
+{
+    checkpoint *cp;
+    int		n;
+
+    if (state.undo.count == positioncount) {
+	if (positioncount == positionsallocated) {
+	    n = positionsallocated ? positionsallocated * 2 : 256;
+	    if (!(positions = realloc(positions, n * sizeof *positions)))
+		memerrexit();
+	    positionsallocated = n;
+	}
+	positions[positioncount].hash = state.hash;
+	positions[positioncount].pushcount = state.pushcount;
+	++positioncount;
+	if (2 * (postableused + 1) > postablesize)
+	    rebuildpostable();
+	else
+	    placeposition(positioncount - 1);
+    }
+
+    if (state.undo.count != checkpointcount * CHECKPOINTINTERVAL)
+	return;
+    n = state.game->ysize * state.game->xsize;
+    if (checkpointcount == checkpointsallocated) {
+	checkpoints = realloc(checkpoints,
+			      (checkpointsallocated + 1) * sizeof *checkpoints);
+	if (!checkpoints)
+	    memerrexit();
+	cp = checkpoints + checkpointsallocated;
+	if (!(cp->map = malloc(n * sizeof *cp->map)))
+	    memerrexit();
+	++checkpointsallocated;
+    }
+    cp = checkpoints + checkpointcount;
+    memcpy(cp->map, state.map, n * sizeof *cp->map);
+    cp->player = state.player;
+    cp->storecount = state.storecount;
+    cp->pushcount = state.pushcount;
+    cp->hash = state.hash;
+    ++checkpointcount;
+}
+
+/* Forget the checkpoints and positions that lie beyond the first n
+ * moves of the line of play, because those moves are about to change.
+ */
+static void truncateline(int n)
+{
+    if (checkpointcount > n / CHECKPOINTINTERVAL + 1)
+	checkpointcount = n / CHECKPOINTINTERVAL + 1;
+    if (positioncount > n + 1)
+	positioncount = n + 1;
 }
 
 /* Initialize the current state to the starting position of the
@@ -70,11 +330,27 @@ static void freegamestate(gamestate *s)
  */
 void initgamestate(int usemoves)
 {
-    int	i;
+    int	i, n;
 
-    memcpy(state.map, state.game->map, sizeof state.map);
+    n = state.game->ysize * state.game->xsize;
+    free(state.map);
+    if (!(state.map = malloc(n * sizeof *state.map)))
+	memerrexit();
+    unpackmap(state.game, state.map);
     state.player = state.game->start;
+    state.hash = poskey(state.player, FALSE);
+    for (i = 0 ; i < n ; ++i)
+	if (state.map[i] & BOX)
+	    state.hash ^= poskey(i, TRUE);
+    for (i = 0 ; i < checkpointsallocated ; ++i)
+	free(checkpoints[i].map);
+    checkpointsallocated = 0;
+    checkpointcount = 0;
+    positioncount = 0;
+    if (postablesize)
+	rebuildpostable();
     initmovelist(&state.undo);
+    unsharemoves(REDOLIST, 0);
     if (!state.game->moveanswer.count)
 	copymovelist(&state.redo, &state.game->pushanswer);
     else if (!state.game->pushanswer.count || usemoves)
@@ -85,9 +361,26 @@ void initgamestate(int usemoves)
     state.pushcount = 0;
     state.storecount = state.game->storecount;
     recording = FALSE;
-    for (i = 0 ; i < (int)(sizeof macros / sizeof *macros) ; ++i)
+    if (macrocount != n) {
+	for (i = 0 ; i < macrocount ; ++i)
+	    destroymovelist(macros + i);
+	if (!(macros = realloc(macros, n * sizeof *macros)))
+	    memerrexit();
+	memset(macros, 0, n * sizeof *macros);
+	macrocount = n;
+    }
+    for (i = 0 ; i < macrocount ; ++i)
 	if (macros[i].count)
 	    macros[i].count = 0;
+    markposition();
+    addtojournal(usemoves ? "M" : "P");
+}
+
+/* Turn the cutting of loops on or off.
+ */
+void setloopcutting(int flag)
+{
+    cutloops = flag;
 }
 
 /* Set the current puzzle to be game, with the given level number.
@@ -96,39 +389,183 @@ void selectgame(gamesetup *game, int level)
 {
     state.game = game;
     state.level = level;
+    dirdelta[WEST] = -1;
+    dirdelta[SOUTH] = +game->xsize;
+    dirdelta[NORTH] = -game->xsize;
+    dirdelta[EAST] = +1;
 }
 
 /*
  * Basic movement functions
  */
 
-/* Apply a legal move to the current state, adding it to the undo list
- * and any macro being recorded. (This function contains the actual
- * sokoban game logic. Everything else in this program is just
- * housekeeping.)
+/* Return the letter of the key for a move, capitalized if the move is
+ * a push.
  */
-static void domove(dyx move)
+static int movetoletter(dyx move)
 {
-    yx	j;
+    return "hjklHJKL"[move & 7];
+}
 
+/* Move the player, and the box if the move is a push, changing the
+ * counts to match. (This function contains the actual sokoban game
+ * logic. Everything else in this program is just housekeeping.)
+ */
+static void applymove(dyx move)
+{
+    yx	d, j;
+
+    d = dirdelta[movedir(move)];
     state.map[state.player] &= ~PLAYER;
-    state.player += move.yx;
+    state.hash ^= poskey(state.player, FALSE);
+    state.player += d;
     state.map[state.player] |= PLAYER;
+    state.hash ^= poskey(state.player, FALSE);
     ++state.movecount;
-    if (move.box) {
-	j = state.player + move.yx;
+    if (movebox(move)) {
+	j = state.player + d;
 	state.map[state.player] &= ~BOX;
 	state.map[j] |= BOX;
+	state.hash ^= poskey(state.player, TRUE) ^ poskey(j, TRUE);
 	if (state.map[state.player] & GOAL)
 	    --state.storecount;
 	if (state.map[j] & GOAL)
 	    ++state.storecount;
 	++state.pushcount;
     }
+}
+
+/* Reverse what applymove() did for the same move.
+ */
+static void unapplymove(dyx move)
+{
+    yx	d, j;
+
+    d = dirdelta[movedir(move)];
+    if (movebox(move)) {
+	j = state.player + d;
+	state.map[j] &= ~BOX;
+	state.map[state.player] |= BOX;
+	state.hash ^= poskey(state.player, TRUE) ^ poskey(j, TRUE);
+	if (state.map[j] & GOAL)
+	    --state.storecount;
+	if (state.map[state.player] & GOAL)
+	    ++state.storecount;
+	--state.pushcount;
+    }
+    state.map[state.player] &= ~PLAYER;
+    state.hash ^= poskey(state.player, FALSE);
+    state.player -= d;
+    state.map[state.player] |= PLAYER;
+    state.hash ^= poskey(state.player, FALSE);
+    --state.movecount;
+}
+
+/* Redo the next move of the line of play without any of domove()'s
+ * bookkeeping.
+ */
+static void stepforward(void)
+{
+    dyx	move;
+
+    move = state.redo.list[--state.redo.count];
+    applymove(move);
+    unsharemoves(UNDOLIST, state.undo.count);
+    addtomovelist(&state.undo, move);
+    markposition();
+}
+
+/* Undo the last move without any of undomove()'s bookkeeping.
+ */
+static void stepback(void)
+{
+    dyx	move;
+
+    move = state.undo.list[--state.undo.count];
+    unsharemoves(REDOLIST, state.redo.count);
+    addtomovelist(&state.redo, move);
+    unapplymove(move);
+}
+
+/* Go to the position after the first n moves of the line of play. If
+ * the nearest checkpoint before it is closer than the current
+ * position, the checkpoint is copied in and the moves in between are
+ * moved across the lists unapplied, so that no more than
+ * CHECKPOINTINTERVAL moves are ever applied. FALSE is returned if the
+ * position is the current one.
+ */
+static int seekmove(int n)
+{
+    char	event[16];
+    checkpoint *cp;
+    int		c, pos;
+
+    if (n < 0)
+	n = 0;
+    else if (n > state.undo.count + state.redo.count)
+	n = state.undo.count + state.redo.count;
+    if (n == state.undo.count)
+	return FALSE;
 
+    c = n / CHECKPOINTINTERVAL;
+    if (c >= checkpointcount)
+	c = checkpointcount - 1;
+    pos = c * CHECKPOINTINTERVAL;
+    if (n - pos < abs(n - state.undo.count)) {
+	while (state.undo.count > pos) {
+	    unsharemoves(REDOLIST, state.redo.count);
+	    addtomovelist(&state.redo, state.undo.list[--state.undo.count]);
+	}
+	while (state.undo.count < pos) {
+	    unsharemoves(UNDOLIST, state.undo.count);
+	    addtomovelist(&state.undo, state.redo.list[--state.redo.count]);
+	}
+	cp = checkpoints + c;
+	memcpy(state.map, cp->map,
+	       state.game->ysize * state.game->xsize * sizeof *state.map);
+	state.player = cp->player;
+	state.storecount = cp->storecount;
+	state.pushcount = cp->pushcount;
+	state.hash = cp->hash;
+	state.movecount = pos;
+    }
+    while (state.undo.count < n)
+	stepforward();
+    while (state.undo.count > n)
+	stepback();
+
+    sprintf(event, "g%d;", n);
+    addtojournal(event);
+    return TRUE;
+}
+
+/* Apply a legal move to the current state, adding it to the undo list
+ * and any macro being recorded.
+ */
+static void domove(dyx move)
+{
+    char	event[2] = " ";
+
+    applymove(move);
+    unsharemoves(UNDOLIST, state.undo.count);
     addtomovelist(&state.undo, move);
+    markposition();
     if (recording)
 	addtomovelist(macro, move);
+    event[0] = movetoletter(move);
+    addtojournal(event);
+}
+
+/* Cut the moves after the first n off the undo list, the position
+ * after n moves being the same as the current one.
+ */
+static void cutloop(int n)
+{
+    state.undo.count = n;
+    state.movecount = n;
+    state.pushcount = positions[n].pushcount;
+    truncateline(n);
+    addtojournal("c");
 }
 
 /* Unapply the last move on the undo list, reversing what was done in
@@ -137,31 +574,19 @@ static void domove(dyx move)
 int undomove(void)
 {
     dyx	move;
-    yx	j;
 
     if (!state.undo.count)
 	return FALSE;
 
     move = state.undo.list[--state.undo.count];
+    unsharemoves(REDOLIST, state.redo.count);
     addtomovelist(&state.redo, move);
-    if (move.box) {
-	j = state.player + move.yx;
-	state.map[j] &= ~BOX;
-	state.map[state.player] |= BOX;
-	if (state.map[j] & GOAL)
-	    --state.storecount;
-	if (state.map[state.player] & GOAL)
-	    ++state.storecount;
-	--state.pushcount;
-    }
-    state.map[state.player] &= ~PLAYER;
-    state.player -= move.yx;
-    state.map[state.player] |= PLAYER;
-    --state.movecount;
+    unapplymove(move);
     if (recording && macro->count) {
 	if (--macro->count == 0)
 	    recording = FALSE;
     }
+    addtojournal("x");
     return TRUE;
 }
 
@@ -195,39 +620,52 @@ int redomoves(int n)
     return TRUE;
 }
 
+/* Move n tenths of the way along the line of play.
+ */
+int seektenths(int n)
+{
+    int	len;
+
+    if (recording)
+	return FALSE;
+    len = state.undo.count + state.redo.count;
+    return seekmove(state.undo.count + n * ((len + 9) / 10));
+}
+
 /* Check a move for validity in the current state. If it is valid, it
  * is applied via domove(), otherwise return FALSE. If the move is
  * equivalent to an undo or a redo, then use that instead; otherwise,
- * the redo list is reset.
+ * the redo list is reset, and if the move returns to a position
+ * already in the undo list, the loop may be cut out.
  */
-int newmove(yx delta)
+int newmove(int dir)
 {
     dyx	move;
-    int	b;
     yx	j;
+    int	n;
 
-    j = state.player + delta;
+    j = state.player + dirdelta[dir];
     if (state.map[j] & WALL)
 	return FALSE;
     if (state.undo.count) {
-	move = state.undo.list[state.undo.count - 1];
-	if (!move.box && move.yx == -delta)
+	if (state.undo.list[state.undo.count - 1] == mkmove(backwards(dir),
+							    FALSE))
 	    return undomove();
     }
 
-    b = state.map[j] & BOX ? TRUE : FALSE;
-    if (b && state.map[j + delta] & (BOX | WALL))
+    move = mkmove(dir, state.map[j] & BOX);
+    if (movebox(move) && state.map[j + dirdelta[dir]] & (BOX | WALL))
 	return FALSE;
     if (state.redo.count) {
-	move = state.redo.list[state.redo.count - 1];
-	if (move.box == b && move.yx == delta)
+	if (state.redo.list[state.redo.count - 1] == move)
 	    return redomove();
     }
 
-    move.yx = delta;
-    move.box = b;
+    truncateline(state.undo.count);
     domove(move);
     state.redo.count = 0;
+    if (cutloops && (n = findrepeat()) >= 0)
+	cutloop(n);
     return TRUE;
 }
 
@@ -276,7 +714,7 @@ int startmacro(void)
 int macromove(void)
 {
     if (macroplay >= 0)
-	if (!newmove(macro->list[macroplay].yx) || ++macroplay >= macro->count)
+	if (!newmove(movedir(macro->list[macroplay])) || ++macroplay >= macro->count)
 	    macroplay = -1;
     return macroplay >= 0;
 }
@@ -292,7 +730,8 @@ int isplaying(void)
  * State-saving functions
  */
 
-/* Save the current state of the game on a stack.
+/* Save the current state of the game on a stack. Nothing is copied
+ * until the current lists are changed.
  */
 void savestate(void)
 {
@@ -300,24 +739,62 @@ void savestate(void)
 
     if (!(save = malloc(sizeof *save)))
 	memerrexit();
-    copygamestate(&save->state, &state);
+    memset(save, 0, sizeof *save);
+    initmovelist(&save->tail[UNDOLIST]);
+    initmovelist(&save->tail[REDOLIST]);
+    save->shared[UNDOLIST] = state.undo.count;
+    save->shared[REDOLIST] = state.redo.count;
+    if (pinned[UNDOLIST] < state.undo.count)
+	pinned[UNDOLIST] = state.undo.count;
+    if (pinned[REDOLIST] < state.redo.count)
+	pinned[REDOLIST] = state.redo.count;
     save->next = stack;
     stack = save;
+    addtojournal("s");
 }
 
-/* Replace the current state with the last saved state.
+/* Replace the current state with the last saved state. The moves of
+ * the current undo list beyond those the saved one shares are undone,
+ * and then the rest of the saved moves are applied.
  */
 int restorestate(void)
 {
     gamestack  *next;
+    dyxlist    *tail;
+    dyx		move;
 
     if (!stack)
 	return FALSE;
-    freegamestate(&state);
-    state = stack->state;
+
+    truncateline(state.undo.count < stack->shared[UNDOLIST]
+			? state.undo.count : stack->shared[UNDOLIST]);
+    while (state.undo.count > stack->shared[UNDOLIST])
+	unapplymove(state.undo.list[--state.undo.count]);
+    while (state.undo.count < stack->shared[UNDOLIST]) {
+	applymove(state.undo.list[state.undo.count++]);
+	markposition();
+    }
+    tail = &stack->tail[UNDOLIST];
+    while (tail->count) {
+	move = tail->list[--tail->count];
+	applymove(move);
+	unsharemoves(UNDOLIST, state.undo.count);
+	addtomovelist(&state.undo, move);
+	markposition();
+    }
+
+    unsharemoves(REDOLIST, stack->shared[REDOLIST]);
+    state.redo.count = stack->shared[REDOLIST];
+    tail = &stack->tail[REDOLIST];
+    while (tail->count)
+	addtomovelist(&state.redo, tail->list[--tail->count]);
+
+    destroymovelist(&stack->tail[UNDOLIST]);
+    destroymovelist(&stack->tail[REDOLIST]);
     next = stack->next;
     free(stack);
     stack = next;
+    addtojournal("r");
     return TRUE;
 }
 
@@ -328,11 +805,89 @@ void freesavedstates(void)
     gamestack  *next;
 
     while (stack) {
-	freegamestate(&stack->state);
+	destroymovelist(&stack->tail[UNDOLIST]);
+	destroymovelist(&stack->tail[REDOLIST]);
 	next = stack->next;
 	free(stack);
 	stack = next;
     }
+    pinned[UNDOLIST] = 0;
+    pinned[REDOLIST] = 0;
+}
+
+/*
+ * Journal functions
+ */
+
+/* Reapply a move read from the journal. The move must fit the current
+ * position, and it is treated as a redo if it matches the top of the
+ * redo list, exactly as newmove() would have.
+ */
+static int replaymove(int ch)
+{
+    char const *p;
+    dyx		move;
+    yx		d, j;
+
+    if (!ch || !(p = strchr("hjklHJKL", ch)))
+	return FALSE;
+    move = (dyx)(p - "hjklHJKL");
+    d = dirdelta[movedir(move)];
+    j = state.player + d;
+    if (state.map[j] & WALL)
+	return FALSE;
+    if (movebox(move) != (state.map[j] & BOX ? TRUE : FALSE))
+	return FALSE;
+    if (movebox(move) && state.map[j + d] & (BOX | WALL))
+	return FALSE;
+    if (state.redo.count) {
+	if (state.redo.list[state.redo.count - 1] == move)
+	    return redomove();
+    }
+    truncateline(state.undo.count);
+    domove(move);
+    state.redo.count = 0;
+    return TRUE;
+}
+
+/* Bring the current puzzle to the position recorded in a journal. The
+ * events are the letters of the moves (capitalized for pushes), x for
+ * an undo, c for a loop cut out of the undo list, s and r for saving
+ * and restoring a position, g followed by a move number and a
+ * semicolon for a jump along the line of play, and M or P for a
+ * return to the starting position with the least-moves or the
+ * least-pushes solution on the redo list. The replayed events are
+ * added to the current journal in turn.
+ */
+int replayjournal(char const *events)
+{
+    int	n;
+
+    if (*events != 'M' && *events != 'P')
+	return FALSE;
+    for ( ; *events ; ++events) {
+	switch (*events) {
+	  case 'M':	initgamestate(TRUE);			break;
+	  case 'P':	initgamestate(FALSE);			break;
+	  case 'x':	if (!undomove())	return TRUE;	break;
+	  case 'c':
+	    if ((n = findrepeat()) < 0)
+		return TRUE;
+	    cutloop(n);
+	    break;
+	  case 's':	savestate();				break;
+	  case 'r':	if (!restorestate())	return TRUE;	break;
+	  case 'g':
+	    n = 0;
+	    while (n < 10000000 && events[1] >= '0' && events[1] <= '9')
+		n = n * 10 + *++events - '0';
+	    if (*++events != ';' || !seekmove(n))
+		return TRUE;
+	    break;
+	  default:	if (!replaymove(*events)) return TRUE;	break;
+	}
+    }
+    return TRUE;
 }
 
 /*
@@ -346,12 +901,13 @@ static void outputmapstate(void)
     char	obj[2] = " ";
     cell       *map;
     int		spaces;
-    int		y, x;
+    int		y, x, w;
 
     if (state.movecount)
 	printf(";;; move %d\n", state.movecount);
+    w = state.game->xsize;
     map = state.map;
-    for (y = 1, map += XSIZE ; y < state.game->ysize - 1 ; ++y, map += XSIZE) {
+    for (y = 1, map += w ; y < state.game->ysize - 1 ; ++y, map += w) {
 	spaces = 0;
 	for (x = 1 ; x < state.game->xsize - 1 ; ++x) {
 	    if (map[x] & PLAYER)
@@ -378,7 +934,7 @@ static void outputmapstate(void)
  */
 int displaygamesolution(void)
 {
-    dyx		lastmove = { 0 };
+    int		lastmove = -1;
     dyx	       *move;
     int		i;
 
@@ -387,7 +943,7 @@ int displaygamesolution(void)
     move = state.redo.list + state.redo.count;
     for (i = 0 ; i < state.redo.count ; ++i) {
 	--move;
-	if (move->yx != lastmove.yx || move->box != lastmove.box) {
+	if (*move != lastmove) {
 	    lastmove = *move;
 	    outputmapstate();
 	}
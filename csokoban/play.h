@@ -22,7 +22,8 @@ typedef	struct gamestate {
     int		pushcount;		/* number of pushes made so far */
     dyxlist	undo;			/* the list of moves */
     dyxlist	redo;			/* the list of recently undone moves */
-    cell	map[MAXHEIGHT * MAXWIDTH]; /* the game's map */
+    cell       *map;			/* the game's map */
+    unsigned long hash;			/* hash of the player and boxes */
 } gamestate;
 
 /* Set the current puzzle to be game, with the given level number.
@@ -40,10 +41,17 @@ extern void selectgame(gamesetup *game, int level);
  */
 extern void initgamestate(int usemoves);
 
-/* Execute a new move in the current game. If the move is illegal,
- * FALSE will be returned and the state is unchanged.
+/* Set whether a new move that brings back a position from earlier in
+ * the undo list cuts out the moves in between, so that the solutions
+ * saved have no loops in them.
  */
-extern int newmove(yx delta);
+extern void setloopcutting(int flag);
+
+/* Execute a new move in the current game, one step in direction dir.
+ * If the move is illegal, FALSE will be returned and the state is
+ * unchanged.
+ */
+extern int newmove(int dir);
 
 /* Undo the latest move. FALSE is returned if there is no latest move.
  */
@@ -63,6 +71,14 @@ extern int redomove(void);
  */
 extern int redomoves(int n);
 
+/* Undo or redo moves to go n tenths of the way along the line of play
+ * (the moves on the undo list followed by those on the redo list),
+ * forwards if n is positive and backwards if it is negative. Only a
+ * bounded number of moves are actually applied, however far the jump.
+ * FALSE is returned if no moves were undone or redone.
+ */
+extern int seektenths(int n);
+
 /* Return TRUE if the current state has completed the puzzle.
  */
 extern int checkfinished(void);
@@ -102,6 +118,14 @@ extern int restorestate(void);
  */
 extern void freesavedstates(void);
 
+/* Bring the current puzzle to the position recorded in the journal
+ * by replaying events, which is the text returned by readjournal().
+ * Replay stops at the first event that does not fit. FALSE is
+ * returned if the events do not begin at the starting position, in
+ * which case initgamestate() must still be called.
+ */
+extern int replayjournal(char const *events);
+
 /* Display the current game state to the user.
  */
 extern int drawscreen(int index);
@@ -0,0 +1,29 @@
+/* prefetch.h: Functions for reading the neighboring puzzles in the
+ * background.
+ *
+ * Copyright (C) 2000 by Brian Raiter, under the GNU General Public
+ * License. No warranty. See COPYING for details.
+ */
+
+#ifndef	_prefetch_h_
+#define	_prefetch_h_
+
+#include	"fileread.h"
+
+/* Begin reading the puzzles on either side of puzzle number level in
+ * series, along with the user's solutions for them, in the
+ * background. The background thread is started the first time this
+ * function is called. The caller must already have reserved room in
+ * series for the following puzzle, so that reading it does not move
+ * the puzzles already in memory.
+ */
+extern void prefetchlevels(gameseries *series, int level);
+
+/* Wait for any reading in progress to finish, and keep the background
+ * thread from starting anything more until prefetchlevels() is called
+ * again. The puzzle files and the answer files must not be touched
+ * while the background thread is reading them.
+ */
+extern void stopprefetch(void);
+
+#endif